@@ -0,0 +1,108 @@
+/**
+ * 快速跟踪点的 agent，由调试器通过 LD_PRELOAD 加载到 tracee 中
+ * 加载时映射调试器传来的共享内存，写入 bdb_agent_hit 的地址后用 SIGTRAP 通知调试器安装蹦床
+ * 蹦床保存了通用寄存器，但没有保存 SSE/AVX 寄存器，所以用 -mgeneral-regs-only 编译，命中时只调用不碰浮点寄存器的函数
+ */
+
+#include <trace_ring.hh>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <csignal>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+using namespace BitTech;
+
+namespace {
+
+TraceRing::Header *header = nullptr;
+TraceRing::Record *records = nullptr;
+__thread uint32_t cached_tid = 0;
+
+// 不经过 libc 取线程号，结果缓存在线程局部变量中
+auto current_tid() -> uint32_t {
+    if (cached_tid == 0) {
+        long tid;
+        asm volatile("syscall" : "=a"(tid) : "a"(SYS_gettid) : "rcx", "r11", "memory");
+        cached_tid = static_cast<uint32_t>(tid);
+    }
+    return cached_tid;
+}
+
+// fork 出的子进程中线程号变了
+auto forget_tid() -> void {
+    cached_tid = 0;
+}
+
+auto register_value(TraceRing::Frame const *frame, uint8_t reg) -> uint64_t {
+    if (reg == TraceRing::reg_rsp) {
+        return reinterpret_cast<uint64_t>(frame + 1) + TraceRing::red_zone;
+    }
+    return reinterpret_cast<uint64_t const *>(frame)[reg];
+}
+
+}
+
+// 蹦床调用的入口，frame 指向蹦床保存的寄存器，site 是跟踪点编号
+extern "C" __attribute__((visibility("default"))) void bdb_agent_hit(TraceRing::Frame const *frame, uint32_t site) {
+    if (header == nullptr || site >= TraceRing::max_sites) {
+        return;
+    }
+    auto& s = header->sites[site];
+    __atomic_fetch_add(&s.hits, 1, __ATOMIC_RELAXED);
+
+    // 预留一个位置，缓冲区满时丢弃这条记录
+    auto head = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+    do {
+        if (head - __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE) >= TraceRing::capacity) {
+            __atomic_fetch_add(&header->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&header->head, &head, head + 1, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    auto& record = records[head & (TraceRing::capacity - 1)];
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    record.ns = static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    record.site = site;
+    record.tid = current_tid();
+    auto count = s.reg_count < TraceRing::max_regs ? s.reg_count : TraceRing::max_regs;
+    for (uint8_t i = 0; i < count; ++i) {
+        record.regs[i] = register_value(frame, s.regs[i]);
+    }
+    __atomic_store_n(&record.seq, head + 1, __ATOMIC_RELEASE);
+}
+
+// 环境变量只对 tracee 本身有效，去掉之后 tracee 再 execv 的程序不会加载 agent
+__attribute__((constructor)) static void bdb_agent_init() {
+    auto fd_text = getenv("BDB_AGENT_FD");
+    if (fd_text == nullptr) {
+        return;
+    }
+    auto fd = atoi(fd_text);
+    unsetenv("BDB_AGENT_FD");
+    unsetenv("LD_PRELOAD");
+
+    auto mapped = mmap(nullptr, TraceRing::size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return;
+    }
+    auto h = static_cast<TraceRing::Header *>(mapped);
+    if (h->magic != TraceRing::magic || __atomic_load_n(&h->ready, __ATOMIC_ACQUIRE)) {
+        munmap(mapped, TraceRing::size());
+        return;
+    }
+
+    header = h;
+    records = TraceRing::records(h);
+    pthread_atfork(nullptr, nullptr, forget_tid);
+    header->hit_function = reinterpret_cast<uint64_t>(&bdb_agent_hit);
+    header->agent_pid = static_cast<uint32_t>(getpid());
+    __atomic_store_n(&header->ready, 1, __ATOMIC_RELEASE);
+    // 调试器收到这个 SIGTRAP 后安装蹦床，然后不带信号地继续运行
+    raise(SIGTRAP);
+}
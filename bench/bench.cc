@@ -0,0 +1,389 @@
+/**
+ * 调试器热点路径的基准测试，由 make bench 运行
+ * 被调试程序由 bench/Makefile 生成到输出目录中：
+ *   units-<单元数>x<函数数>  成千上万个编译单元和函数，测加载和 DWARF 查询
+ *   heap                   大堆，测 PtraceProxy 读写内存和寄存器
+ *   loop                   紧凑的循环，测断点命中后继续运行的吞吐和 step/next 的延迟
+ *   threads                很多线程，测停下和恢复所有线程的开销
+ *   recursion              深递归，测栈回溯
+ * 调试器自身的打印重定向到 /dev/null，结果以 JSON 输出到标准输出
+ * 用法: bdb-bench <输出目录> [--units N] [--funcs N] [--depth N] [--threads N] [--heap-mb N]
+ */
+
+#include <inferior.hh>
+#include <commands/step.hh>
+#include <commands/next.hh>
+#include <stopwatch.hh>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+namespace BitTech {
+
+class Bench {
+public:
+    struct Result {
+        std::string name;
+        std::string tracee;
+        std::size_t iterations;
+        double total_ms;
+        // 读写内存的基准测试传输的总字节数，其余为 0
+        uint64_t bytes;
+    };
+
+public:
+    Bench(std::string const& dir, std::map<std::string, long> const& scale)
+        : dir{dir}, scale{scale}, results{}, errors{}, current{}, saved_stdout{-1} {}
+
+public:
+    auto run() -> void {
+        group("dwarf", [this] { bench_dwarf(); });
+        group("ptrace", [this] { bench_ptrace(); });
+        group("breakpoint", [this] { bench_breakpoint(); });
+        group("threads", [this] { bench_threads(); });
+        group("unwind", [this] { bench_unwind(); });
+    }
+
+    // 结果按 JSON 输出，每项给出总耗时、每次操作的微秒数和每秒的操作数
+    auto print_json() const -> void {
+        printf("{\n  \"scale\": {");
+        auto first = true;
+        for (auto const& item : scale) {
+            printf("%s\"%s\": %ld", first ? "" : ", ", item.first.c_str(), item.second);
+            first = false;
+        }
+        printf("},\n  \"results\": [\n");
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            auto const& r = results[i];
+            auto per_op_us = r.iterations > 0 ? r.total_ms * 1000 / r.iterations : 0;
+            auto ops_per_sec = r.total_ms > 0 ? r.iterations * 1000 / r.total_ms : 0;
+            printf("    {\"name\": \"%s\", \"tracee\": \"%s\", \"iterations\": %zu, \"total_ms\": %.3f, "
+                "\"per_op_us\": %.3f, \"ops_per_sec\": %.1f",
+                r.name.c_str(), r.tracee.c_str(), r.iterations, r.total_ms, per_op_us, ops_per_sec);
+            if (r.bytes > 0) {
+                printf(", \"bytes_per_sec\": %.0f", r.total_ms > 0 ? r.bytes * 1000 / r.total_ms : 0);
+            }
+            printf("}%s\n", i + 1 < results.size() ? "," : "");
+        }
+        printf("  ],\n  \"errors\": [");
+        for (std::size_t i = 0; i < errors.size(); ++i) {
+            printf("%s\"%s\"", i > 0 ? ", " : "", escape(errors[i]).c_str());
+        }
+        printf("]\n}\n");
+    }
+
+    // 有错误时结果不完整，make bench 以失败结束
+    auto ok() const -> bool {
+        return errors.empty();
+    }
+
+private:
+    // 加载成千上万个编译单元的程序：第一次没有索引缓存，第二次映射缓存
+    // 之后在有缓存的调试信息上按地址查函数和行、按名字查函数
+    auto bench_dwarf() -> void {
+        char name[64];
+        snprintf(name, sizeof(name), "units-%ldx%ld", scale.at("units"), scale.at("funcs"));
+        auto path = dir + "/" + name;
+        {
+            Stopwatch stopwatch{};
+            Inferior inferior{path};
+            // build_time 等待后台的函数名索引建立完成，析构时等待索引缓存写完
+            inferior.get_name_index().build_time();
+            record("load_cold", name, 1, stopwatch.elapsed_ms());
+        }
+
+        Stopwatch stopwatch{};
+        Inferior inferior{path};
+        inferior.get_name_index().build_time();
+        record("load_warm", name, 1, stopwatch.elapsed_ms());
+
+        std::vector<std::string> names{};
+        for (long i = 0; i < scale.at("units"); ++i) {
+            for (long j = 0; j < scale.at("funcs"); ++j) {
+                names.push_back("f_" + std::to_string(i) + "_" + std::to_string(j));
+            }
+        }
+        std::mt19937 random{1};
+        std::shuffle(names.begin(), names.end(), random);
+
+        std::vector<std::intptr_t> addrs{};
+        stopwatch.restart();
+        for (auto const& func : names) {
+            // 函数开头之后几个字节，落在函数中间
+            addrs.push_back(at_low_pc(inferior.get_die_by_function_name(func)) + 4);
+        }
+        record("get_die_by_function_name", name, names.size(), stopwatch.elapsed_ms());
+
+        // 第一遍按编译单元建立函数和行号表，第二遍只是查询
+        for (auto pass : {"first", "warm"}) {
+            stopwatch.restart();
+            for (auto addr : addrs) {
+                inferior.get_function_die_by_addr(addr);
+            }
+            record(std::string{"get_function_die_by_addr."} + pass, name, addrs.size(), stopwatch.elapsed_ms());
+
+            stopwatch.restart();
+            for (auto addr : addrs) {
+                inferior.get_line_iter_by_addr(addr);
+            }
+            record(std::string{"get_line_iter_by_addr."} + pass, name, addrs.size(), stopwatch.elapsed_ms());
+        }
+    }
+
+    // 在 heap 的 ready(buf, size) 停下，按不同的粒度读写 tracee 的内存和寄存器
+    auto bench_ptrace() -> void {
+        Inferior inferior{dir + "/heap"};
+        run_to(inferior, "ready", {std::to_string(scale.at("heap-mb"))});
+        auto tid = inferior.current_thread().tid;
+        auto regs = PtraceProxy::get_registers(tid);
+        auto buf = static_cast<std::intptr_t>(regs.rdi);
+        auto size = static_cast<std::size_t>(regs.rsi);
+        std::mt19937 random{1};
+        std::uniform_int_distribution<std::size_t> offset{0, size - 4096};
+
+        Stopwatch stopwatch{};
+        const std::size_t n = 100000;
+        for (std::size_t i = 0; i < n; ++i) {
+            regs = PtraceProxy::get_registers(tid);
+        }
+        record("get_registers", "heap", n, stopwatch.restart());
+        for (std::size_t i = 0; i < n; ++i) {
+            PtraceProxy::set_registers(tid, regs);
+        }
+        record("set_registers", "heap", n, stopwatch.restart());
+
+        std::vector<char> data(1 << 20);
+        for (std::size_t i = 0; i < n; ++i) {
+            PtraceProxy::read_memory(tid, buf + offset(random), data.data(), 8);
+        }
+        record("read_memory.8", "heap", n, stopwatch.restart(), n * 8);
+        for (std::size_t i = 0; i < n / 5; ++i) {
+            PtraceProxy::read_memory(tid, buf + offset(random), data.data(), 4096);
+        }
+        record("read_memory.4k", "heap", n / 5, stopwatch.restart(), n / 5 * 4096);
+        for (std::size_t at = 0; at + data.size() <= size; at += data.size()) {
+            PtraceProxy::read_memory(tid, buf + at, data.data(), data.size());
+        }
+        record("read_memory.1m", "heap", size / data.size(), stopwatch.restart(), size / data.size() * data.size());
+
+        // 一次系统调用读 64 块分散的 16 字节，跟踪点收集多项数据时就是这样读的
+        std::vector<iovec> local(64), remote(64);
+        for (std::size_t i = 0; i < n / 5; ++i) {
+            for (std::size_t k = 0; k < local.size(); ++k) {
+                local[k] = iovec{data.data() + k * 16, 16};
+                remote[k] = iovec{reinterpret_cast<void *>(buf + offset(random)), 16};
+            }
+            PtraceProxy::read_ranges(tid, local.data(), remote.data(), local.size());
+        }
+        record("read_ranges.64x16", "heap", n / 5, stopwatch.restart(), n / 5 * 64 * 16);
+
+        for (std::size_t i = 0; i < n; ++i) {
+            auto at = buf + offset(random);
+            PtraceProxy::write_memory(tid, at, data.data(), 8);
+        }
+        record("write_memory.8", "heap", n, stopwatch.restart(), n * 8);
+
+        if (inferior.running()) {
+            inferior.stop();
+        }
+    }
+
+    // loop 的 tick 上有断点，反复继续运行；之后在同一个程序上反复 next 和 step
+    auto bench_breakpoint() -> void {
+        Inferior inferior{dir + "/loop"};
+        run_to(inferior, "tick", {});
+
+        const std::size_t n = 20000;
+        Stopwatch stopwatch{};
+        auto done = repeat(inferior, n, [&inferior] { inferior.continue_execute(); });
+        record_repeated("hit_and_continue", "loop", n, done, stopwatch.restart());
+
+        Next next{inferior};
+        Step step{inferior};
+        const std::size_t steps = 2000;
+        done = repeat(inferior, steps, [&next] { next.run({}); });
+        record_repeated("next", "loop", steps, done, stopwatch.restart());
+        done = repeat(inferior, steps, [&step] { step.run({}); });
+        record_repeated("step", "loop", steps, done, stopwatch.restart());
+
+        if (inferior.running()) {
+            inferior.stop();
+        }
+    }
+
+    // 所有线程都启动后，反复在后台恢复所有线程再用 Ctrl-C 的方式让它们停下；之后每个线程都会碰到 work 上的断点
+    auto bench_threads() -> void {
+        auto threads = std::to_string(scale.at("threads"));
+        Inferior inferior{dir + "/threads"};
+        run_to(inferior, "ready", {threads});
+
+        const std::size_t n = 200;
+        Stopwatch stopwatch{};
+        auto done = repeat(inferior, n, [&inferior] {
+            inferior.continue_in_background();
+            inferior.interrupt();
+        });
+        record_repeated("resume_and_interrupt", "threads-" + threads, n, done, stopwatch.restart());
+
+        inferior.set_breakpoint_at_addr(function_addr(inferior, "work"));
+        stopwatch.restart();
+        done = repeat(inferior, n * 10, [&inferior] { inferior.continue_execute(); });
+        record_repeated("hit_and_continue", "threads-" + threads, n * 10, done, stopwatch.restart());
+
+        if (inferior.running()) {
+            inferior.stop();
+        }
+    }
+
+    // 在 recursion 最深处的 leaf 停下，完整回溯整个调用栈，以及单步命令用到的只回溯两层
+    auto bench_unwind() -> void {
+        auto depth = std::to_string(scale.at("depth"));
+        Inferior inferior{dir + "/recursion"};
+        run_to(inferior, "leaf", {depth});
+
+        const std::size_t n = 20000;
+        Stopwatch stopwatch{};
+        for (std::size_t i = 0; i < n; ++i) {
+            inferior.backtrace(2);
+        }
+        record("backtrace.2", "recursion-" + depth, n, stopwatch.restart());
+
+        std::size_t frames = 0;
+        for (std::size_t i = 0; i < 20; ++i) {
+            frames = inferior.backtrace(scale.at("depth") + 16).size();
+        }
+        record("backtrace.full", "recursion-" + depth, 20, stopwatch.restart());
+        if (frames < static_cast<std::size_t>(scale.at("depth"))) {
+            errors.push_back("backtrace.full 只回溯了 " + std::to_string(frames) + " 层");
+        }
+
+        if (inferior.running()) {
+            inferior.stop();
+        }
+    }
+
+private:
+    // 在函数开头设置断点后启动 tracee，停在断点上
+    auto run_to(Inferior& inferior, std::string const& func, std::vector<std::string> const& args) -> void {
+        inferior.set_breakpoint_at_addr(function_addr(inferior, func));
+        inferior.start(args);
+        if (!inferior.running()) {
+            EXCEPTION("tracee 没有停在 " + func);
+        }
+    }
+
+    static auto function_addr(Inferior& inferior, std::string const& func) -> std::intptr_t {
+        return inferior.to_runtime(at_low_pc(inferior.get_die_by_function_name(func)));
+    }
+
+    auto record(std::string const& name, std::string const& tracee, std::size_t iterations, double ms, uint64_t bytes = 0) -> void {
+        results.push_back(Result{current + "." + name, tracee, iterations, ms, bytes});
+    }
+
+    // 反复执行 body 直到 n 次或者 tracee 结束，返回 tracee 仍在运行时完成的次数
+    template <typename Body>
+    static auto repeat(Inferior& inferior, std::size_t n, Body body) -> std::size_t {
+        std::size_t done = 0;
+        while (done < n && inferior.running()) {
+            body();
+            if (!inferior.running()) {
+                break;
+            }
+            ++done;
+        }
+        return done;
+    }
+
+    // 按实际完成的次数记录，少于计划的次数时记为错误，结果不可信
+    auto record_repeated(std::string const& name, std::string const& tracee, std::size_t planned, std::size_t done, double ms) -> void {
+        record(name, tracee, done, ms);
+        if (done < planned) {
+            errors.push_back(current + "." + name + ": tracee 提前结束，只完成了 " + std::to_string(done)
+                + "/" + std::to_string(planned) + " 次");
+        }
+    }
+
+    // 一组基准测试失败时记下原因，继续下一组；调试器的打印在这期间都丢掉
+    template <typename Body>
+    auto group(std::string const& name, Body body) -> void {
+        current = name;
+        silence();
+        try {
+            body();
+        } catch (exception const& exc) {
+            errors.push_back(name + ": " + exc.reason);
+        } catch (std::exception const& exc) {
+            errors.push_back(name + ": " + exc.what());
+        }
+        restore();
+        fprintf(stderr, "[%s 完成]\n", name.c_str());
+    }
+
+    auto silence() -> void {
+        fflush(stdout);
+        saved_stdout = dup(STDOUT_FILENO);
+        auto null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+
+    auto restore() -> void {
+        fflush(stdout);
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+    }
+
+    static auto escape(std::string const& text) -> std::string {
+        std::string result{};
+        for (auto c : text) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+            }
+            result += c == '\n' ? ' ' : c;
+        }
+        return result;
+    }
+
+private:
+    std::string dir;
+    // 被调试程序的规模
+    std::map<std::string, long> scale;
+    std::vector<Result> results;
+    std::vector<std::string> errors;
+    // 正在运行的一组
+    std::string current;
+    int saved_stdout;
+};
+
+}
+
+
+int main(int argc, char const *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <dir> [--units N] [--funcs N] [--depth N] [--threads N] [--heap-mb N]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    std::map<std::string, long> scale{{"units", 2000}, {"funcs", 8}, {"depth", 10000}, {"threads", 64}, {"heap-mb", 256}};
+    for (auto i = 2; i + 1 < argc; i += 2) {
+        auto key = std::string{argv[i]};
+        if (key.compare(0, 2, "--") != 0 || scale.count(key.substr(2)) == 0) {
+            fprintf(stderr, "未知的选项 %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+        scale[key.substr(2)] = atol(argv[i + 1]);
+    }
+
+    BitTech::Bench bench{argv[1], scale};
+    bench.run();
+    bench.print_json();
+    return bench.ok() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,42 @@
+#!/bin/sh
+# 生成规模化的被调试程序的源码：units 个编译单元，每个单元 funcs 个函数
+# 单元 i 的函数 f_i_j 调用 f_i_(j+1)，main 调用每个单元的 f_i_0
+# 用法: gen_units.sh <目录> <units> <funcs>
+set -e
+
+dir=$1
+units=$2
+funcs=$3
+
+rm -rf "$dir"
+mkdir -p "$dir"
+awk -v dir="$dir" -v units="$units" -v funcs="$funcs" 'BEGIN {
+    for (i = 0; i < units; i++) {
+        file = dir "/unit_" i ".c"
+        printf "static int calls_%d;\n\n", i > file
+        # 倒序定义，被调用的函数总在前面，不需要声明
+        for (j = funcs - 1; j >= 0; j--) {
+            printf "int f_%d_%d(int x) {\n", i, j > file
+            printf "    int y = x * 3 + %d;\n", j > file
+            printf "    calls_%d++;\n", i > file
+            if (j < funcs - 1) {
+                printf "    if (y & 1) {\n" > file
+                printf "        y += f_%d_%d(y >> 1);\n", i, j + 1 > file
+                printf "    }\n" > file
+            }
+            printf "    return y;\n}\n\n" > file
+        }
+        close(file)
+    }
+
+    file = dir "/main.c"
+    for (i = 0; i < units; i++) {
+        printf "int f_%d_0(int x);\n", i > file
+    }
+    printf "\nint main(void) {\n    int s = 0;\n" > file
+    for (i = 0; i < units; i++) {
+        printf "    s += f_%d_0(s);\n", i > file
+    }
+    printf "    return s & 1;\n}\n" > file
+    close(file)
+}'
@@ -0,0 +1,28 @@
+/**
+ * 大堆：分配并写满 mb 兆字节后调用 ready(buf, size)，用来测读写 tracee 内存的开销
+ * 用法: heap [兆字节数]
+ */
+#include <stdlib.h>
+#include <string.h>
+
+
+volatile long sink;
+
+
+__attribute__((noinline)) void ready(char *buf, size_t size) {
+    sink = buf[size - 1];
+}
+
+
+int main(int argc, char *argv[]) {
+    size_t mb = argc > 1 ? (size_t) atol(argv[1]) : 256;
+    size_t size = mb << 20;
+    char *buf = malloc(size);
+    for (size_t i = 0; i < size; i++) {
+        buf[i] = (char) (i * 131);
+    }
+    for (;;) {
+        ready(buf, size);
+    }
+    return 0;
+}
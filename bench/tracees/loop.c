@@ -0,0 +1,23 @@
+/**
+ * 紧凑的循环：每次迭代调用一次 tick，用来测断点命中后继续运行的吞吐和 step/next 的延迟
+ * 用法: loop [迭代次数]，默认几乎不会结束
+ */
+#include <stdlib.h>
+
+
+volatile long sink;
+
+
+__attribute__((noinline)) void tick(long i) {
+    sink += i;
+    sink ^= i >> 3;
+}
+
+
+int main(int argc, char *argv[]) {
+    long n = argc > 1 ? atol(argv[1]) : 1000000000L;
+    for (long i = 0; i < n; i++) {
+        tick(i);
+    }
+    return 0;
+}
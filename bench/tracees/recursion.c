@@ -0,0 +1,29 @@
+/**
+ * 深递归：descend 递归 depth 层之后调用 leaf，用来测栈回溯的开销
+ * 用法: recursion [深度]
+ */
+#include <stdlib.h>
+
+
+volatile long sink;
+
+
+__attribute__((noinline)) void leaf(long depth) {
+    sink = depth;
+}
+
+
+__attribute__((noinline)) long descend(long n) {
+    if (n == 0) {
+        leaf(sink);
+        return 0;
+    }
+    return descend(n - 1) + 1;
+}
+
+
+int main(int argc, char *argv[]) {
+    long depth = argc > 1 ? atol(argv[1]) : 10000;
+    sink = depth;
+    return (int) (descend(depth) & 1);
+}
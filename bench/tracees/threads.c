@@ -0,0 +1,48 @@
+/**
+ * 很多线程：所有线程启动后 main 调用 ready，之后每个线程不停地调用 work
+ * 用来测全停止模式下停下和恢复所有线程、以及多线程下断点命中的开销
+ * 用法: threads [线程数]
+ */
+#define _POSIX_C_SOURCE 200112L
+#include <pthread.h>
+#include <stdlib.h>
+
+
+static pthread_barrier_t barrier;
+static volatile long counters[1024];
+
+
+__attribute__((noinline)) void work(long id) {
+    counters[id & 1023]++;
+}
+
+
+__attribute__((noinline)) void ready(long n) {
+    counters[0] = n;
+}
+
+
+void *worker(void *arg) {
+    long id = (long) arg;
+    pthread_barrier_wait(&barrier);
+    for (;;) {
+        work(id);
+    }
+    return NULL;
+}
+
+
+int main(int argc, char *argv[]) {
+    long n = argc > 1 ? atol(argv[1]) : 64;
+    pthread_t *tids = malloc(sizeof(pthread_t) * n);
+    pthread_barrier_init(&barrier, NULL, n + 1);
+    for (long i = 0; i < n; i++) {
+        pthread_create(&tids[i], NULL, worker, (void *) i);
+    }
+    pthread_barrier_wait(&barrier);
+    ready(n);
+    for (long i = 0; i < n; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    return 0;
+}
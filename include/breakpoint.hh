@@ -4,6 +4,7 @@
  * 断点，利用 int 3（0xCC）实现的软件断点
  */
 
+#include <exception.hh>
 #include <ptrace_proxy.hh>
 #include <cstdint>
 #include <unistd.h>
@@ -27,14 +28,15 @@ public:
             return;
         }
 
-        // 从内存地址处获取指令
-        uint64_t data = PtraceProxy::read_memory(pid, addr);
-        // 只保留 8 Bit
-        saved = static_cast<uint8_t>(data & 0xFF);
+        // 从内存地址处获取指令的第一个字节
+        if (PtraceProxy::read_memory(pid, addr, &saved, 1) != 1) {
+            EXCEPTION("读取断点地址处的指令失败");
+        }
         // 将指令替换成 int 3（0xCC）
-        uint64_t data_int3 = (data & ~0xFF) | 0xCC;
-        // 重新将指令设置回内存地址处
-        PtraceProxy::write_memory(pid, addr, data_int3);
+        uint8_t int3 = 0xCC;
+        if (PtraceProxy::patch_memory(pid, addr, &int3, 1) != 1) {
+            EXCEPTION("写入断点指令失败");
+        }
 
         is_enabled = true;
     }
@@ -44,16 +46,33 @@ public:
             return;
         }
 
-        // 从内存地址处获取被修改为 0xCC 的指令
-        auto data_int3 = PtraceProxy::read_memory(pid, addr);
-        // 将指令修改为原状
-        uint64_t data = (data_int3 & ~0xFF) | saved;
-        // 重新将指令设置回内存地址处
-        PtraceProxy::write_memory(pid, addr, data);
+        // 将被修改为 0xCC 的字节恢复原状
+        if (PtraceProxy::patch_memory(pid, addr, &saved, 1) != 1) {
+            EXCEPTION("恢复断点处的指令失败");
+        }
+
+        is_enabled = false;
+    }
+
+public:
+    // 批量修改内存时使用，由调用者负责真正写入 0xCC 或者恢复原来的字节
+    auto mark_enabled(uint8_t original) -> void {
+        saved = original;
+        is_enabled = true;
+    }
 
+    auto mark_disabled() -> void {
         is_enabled = false;
     }
 
+    auto address() const -> std::intptr_t {
+        return addr;
+    }
+
+    auto saved_byte() const -> uint8_t {
+        return saved;
+    }
+
 private:
     // 保存 tracee 的 pid
     pid_t pid;
@@ -0,0 +1,87 @@
+#pragma once
+
+/**
+ * 批量开启、关闭断点
+ * 按页把断点分组，同一组只读一次、写一次内存，而不是每个断点各自读写
+ */
+
+#include <exception.hh>
+#include <ptrace_proxy.hh>
+#include <breakpoint.hh>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+namespace BitTech {
+
+class BreakpointBatch {
+public:
+    // 开启 bps 中所有未开启的断点
+    static auto enable(pid_t pid, std::vector<Breakpoint *> bps) -> void {
+        bps.erase(std::remove_if(bps.begin(), bps.end(), [](Breakpoint *bp) {
+            return bp->enabled();
+        }), bps.end());
+
+        patch(pid, bps, true);
+    }
+
+    // 关闭 bps 中所有开启的断点
+    static auto disable(pid_t pid, std::vector<Breakpoint *> bps) -> void {
+        bps.erase(std::remove_if(bps.begin(), bps.end(), [](Breakpoint *bp) {
+            return !bp->enabled();
+        }), bps.end());
+
+        patch(pid, bps, false);
+    }
+
+private:
+    static const std::intptr_t page_size = 4096;
+
+    static auto patch(pid_t pid, std::vector<Breakpoint *>& bps, bool enable) -> void {
+        std::sort(bps.begin(), bps.end(), [](Breakpoint *a, Breakpoint *b) {
+            return a->address() < b->address();
+        });
+
+        std::vector<uint8_t> buffer{};
+        std::size_t first = 0;
+        while (first < bps.size()) {
+            // 相邻页上的断点合并成一组，读写的区间必然都已映射
+            auto last = first + 1;
+            while (last < bps.size()
+                && bps[last]->address() / page_size - bps[last - 1]->address() / page_size <= 1) {
+                ++last;
+            }
+
+            auto low = bps[first]->address();
+            auto high = bps[last - 1]->address() + 1;
+            buffer.resize(high - low);
+            // 区间里可能还有不在这一批中的断点，所以先读回当前内容再修改
+            if (PtraceProxy::read_memory(pid, low, buffer.data(), buffer.size()) != buffer.size()) {
+                EXCEPTION("读取断点地址处的指令失败");
+            }
+
+            auto original = buffer;
+            for (auto i = first; i < last; ++i) {
+                auto offset = bps[i]->address() - low;
+                buffer[offset] = enable ? 0xCC : bps[i]->saved_byte();
+            }
+
+            if (PtraceProxy::patch_memory(pid, low, buffer.data(), buffer.size()) != buffer.size()) {
+                EXCEPTION("写入断点指令失败");
+            }
+
+            // 写入成功后再更新断点的状态
+            for (auto i = first; i < last; ++i) {
+                if (enable) {
+                    bps[i]->mark_enabled(original[bps[i]->address() - low]);
+                } else {
+                    bps[i]->mark_disabled();
+                }
+            }
+
+            first = last;
+        }
+    }
+};
+
+}
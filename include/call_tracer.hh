@@ -0,0 +1,194 @@
+#pragma once
+
+/**
+ * 函数调用跟踪：统计函数的调用次数和从进入到返回的耗时分布
+ * 函数入口和返回地址处各有一个断点，命中时 Inferior 在等待线程的循环中记下时间后直接让线程继续运行，不回到命令行
+ * 入口处 rsp 指向返回地址，rsp + 8 就是这次调用的 CFA；返回到调用者时 rsp 恰好等于 CFA，用它配对进入和返回，递归调用也不会配错
+ * 耗时包含两次断点停下的开销，适合比较函数之间、调用之间的差别
+ */
+
+#include <string>
+#include <vector>
+#include <set>
+#include <array>
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
+#include <chrono>
+#include <cstdint>
+#include <sys/types.h>
+
+namespace BitTech {
+
+class CallTracer {
+public:
+    // 耗时按 2 的幂分桶，第 i 个桶是 [2^i, 2^(i+1)) 纳秒，第 0 个桶包括 0
+    static const int bucket_count = 48;
+
+    struct Function {
+        std::string name;
+        // 函数入口的链接地址
+        std::intptr_t low_pc;
+        // 进入的次数
+        uint64_t calls;
+        // 配对上返回的次数，耗时只统计这些调用
+        uint64_t returns;
+        uint64_t total_ns;
+        uint64_t min_ns;
+        uint64_t max_ns;
+        std::array<uint64_t, bucket_count> histogram;
+    };
+
+public:
+    CallTracer(): functions{}, entries{}, stacks{}, return_sites{}, owned{} {}
+
+public:
+    // 加入要跟踪的函数，入口已经在跟踪时返回 false
+    auto add(std::string const& name, std::intptr_t low_pc) -> bool {
+        if (entries.count(low_pc)) {
+            return false;
+        }
+        Function func{name, low_pc, 0, 0, 0, std::numeric_limits<uint64_t>::max(), 0, {}};
+        entries[low_pc] = functions.size();
+        functions.push_back(func);
+        return true;
+    }
+
+    auto active() const -> bool {
+        return !functions.empty();
+    }
+
+    auto all() const -> std::vector<Function> const& {
+        return functions;
+    }
+
+    // 入口的链接地址是否是跟踪的函数，是时在 index 中返回函数的下标
+    auto find_entry(std::intptr_t low_pc, std::size_t& index) const -> bool {
+        auto it = entries.find(low_pc);
+        if (it == entries.end()) {
+            return false;
+        }
+        index = it->second;
+        return true;
+    }
+
+public:
+    // 线程 tid 进入函数 index，cfa 是这次调用的 CFA
+    auto enter(pid_t tid, std::size_t index, std::intptr_t cfa) -> void {
+        auto& stack = stacks[tid];
+        // 栈上 CFA 不高于新调用的记录已经返回了（longjmp、异常、没有命中返回断点的尾调用）
+        while (!stack.empty() && stack.back().cfa <= cfa) {
+            stack.pop_back();
+        }
+        stack.push_back(Call{index, cfa, now()});
+        ++functions[index].calls;
+    }
+
+    // 线程 tid 执行到了返回地址，rsp 等于某次调用的 CFA 时这次调用结束了，配对上时返回 true
+    auto leave(pid_t tid, std::intptr_t rsp) -> bool {
+        auto it = stacks.find(tid);
+        if (it == stacks.end()) {
+            return false;
+        }
+        auto& stack = it->second;
+        // 比 rsp 更深的记录已经返回了，只是没有经过返回断点
+        while (!stack.empty() && stack.back().cfa < rsp) {
+            stack.pop_back();
+        }
+        if (stack.empty() || stack.back().cfa != rsp) {
+            return false;
+        }
+        auto call = stack.back();
+        stack.pop_back();
+        record(functions[call.index], static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            now() - call.start).count()));
+        return true;
+    }
+
+public:
+    // 返回地址的断点由第一次命中入口时设置，之后一直保留，避免每次调用都读写内存
+    auto has_return_site(std::intptr_t addr) const -> bool {
+        return return_sites.count(addr) > 0;
+    }
+
+    auto add_return_site(std::intptr_t addr) -> void {
+        return_sites.insert(addr);
+    }
+
+    // 跟踪加入的断点，停止跟踪时只删除这些
+    auto owned_breakpoints() -> std::set<std::intptr_t>& {
+        return owned;
+    }
+
+    // tracee 结束后断点都不在了，进行中的调用也不会返回，统计数据保留
+    auto reset() -> void {
+        stacks.clear();
+        return_sites.clear();
+        owned.clear();
+    }
+
+    // 停止跟踪，丢掉所有函数和统计数据
+    auto clear() -> void {
+        reset();
+        functions.clear();
+        entries.clear();
+    }
+
+public:
+    // 耗时所在的桶
+    static auto bucket_of(uint64_t ns) -> int {
+        auto bucket = 0;
+        while (ns > 1 && bucket < bucket_count - 1) {
+            ns >>= 1;
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    // 按直方图估算第 percent 百分位的耗时，取所在桶的上界
+    static auto percentile_ns(Function const& func, double percent) -> uint64_t {
+        if (func.returns == 0) {
+            return 0;
+        }
+        auto target = static_cast<uint64_t>(func.returns * percent / 100);
+        uint64_t seen = 0;
+        for (auto i = 0; i < bucket_count; ++i) {
+            seen += func.histogram[i];
+            if (seen > target) {
+                return std::min(func.max_ns, (uint64_t{1} << (i + 1)) - 1);
+            }
+        }
+        return func.max_ns;
+    }
+
+private:
+    struct Call {
+        std::size_t index;
+        std::intptr_t cfa;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    static auto now() -> std::chrono::steady_clock::time_point {
+        return std::chrono::steady_clock::now();
+    }
+
+    static auto record(Function& func, uint64_t ns) -> void {
+        ++func.returns;
+        func.total_ns += ns;
+        func.min_ns = std::min(func.min_ns, ns);
+        func.max_ns = std::max(func.max_ns, ns);
+        ++func.histogram[bucket_of(ns)];
+    }
+
+private:
+    std::vector<Function> functions;
+    // 入口的链接地址 -> functions 中的下标
+    std::unordered_map<std::intptr_t, std::size_t> entries;
+    // 每个线程进行中的调用，栈顶是最内层的调用
+    std::unordered_map<pid_t, std::vector<Call>> stacks;
+    // 已经设置了断点的返回地址（运行时地址）
+    std::set<std::intptr_t> return_sites;
+    std::set<std::intptr_t> owned;
+};
+
+}
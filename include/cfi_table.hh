@@ -0,0 +1,568 @@
+#pragma once
+
+/**
+ * 一个 .eh_frame 或者 .debug_frame 节中的调用帧信息（CFI）
+ * 建立时只扫描一遍所有的 FDE，记下每个 FDE 覆盖的地址区间；第一次查询某个函数时才执行它的 CFA 指令，
+ * 把得到的每一行（一个地址区间内 CFA 和各个寄存器的恢复规则）缓存起来，之后同一区间的查询只是一次查找
+ * 地址都是 ELF 中的链接地址，换算成运行时地址由使用者负责
+ */
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace BitTech {
+
+class CfiTable {
+public:
+    // DWARF 中 x86-64 的寄存器编号：0-15 依次是 rax rdx rcx rbx rsi rdi rbp rsp r8-r15，16 是返回地址
+    static const int register_count = 17;
+
+    // 调用者的寄存器怎样恢复
+    struct Rule {
+        enum class Kind {
+            same,        // 没有变化
+            undefined,   // 无法恢复，返回地址是 undefined 表示已经到了最外层的栈帧
+            offset,      // 保存在 CFA + value 处的内存中
+            val_offset,  // 值就是 CFA + value
+            reg,         // 保存在编号为 value 的寄存器中
+            expression,  // DWARF 表达式，不支持
+        };
+        Kind kind;
+        int64_t value;
+    };
+
+    // [low, high) 区间内的恢复规则
+    struct Row {
+        std::intptr_t low;
+        std::intptr_t high;
+        // CFA = 编号为 cfa_reg 的寄存器 + cfa_offset，cfa_is_expression 时是不支持的表达式
+        int cfa_reg;
+        int64_t cfa_offset;
+        bool cfa_is_expression;
+        // 返回地址所在的列，x86-64 上总是 16
+        int ra_reg;
+        // 信号处理函数的栈帧，返回地址就是被打断的指令，查询时不需要减 1
+        bool is_signal_frame;
+        std::array<Rule, register_count> rules;
+    };
+
+public:
+    // data 是节的内容，addr 是节的链接地址，eh_frame 表示是 .eh_frame 而不是 .debug_frame
+    CfiTable(uint8_t const *data, std::size_t size, std::intptr_t addr, bool eh_frame)
+        : data{data}, size{size}, addr{addr}, is_eh_frame{eh_frame}, fdes{}, cies{}, rows{} {
+        index();
+    }
+
+public:
+    // 找到 pc 所在的行，没有 FDE 覆盖 pc 时返回 false
+    auto find(std::intptr_t pc, Row& row) -> bool {
+        auto cached = rows.upper_bound(pc);
+        if (cached != rows.begin() && (--cached)->second.high > pc) {
+            row = cached->second;
+            return true;
+        }
+
+        auto it = std::upper_bound(fdes.begin(), fdes.end(), pc, [](std::intptr_t value, Fde const& fde) {
+            return value < fde.low;
+        });
+        if (it == fdes.begin() || (--it)->high <= pc) {
+            return false;
+        }
+        if (!decode(*it)) {
+            return false;
+        }
+
+        cached = rows.upper_bound(pc);
+        if (cached == rows.begin() || (--cached)->second.high <= pc) {
+            return false;
+        }
+        row = cached->second;
+        return true;
+    }
+
+    auto fde_count() const -> std::size_t {
+        return fdes.size();
+    }
+
+private:
+    struct Cie {
+        bool valid;
+        uint64_t code_align;
+        int64_t data_align;
+        int ra_reg;
+        // FDE 中地址的编码方式（DW_EH_PE_*）
+        uint8_t fde_encoding;
+        bool has_augmentation_data;
+        bool is_signal_frame;
+        std::size_t instructions;
+        std::size_t end;
+    };
+
+    struct Fde {
+        std::intptr_t low;
+        std::intptr_t high;
+        std::size_t cie;
+        std::size_t instructions;
+        std::size_t end;
+    };
+
+    // 顺序读取节中的数据，越界时停在末尾并标记失败
+    struct Cursor {
+        uint8_t const *data;
+        std::size_t pos;
+        std::size_t end;
+        bool failed;
+
+        auto u8() -> uint8_t {
+            if (pos + 1 > end) {
+                failed = true;
+                pos = end;
+                return 0;
+            }
+            return data[pos++];
+        }
+
+        template <typename T>
+        auto fixed() -> T {
+            T value = 0;
+            if (pos + sizeof(T) > end) {
+                failed = true;
+                pos = end;
+                return value;
+            }
+            memcpy(&value, data + pos, sizeof(T));
+            pos += sizeof(T);
+            return value;
+        }
+
+        auto uleb() -> uint64_t {
+            uint64_t value = 0;
+            for (auto shift = 0; ; shift += 7) {
+                auto byte = u8();
+                if (shift < 64) {
+                    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                }
+                if (!(byte & 0x80) || failed) {
+                    return value;
+                }
+            }
+        }
+
+        auto sleb() -> int64_t {
+            int64_t value = 0;
+            auto shift = 0;
+            uint8_t byte;
+            do {
+                byte = u8();
+                if (shift < 64) {
+                    value |= static_cast<int64_t>(byte & 0x7F) << shift;
+                }
+                shift += 7;
+            } while ((byte & 0x80) && !failed);
+            if (shift < 64 && (byte & 0x40)) {
+                value |= -(static_cast<int64_t>(1) << shift);
+            }
+            return value;
+        }
+
+        auto skip(std::size_t n) -> void {
+            if (pos + n > end) {
+                failed = true;
+                pos = end;
+                return;
+            }
+            pos += n;
+        }
+    };
+
+private:
+    // 扫描所有条目，记下每个 FDE 覆盖的区间，按起始地址排序
+    auto index() -> void {
+        std::size_t offset = 0;
+        while (offset + 4 <= size) {
+            Cursor c{data, offset, size, false};
+            uint64_t length = c.fixed<uint32_t>();
+            auto is_64 = length == 0xFFFFFFFF;
+            if (is_64) {
+                length = c.fixed<uint64_t>();
+            }
+            // .eh_frame 以长度为 0 的条目结束
+            if (length == 0 || c.failed || c.pos + length > size) {
+                break;
+            }
+            auto end = c.pos + length;
+            auto id_pos = c.pos;
+            uint64_t id = is_64 ? c.fixed<uint64_t>() : c.fixed<uint32_t>();
+            offset = end;
+
+            if (is_cie(id, is_64)) {
+                continue;
+            }
+            auto cie_offset = is_eh_frame ? id_pos - id : id;
+            auto const& cie = cie_at(cie_offset);
+            if (!cie.valid) {
+                continue;
+            }
+
+            c.end = end;
+            auto low = read_encoded(c, cie.fde_encoding);
+            auto range = read_encoded(c, cie.fde_encoding & 0x0F);
+            if (cie.has_augmentation_data) {
+                c.skip(c.uleb());
+            }
+            // 链接时被丢弃的函数，地址是 0
+            if (c.failed || low == 0 || range == 0) {
+                continue;
+            }
+            fdes.push_back(Fde{low, low + range, cie_offset, c.pos, end});
+        }
+
+        std::sort(fdes.begin(), fdes.end(), [](Fde const& a, Fde const& b) {
+            return a.low < b.low;
+        });
+    }
+
+    auto is_cie(uint64_t id, bool is_64) const -> bool {
+        if (is_eh_frame) {
+            return id == 0;
+        }
+        return is_64 ? id == 0xFFFFFFFFFFFFFFFFull : id == 0xFFFFFFFF;
+    }
+
+    auto cie_at(std::size_t offset) -> Cie const& {
+        auto it = cies.find(offset);
+        if (it != cies.end()) {
+            return it->second;
+        }
+
+        Cie cie{false, 1, 1, 16, 0, false, false, 0, 0};
+        Cursor c{data, offset, size, false};
+        uint64_t length = c.fixed<uint32_t>();
+        auto is_64 = length == 0xFFFFFFFF;
+        if (is_64) {
+            length = c.fixed<uint64_t>();
+        }
+        if (c.failed || c.pos + length > size) {
+            return cies[offset] = cie;
+        }
+        c.end = c.pos + length;
+        c.skip(is_64 ? 8 : 4);
+
+        auto version = c.u8();
+        std::string augmentation{};
+        while (auto ch = c.u8()) {
+            augmentation += static_cast<char>(ch);
+        }
+        if (!is_eh_frame && version >= 4) {
+            // address_size 和 segment_size
+            c.skip(2);
+        }
+        cie.code_align = c.uleb();
+        cie.data_align = c.sleb();
+        cie.ra_reg = version == 1 ? c.u8() : static_cast<int>(c.uleb());
+        // .debug_frame 中的地址都是 8 字节的绝对地址
+        cie.fde_encoding = is_eh_frame ? DW_EH_PE_absptr : DW_EH_PE_udata8;
+
+        if (!augmentation.empty() && augmentation[0] == 'z') {
+            cie.has_augmentation_data = true;
+            auto length = c.uleb();
+            auto after = c.pos + length;
+            for (auto i = 1u; i < augmentation.size() && !c.failed; ++i) {
+                switch (augmentation[i]) {
+                case 'L':
+                    c.u8();
+                    break;
+                case 'P':
+                    read_encoded(c, c.u8());
+                    break;
+                case 'R':
+                    cie.fde_encoding = c.u8();
+                    break;
+                case 'S':
+                    cie.is_signal_frame = true;
+                    break;
+                default:
+                    break;
+                }
+            }
+            c.pos = after;
+        } else if (!augmentation.empty()) {
+            // 不认识的扩充，不知道后面的数据怎样解析
+            return cies[offset] = cie;
+        }
+
+        cie.valid = !c.failed && c.pos <= c.end && cie.ra_reg < register_count;
+        cie.instructions = c.pos;
+        cie.end = c.end;
+        return cies[offset] = cie;
+    }
+
+private:
+    // DW_EH_PE_* 编码
+    static const uint8_t DW_EH_PE_absptr = 0x00;
+    static const uint8_t DW_EH_PE_uleb128 = 0x01;
+    static const uint8_t DW_EH_PE_udata2 = 0x02;
+    static const uint8_t DW_EH_PE_udata4 = 0x03;
+    static const uint8_t DW_EH_PE_udata8 = 0x04;
+    static const uint8_t DW_EH_PE_sleb128 = 0x09;
+    static const uint8_t DW_EH_PE_sdata2 = 0x0A;
+    static const uint8_t DW_EH_PE_sdata4 = 0x0B;
+    static const uint8_t DW_EH_PE_sdata8 = 0x0C;
+    static const uint8_t DW_EH_PE_pcrel = 0x10;
+    static const uint8_t DW_EH_PE_datarel = 0x30;
+    static const uint8_t DW_EH_PE_omit = 0xFF;
+
+    // 按 encoding 读一个地址，pcrel 相对于这个字段自己的链接地址
+    auto read_encoded(Cursor& c, uint8_t encoding) const -> std::intptr_t {
+        if (encoding == DW_EH_PE_omit) {
+            return 0;
+        }
+        auto field = addr + static_cast<std::intptr_t>(c.pos);
+        int64_t value = 0;
+        switch (encoding & 0x0F) {
+        case DW_EH_PE_absptr:
+        case DW_EH_PE_udata8:
+        case DW_EH_PE_sdata8:
+            value = c.fixed<int64_t>();
+            break;
+        case DW_EH_PE_uleb128:
+            value = static_cast<int64_t>(c.uleb());
+            break;
+        case DW_EH_PE_udata2:
+            value = c.fixed<uint16_t>();
+            break;
+        case DW_EH_PE_udata4:
+            value = c.fixed<uint32_t>();
+            break;
+        case DW_EH_PE_sleb128:
+            value = c.sleb();
+            break;
+        case DW_EH_PE_sdata2:
+            value = c.fixed<int16_t>();
+            break;
+        case DW_EH_PE_sdata4:
+            value = c.fixed<int32_t>();
+            break;
+        default:
+            c.failed = true;
+            return 0;
+        }
+
+        switch (encoding & 0x70) {
+        case DW_EH_PE_pcrel:
+            value += field;
+            break;
+        case DW_EH_PE_datarel:
+            value += addr;
+            break;
+        default:
+            break;
+        }
+        return static_cast<std::intptr_t>(value);
+    }
+
+private:
+    // 执行 CIE 的初始指令和 FDE 的指令，把 FDE 的每一行都放进缓存
+    auto decode(Fde const& fde) -> bool {
+        auto const& cie = cie_at(fde.cie);
+        Row initial{};
+        initial.low = fde.low;
+        initial.high = fde.high;
+        initial.cfa_reg = 7;
+        initial.cfa_offset = 8;
+        initial.cfa_is_expression = false;
+        initial.ra_reg = cie.ra_reg;
+        initial.is_signal_frame = cie.is_signal_frame;
+        initial.rules.fill(Rule{Rule::Kind::same, 0});
+
+        // CIE 的初始指令不会推进地址，执行完就是 DW_CFA_restore 用的初始规则
+        if (!execute(cie, cie.instructions, cie.end, initial, initial, fde, nullptr)) {
+            return false;
+        }
+        auto row = initial;
+        std::vector<Row> result{};
+        if (!execute(cie, fde.instructions, fde.end, row, initial, fde, &result)) {
+            return false;
+        }
+        row.high = fde.high;
+        if (row.low < row.high) {
+            result.push_back(row);
+        }
+        for (auto const& r : result) {
+            rows[r.low] = r;
+        }
+        return true;
+    }
+
+    // 执行 [pos, end) 中的 CFA 指令，row.low 是当前的地址
+    // 地址推进时，把到这里为止的行加入 result
+    auto execute(Cie const& cie, std::size_t pos, std::size_t end, Row& row, Row const& initial, Fde const& fde,
+        std::vector<Row> *result) const -> bool {
+        std::vector<Row> remembered{};
+        Cursor c{data, pos, end, false};
+
+        auto advance = [&](uint64_t delta) {
+            auto next = row.low + static_cast<std::intptr_t>(delta * cie.code_align);
+            if (result != nullptr && next > row.low) {
+                auto done = row;
+                done.high = std::min(next, fde.high);
+                result->push_back(done);
+            }
+            row.low = next;
+        };
+        auto set_rule = [&](uint64_t reg, Rule::Kind kind, int64_t value) {
+            if (reg < register_count) {
+                row.rules[reg] = Rule{kind, value};
+            }
+        };
+
+        while (c.pos < c.end && !c.failed) {
+            auto op = c.u8();
+            auto low6 = op & 0x3F;
+            switch (op >> 6) {
+            case 1:  // DW_CFA_advance_loc
+                advance(low6);
+                continue;
+            case 2:  // DW_CFA_offset
+                set_rule(low6, Rule::Kind::offset, static_cast<int64_t>(c.uleb()) * cie.data_align);
+                continue;
+            case 3:  // DW_CFA_restore
+                if (low6 < register_count) {
+                    row.rules[low6] = initial.rules[low6];
+                }
+                continue;
+            default:
+                break;
+            }
+
+            switch (op) {
+            case 0x00:  // DW_CFA_nop
+                break;
+            case 0x01:  // DW_CFA_set_loc
+                row.low = read_encoded(c, cie.fde_encoding);
+                break;
+            case 0x02:  // DW_CFA_advance_loc1
+                advance(c.u8());
+                break;
+            case 0x03:  // DW_CFA_advance_loc2
+                advance(c.fixed<uint16_t>());
+                break;
+            case 0x04:  // DW_CFA_advance_loc4
+                advance(c.fixed<uint32_t>());
+                break;
+            case 0x05: {  // DW_CFA_offset_extended
+                auto reg = c.uleb();
+                set_rule(reg, Rule::Kind::offset, static_cast<int64_t>(c.uleb()) * cie.data_align);
+                break;
+            }
+            case 0x06: {  // DW_CFA_restore_extended
+                auto reg = c.uleb();
+                if (reg < register_count) {
+                    row.rules[reg] = initial.rules[reg];
+                }
+                break;
+            }
+            case 0x07:  // DW_CFA_undefined
+                set_rule(c.uleb(), Rule::Kind::undefined, 0);
+                break;
+            case 0x08:  // DW_CFA_same_value
+                set_rule(c.uleb(), Rule::Kind::same, 0);
+                break;
+            case 0x09: {  // DW_CFA_register
+                auto reg = c.uleb();
+                set_rule(reg, Rule::Kind::reg, static_cast<int64_t>(c.uleb()));
+                break;
+            }
+            case 0x0A:  // DW_CFA_remember_state
+                remembered.push_back(row);
+                break;
+            case 0x0B:  // DW_CFA_restore_state，地址保持当前的值
+                if (!remembered.empty()) {
+                    auto low = row.low;
+                    row = remembered.back();
+                    row.low = low;
+                    remembered.pop_back();
+                }
+                break;
+            case 0x0C:  // DW_CFA_def_cfa
+                row.cfa_reg = static_cast<int>(c.uleb());
+                row.cfa_offset = static_cast<int64_t>(c.uleb());
+                row.cfa_is_expression = false;
+                break;
+            case 0x0D:  // DW_CFA_def_cfa_register
+                row.cfa_reg = static_cast<int>(c.uleb());
+                row.cfa_is_expression = false;
+                break;
+            case 0x0E:  // DW_CFA_def_cfa_offset
+                row.cfa_offset = static_cast<int64_t>(c.uleb());
+                break;
+            case 0x0F:  // DW_CFA_def_cfa_expression
+                row.cfa_is_expression = true;
+                c.skip(c.uleb());
+                break;
+            case 0x10:  // DW_CFA_expression
+            case 0x16: {  // DW_CFA_val_expression
+                auto reg = c.uleb();
+                set_rule(reg, Rule::Kind::expression, 0);
+                c.skip(c.uleb());
+                break;
+            }
+            case 0x11: {  // DW_CFA_offset_extended_sf
+                auto reg = c.uleb();
+                set_rule(reg, Rule::Kind::offset, c.sleb() * cie.data_align);
+                break;
+            }
+            case 0x12:  // DW_CFA_def_cfa_sf
+                row.cfa_reg = static_cast<int>(c.uleb());
+                row.cfa_offset = c.sleb() * cie.data_align;
+                row.cfa_is_expression = false;
+                break;
+            case 0x13:  // DW_CFA_def_cfa_offset_sf
+                row.cfa_offset = c.sleb() * cie.data_align;
+                break;
+            case 0x14: {  // DW_CFA_val_offset
+                auto reg = c.uleb();
+                set_rule(reg, Rule::Kind::val_offset, static_cast<int64_t>(c.uleb()) * cie.data_align);
+                break;
+            }
+            case 0x15: {  // DW_CFA_val_offset_sf
+                auto reg = c.uleb();
+                set_rule(reg, Rule::Kind::val_offset, c.sleb() * cie.data_align);
+                break;
+            }
+            case 0x2E:  // DW_CFA_GNU_args_size
+                c.uleb();
+                break;
+            case 0x2F: {  // DW_CFA_GNU_negative_offset_extended
+                auto reg = c.uleb();
+                set_rule(reg, Rule::Kind::offset, -static_cast<int64_t>(c.uleb()) * cie.data_align);
+                break;
+            }
+            default:
+                // 不认识的指令，不知道它有多长
+                return false;
+            }
+        }
+        return !c.failed;
+    }
+
+private:
+    uint8_t const *data;
+    std::size_t size;
+    std::intptr_t addr;
+    bool is_eh_frame;
+    // 按起始地址排序的 FDE
+    std::vector<Fde> fdes;
+    // 节中的偏移 -> CIE
+    std::unordered_map<std::size_t, Cie> cies;
+    // 已经解码的行，按起始地址索引
+    std::map<std::intptr_t, Row> rows;
+};
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+/**
+ * 只读的定长数组，数据要么由自己持有，要么借用外部的内存（例如 mmap 进来的索引缓存文件）
+ * 索引的各个列都用它存放，这样从缓存文件加载时不需要复制
+ */
+
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+namespace BitTech {
+
+template <typename T>
+class Column {
+public:
+    Column(): owned{}, values{nullptr}, count{0} {}
+    explicit Column(std::vector<T> data): owned(std::move(data)), values{owned.data()}, count{owned.size()} {}
+    // 借用外部的内存，调用者保证其生命周期长于 Column
+    Column(T const *data, std::size_t count): owned{}, values{data}, count{count} {}
+
+    Column(Column const& other)
+        : owned(other.owned), values{other.is_borrowed() ? other.values : owned.data()}, count{other.count} {}
+
+    Column(Column&& other)
+        : owned{}, values{other.values}, count{other.count} {
+        // vector 移动后缓冲区不变，values 仍然有效
+        owned.swap(other.owned);
+        other.values = nullptr;
+        other.count = 0;
+    }
+
+    auto operator=(Column other) -> Column& {
+        owned.swap(other.owned);
+        std::swap(values, other.values);
+        std::swap(count, other.count);
+        return *this;
+    }
+
+public:
+    auto operator[](std::size_t i) const -> T const& {
+        return values[i];
+    }
+
+    auto begin() const -> T const * {
+        return values;
+    }
+
+    auto end() const -> T const * {
+        return values + count;
+    }
+
+    auto size() const -> std::size_t {
+        return count;
+    }
+
+    auto empty() const -> bool {
+        return count == 0;
+    }
+
+    auto back() const -> T const& {
+        return values[count - 1];
+    }
+
+    auto data() const -> T const * {
+        return values;
+    }
+
+private:
+    auto is_borrowed() const -> bool {
+        return values != nullptr && values != owned.data();
+    }
+
+private:
+    std::vector<T> owned;
+    T const *values;
+    std::size_t count;
+};
+
+}
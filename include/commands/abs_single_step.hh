@@ -24,6 +24,10 @@ public:
             printf("还未运行，先启动运行。\n");
             return;
         }
+        if (!inferior.current_thread_stopped()) {
+            printf("当前线程正在运行，用 thread 切换到停下的线程。\n");
+            return;
+        }
 
         try {
             run_step();
@@ -37,78 +41,52 @@ protected:
     // step 和 next 的不同在这个函数里处理
     virtual auto single_step_handle() const -> void = 0;
 
+private:
+    // 用 CFI 回溯到调用者，不依赖帧指针，停在函数开头或者没有帧指针的代码中也能找到返回地址
+    auto read_return_address() const -> std::intptr_t {
+        auto frames = inferior.backtrace(2);
+        if (frames.size() < 2) {
+            EXCEPTION("读取返回地址失败");
+        }
+        return frames[1].pc;
+    }
+
 private:
     // 继续执行到本函数结束
     auto continue_to_return_address() const -> void {
-        std::set<std::intptr_t> to_remove{};
-        auto pid = inferior.pid;
-        // 根据 ABI 的规范，返回地址在当前 栈帧 + 8 位置处
-        auto frame_pointer = PtraceProxy::get_frame_pointer(pid);
-        auto return_address = PtraceProxy::read_memory(pid, frame_pointer + 8);
-        if (inferior.breakpoints.count(return_address) == 0) {
-            inferior.set_breakpoint_at_addr(return_address);
-            to_remove.insert(return_address);
-        }
+        auto return_address = read_return_address();
+        auto to_remove = inferior.set_breakpoints_at_addrs({return_address});
 
         // 继续执行被调试程序，直到触发断点
-        inferior.continue_execute();
+        inferior.continue_in_step();
 
         // 删除执行 step 命令阶段添加的所有断点
-        for (auto addr : to_remove) {
-            if (inferior.breakpoints[addr].enabled()) {
-                inferior.breakpoints[addr].disable();
-            }
-            inferior.breakpoints.erase(addr);
-        }
+        inferior.remove_breakpoints_at_addrs(to_remove);
     }
 
     /**
      * 异常的情况留给外面考虑
      * 通过把函数的每一行都加上断点的方式实现 step
+     * 这些断点来自缓存的单步计划，在同一个栈帧中连续单步时一直保留在 tracee 中
      */
     auto run_step() const -> void {
-        auto func_die = inferior.get_function_die_by_pc();
-        auto begin_addr = at_low_pc(func_die);
-        auto end_addr = at_high_pc(func_die);
-
-        // 函数起始位置
-        auto line_iter = inferior.get_line_iter_by_addr(begin_addr);
-        // 当前执行位置
-        auto current_line_iter = inferior.get_line_iter_by_pc();
-
-        // 把每一行都加上断点
-        std::set<std::intptr_t> to_remove{};
-        for (; line_iter->address < end_addr; ++line_iter) {
-            if (line_iter->address != current_line_iter->address
-                && inferior.breakpoints.count(line_iter->address) == 0) {
-                inferior.set_breakpoint_at_addr(line_iter->address);
-                to_remove.insert(line_iter->address);
-            }
-        }
+        auto const& func_die = inferior.get_function_die_by_pc();
+        auto const& plan = inferior.get_step_plan(func_die);
 
         // 如果当前函数不是 main 函数，则需要找到本函数返回后的第一个指令处，也设置断点
-        if (at_name(func_die) != "main") {
-            auto pid = inferior.pid;
-            // 根据 ABI 的规范，返回地址在当前 栈帧 + 8 位置处
-            auto frame_pointer = PtraceProxy::get_frame_pointer(pid);
-            auto return_address = PtraceProxy::read_memory(pid, frame_pointer + 8);
-            if (inferior.breakpoints.count(return_address) == 0) {
-                inferior.set_breakpoint_at_addr(return_address);
-                to_remove.insert(return_address);
-            }
+        // 栈帧用 CFA 区分，函数的序言中 rbp 还没有建立，CFA 却一直不变
+        auto frames = inferior.backtrace(2);
+        std::intptr_t return_address = 0;
+        if (at_name(func_die) != "main" && frames.size() > 1) {
+            return_address = frames[1].pc;
         }
 
+        // 当前行的开始地址不设置断点，循环回到本行时不会停下
+        auto line = inferior.get_line_iter_by_pc().line();
+        inferior.arm_step_plan(plan, frames.front().cfa, return_address, line);
+
         // step 和 next 的不同在这个函数里处理
         single_step_handle();
-
-        // 已经彻底从一个函数返回了
-        // 删除执行 step 命令阶段添加的所有断点
-        for (auto addr : to_remove) {
-            if (inferior.breakpoints[addr].enabled()) {
-                inferior.breakpoints[addr].disable();
-            }
-            inferior.breakpoints.erase(addr);
-        }
     }
 };
 
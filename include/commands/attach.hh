@@ -0,0 +1,47 @@
+#pragma once
+
+/**
+ * 附加到正在运行的进程
+ * 进程运行的必须是启动调试器时给出的 program，附加后所有线程停下，之前设置的断点和观察点布置到进程中
+ **/
+
+#include <command.hh>
+#include <string>
+
+namespace BitTech {
+
+class Attach : public Command {
+public:
+    Attach(Inferior& inferior): Command(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "attach";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "at";
+    }
+
+    auto brief() const -> std::string override {
+        return "attach <pid>，附加到正在运行的进程。";
+    }
+
+public:
+    auto run(std::vector<std::string> const& args) const -> void {
+        if (args.size() == 0) {
+            printf("用法: attach <pid>\n");
+            return;
+        }
+
+        try {
+            inferior.attach(std::stoi(args[0]));
+        } catch (std::logic_error const& exc) {
+            printf("进程号的格式不正确\n");
+        } catch (exception const& exc) {
+            printf("%s\n", exc.reason.c_str());
+        }
+    }
+};
+
+}
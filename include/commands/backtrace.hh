@@ -0,0 +1,82 @@
+#pragma once
+
+/**
+ * 打印当前线程的调用栈
+ * backtrace [n] 最多打印 n 帧，默认 64 帧；没有调试信息的栈帧显示它所在的 ELF 文件
+ **/
+
+#include <command.hh>
+#include <stopwatch.hh>
+#include <string>
+
+namespace BitTech {
+
+class Backtrace : public Command {
+public:
+    Backtrace(Inferior& inferior): Command(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "backtrace";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "bt";
+    }
+
+    auto brief() const -> std::string override {
+        return "backtrace [n]，打印当前线程的调用栈。";
+    }
+
+public:
+    auto run(std::vector<std::string> const& args) const -> void {
+        if (!inferior.running()) {
+            printf("还未运行，先启动运行。\n");
+            return;
+        }
+        if (!inferior.current_thread_stopped()) {
+            printf("当前线程正在运行，用 thread 切换到停下的线程。\n");
+            return;
+        }
+
+        std::size_t max_depth = 64;
+        if (args.size() > 0) {
+            try {
+                max_depth = std::stoul(args[0]);
+            } catch (std::logic_error const& exc) {
+                printf("栈帧数的格式不正确\n");
+                return;
+            }
+        }
+
+        Stopwatch stopwatch{};
+        auto frames = inferior.backtrace(max_depth);
+        auto elapsed_us = stopwatch.elapsed_ms() * 1000;
+
+        for (std::size_t i = 0; i < frames.size(); ++i) {
+            // 调用者的栈帧中是返回地址，减 1 落在 call 指令所在的行上
+            auto addr = frames[i].pc;
+            auto lookup = i == 0 ? addr : addr - 1;
+            printf("#%-3zu 0x%016lx in %s\n", i, addr, describe(lookup).c_str());
+        }
+        printf("[回溯 %zu 帧，%.1f us]\n", frames.size(), elapsed_us);
+    }
+
+private:
+    auto describe(std::intptr_t addr) const -> std::string {
+        try {
+            auto result = at_name(inferior.get_function_die_by_addr(addr)) + " ()";
+            try {
+                auto line_iter = inferior.get_line_iter_by_addr(addr);
+                result += " at " + line_iter.file() + ":" + std::to_string(line_iter.line());
+            } catch (no_debug_information const& exc) {
+            }
+            return result;
+        } catch (no_debug_information const& exc) {
+            auto module = inferior.module_of(addr);
+            return module.empty() ? std::string{"??"} : "?? from " + module;
+        }
+    }
+};
+
+}
@@ -2,7 +2,7 @@
 
 /**
  * 打断点命令
- * 目前只支持传入指令地址进行断点
+ * 支持 *0x 开头的指令地址、函数名以及 文件:行号 三种形式
  **/
 
 #include <command.hh>
@@ -29,25 +29,22 @@ public:
 public:
     auto run(std::vector<std::string> const& args) const -> void {
         if (args.size() == 0) {
-            printf("需要以 16 进制形式给出断点指令地址\n");
+            printf("需要给出断点位置：*0x 开头的指令地址、函数名或者 文件:行号\n");
             return;
         }
 
-        if (args[0][0] == '*') {
-            // 假设是 *0x 开头，按指令地址断点
-            std::intptr_t addr = std::stol(std::string{args[0], 3}, 0, 16);
-            inferior.set_breakpoint_at_addr(addr);
-        } else {
-            // 按函数断点
-            try {
-                auto func_die = inferior.get_die_by_function_name(args[0]);
-                auto addr = at_low_pc(func_die);
-                inferior.set_breakpoint_at_addr(addr);
-            } catch (no_debug_information const& exc) {
-                printf("没有找到函数的调试信息\n");
-            }
+        try {
+            set_at(inferior.resolve_location(args[0]));
+        } catch (exception const& exc) {
+            printf("%s\n", exc.reason.c_str());
         }
     }
+
+protected:
+    // 在解析出的地址处设置断点，hbreak 改为使用硬件断点
+    virtual auto set_at(std::intptr_t addr) const -> void {
+        inferior.set_breakpoint_at_addr(addr);
+    }
 };
 
 }
@@ -0,0 +1,129 @@
+#pragma once
+
+/**
+ * 捕获系统调用
+ * catch syscall <名称|编号|all ...>：进入这些系统调用时停下，返回时打印返回值
+ * catch syscall log <名称|编号|all ...>：不停下，每次返回时打印一行调用、返回值和耗时，类似 strace
+ * catch syscall off：取消所有捕获
+ * catch syscall：打印每个系统调用的次数、失败次数和耗时
+ * 过滤器在 run 启动 tracee 时安装，运行中新加入的系统调用要到下次 run 才生效
+ **/
+
+#include <command.hh>
+#include <syscall_catcher.hh>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+
+namespace BitTech {
+
+class Catch : public Command {
+public:
+    Catch(Inferior& inferior): Command(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "catch";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "ca";
+    }
+
+    auto brief() const -> std::string override {
+        return "catch syscall [log|off] [名称 ...]，捕获系统调用，不带名称时打印统计。";
+    }
+
+public:
+    auto run(std::vector<std::string> const& args) const -> void {
+        if (args.empty() || args[0] != "syscall") {
+            printf("用法: catch syscall [log|off] [名称|编号|all ...]\n");
+            return;
+        }
+        if (args.size() == 1) {
+            summary();
+            return;
+        }
+        if (args[1] == "off") {
+            inferior.clear_syscall_catches();
+            printf("已取消所有系统调用的捕获\n");
+            return;
+        }
+
+        auto mode = SyscallCatcher::Mode::stop;
+        auto first = 1u;
+        if (args[1] == "log") {
+            mode = SyscallCatcher::Mode::log;
+            first = 2;
+        }
+
+        std::vector<long> nrs{};
+        auto all = false;
+        for (auto i = first; i < args.size(); ++i) {
+            if (args[i] == "all") {
+                all = true;
+                continue;
+            }
+            auto nr = SyscallTable::number_of(args[i]);
+            if (nr < 0) {
+                printf("不认识的系统调用 %s\n", args[i].c_str());
+                return;
+            }
+            nrs.push_back(nr);
+        }
+        if (!all && nrs.empty()) {
+            printf("没有指定系统调用\n");
+            return;
+        }
+
+        auto later = inferior.catch_syscalls(nrs, all, mode);
+        auto action = mode == SyscallCatcher::Mode::stop ? "捕获" : "记录";
+        if (all) {
+            printf("%s所有系统调用\n", action);
+        } else {
+            std::string names{};
+            for (auto nr : nrs) {
+                names += " " + SyscallTable::name_of(nr);
+            }
+            printf("%s系统调用%s\n", action, names.c_str());
+        }
+        if (!later.empty()) {
+            printf("tracee 启动时安装的 seccomp 过滤器不会停下%s，下次 run 时生效\n",
+                later.front() < 0 ? "所有系统调用" : "其中一部分系统调用");
+        }
+    }
+
+private:
+    // 按总耗时从大到小打印
+    auto summary() const -> void {
+        auto const& stats = inferior.get_syscall_catcher().all_stats();
+        if (stats.empty()) {
+            printf("还没有捕获到系统调用\n");
+            return;
+        }
+
+        std::vector<std::pair<long, SyscallCatcher::Stat>> items{stats.begin(), stats.end()};
+        std::stable_sort(items.begin(), items.end(), [](std::pair<long, SyscallCatcher::Stat> const& a,
+            std::pair<long, SyscallCatcher::Stat> const& b) {
+            return a.second.total_ns > b.second.total_ns;
+        });
+
+        uint64_t calls = 0;
+        uint64_t errors = 0;
+        uint64_t total_ns = 0;
+        printf("%-20s %10s %10s %12s %10s %10s\n", "系统调用", "次数", "失败", "总计(us)", "平均(us)", "最长(us)");
+        for (auto const& item : items) {
+            auto const& stat = item.second;
+            printf("%-20s %10lu %10lu %12.1f %10.2f %10.2f\n", SyscallTable::name_of(item.first).c_str(),
+                stat.calls, stat.errors, stat.total_ns / 1000.0,
+                stat.calls == 0 ? 0 : stat.total_ns / 1000.0 / stat.calls, stat.max_ns / 1000.0);
+            calls += stat.calls;
+            errors += stat.errors;
+            total_ns += stat.total_ns;
+        }
+        printf("%-20s %10lu %10lu %12.1f\n", "合计", calls, errors, total_ns / 1000.0);
+    }
+};
+
+}
@@ -2,9 +2,17 @@
 
 /**
  * 继续 tracee 的执行
+ * 非停止模式下只恢复当前线程，continue -a 恢复所有停下的线程
+ * continue &：在后台运行，立即回到命令行，线程停下时在提示符下报告
+ * continue --timeout <毫秒>：运行超过这么长时间就停下
+ * 运行中按 Ctrl-C 让所有线程停下
  **/
 
 #include <command.hh>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <climits>
 
 namespace BitTech {
 
@@ -22,7 +30,7 @@ public:
     }
 
     auto brief() const -> std::string override {
-        return "继续运行 program。";
+        return "continue [-a] [&] [--timeout <毫秒>]，继续运行 program，非停止模式下 -a 恢复所有线程，& 在后台运行。";
     }
 
 public:
@@ -31,8 +39,44 @@ public:
             printf("还未运行，先启动运行。\n");
             return;
         }
+        if (!inferior.current_thread_stopped()) {
+            printf("当前线程正在运行，用 thread 切换到停下的线程。\n");
+            return;
+        }
 
-        inferior.continue_execute();
+        auto all_threads = false;
+        auto background = false;
+        long timeout_ms = 0;
+        for (std::size_t i = 0; i < args.size(); ++i) {
+            if (args[i] == "-a") {
+                all_threads = true;
+            } else if (args[i] == "&") {
+                background = true;
+            } else if (args[i] == "--timeout" && i + 1 < args.size()) {
+                char *end = nullptr;
+                timeout_ms = strtol(args[++i].c_str(), &end, 10);
+                if (*end != '\0' || timeout_ms <= 0 || timeout_ms > INT_MAX) {
+                    printf("超时必须是正的毫秒数\n");
+                    return;
+                }
+            } else {
+                printf("用法: continue [-a] [&] [--timeout <毫秒>]\n");
+                return;
+            }
+        }
+        if (background && timeout_ms > 0) {
+            printf("后台运行不支持超时\n");
+            return;
+        }
+
+        if (background) {
+            inferior.continue_in_background(all_threads);
+            if (inferior.in_background()) {
+                printf("在后台继续运行，Ctrl-C 打断\n");
+            }
+        } else {
+            inferior.continue_execute(all_threads, static_cast<int>(timeout_ms));
+        }
     }
 };
 
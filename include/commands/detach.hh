@@ -0,0 +1,44 @@
+#pragma once
+
+/**
+ * 脱离 tracee，让它继续运行
+ * 脱离之前恢复调试器对进程做的所有修改：断点处原来的字节、页的权限、调试寄存器以及位移单步的暂存页
+ **/
+
+#include <command.hh>
+
+namespace BitTech {
+
+class Detach : public Command {
+public:
+    Detach(Inferior& inferior): Command(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "detach";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "de";
+    }
+
+    auto brief() const -> std::string override {
+        return "恢复所有修改后脱离 tracee，让它继续运行。";
+    }
+
+public:
+    auto run(std::vector<std::string> const& args) const -> void {
+        if (!inferior.running()) {
+            printf("还未运行，先启动运行。\n");
+            return;
+        }
+
+        try {
+            inferior.detach();
+        } catch (exception const& exc) {
+            printf("%s\n", exc.reason.c_str());
+        }
+    }
+};
+
+}
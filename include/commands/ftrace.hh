@@ -0,0 +1,127 @@
+#pragma once
+
+/**
+ * 快速跟踪点
+ * ftrace <位置> [寄存器 ...]：在位置处加入快速跟踪点，命中时记下时间、线程和最多 4 个寄存器，tracee 不停下
+ * ftrace：打印每个跟踪点的命中次数、读出的记录数和丢弃的记录数
+ * ftrace dump [n]：打印最近的 n 条记录，默认 20 条
+ * ftrace off：删除所有快速跟踪点
+ * 位置的写法和 break 相同；agent 由 run 启动 tracee 时预加载，附加的进程不能使用
+ **/
+
+#include <command.hh>
+#include <fast_tracer.hh>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+namespace BitTech {
+
+class Ftrace : public Command {
+public:
+    Ftrace(Inferior& inferior): Command(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "ftrace";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "ft";
+    }
+
+    auto brief() const -> std::string override {
+        return "ftrace [<位置> [寄存器 ...]|dump [n]|off]，快速跟踪点，命中时不停下，不带参数时打印统计。";
+    }
+
+public:
+    auto run(std::vector<std::string> const& args) const -> void {
+        try {
+            if (args.empty()) {
+                summary();
+            } else if (args[0] == "off") {
+                inferior.clear_fast_tracepoints();
+                printf("已删除所有快速跟踪点\n");
+            } else if (args[0] == "dump") {
+                dump(args.size() > 1 ? std::stoul(args[1]) : 20);
+            } else {
+                add(args);
+            }
+        } catch (std::logic_error const& exc) {
+            printf("记录条数的格式不正确\n");
+        } catch (exception const& exc) {
+            printf("%s\n", exc.reason.c_str());
+        }
+    }
+
+private:
+    auto add(std::vector<std::string> const& args) const -> void {
+        std::vector<uint8_t> regs{};
+        for (std::size_t i = 1; i < args.size(); ++i) {
+            auto reg = TraceRing::register_of(args[i].c_str());
+            if (reg < 0) {
+                printf("不认识的寄存器 %s\n", args[i].c_str());
+                return;
+            }
+            if (regs.size() == TraceRing::max_regs) {
+                printf("每个跟踪点最多记录 %u 个寄存器\n", TraceRing::max_regs);
+                return;
+            }
+            regs.push_back(static_cast<uint8_t>(reg));
+        }
+
+        auto addr = inferior.resolve_location(args[0]);
+        auto id = inferior.add_fast_tracepoint(addr, args[0], regs);
+        printf("快速跟踪点 %d 在 0x%lx\n", id, addr);
+        if (inferior.running() && !inferior.get_fast_tracer().prepared()) {
+            printf("tracee 没有预加载 agent，下次 run 时生效\n");
+        }
+    }
+
+    auto summary() const -> void {
+        auto& tracer = inferior.get_fast_tracer();
+        if (!tracer.active()) {
+            printf("没有快速跟踪点，用 ftrace <位置> [寄存器 ...] 加入\n");
+            return;
+        }
+        inferior.drain_fast_tracepoints();
+        printf("%-4s %-18s %-24s %-8s %12s  %s\n", "编号", "地址", "位置", "状态", "命中", "寄存器");
+        auto const& sites = tracer.all();
+        for (std::size_t id = 0; id < sites.size(); ++id) {
+            auto const& site = sites[id];
+            std::string regs{};
+            for (auto reg : site.regs) {
+                regs += std::string{regs.empty() ? "" : " "} + TraceRing::register_name(reg);
+            }
+            printf("%-4zu 0x%-16lx %-24s %-8s %12lu  %s\n", id, site.addr, site.location.c_str(),
+                site.installed ? "已安装" : "未安装", tracer.hits(static_cast<int>(id)), regs.c_str());
+        }
+        printf("读出 %lu 条记录，缓冲区满时丢弃 %lu 条\n", tracer.drained_count(), tracer.dropped());
+    }
+
+    // 时间相对于打印的第一条记录
+    auto dump(std::size_t n) const -> void {
+        inferior.drain_fast_tracepoints();
+        auto& tracer = inferior.get_fast_tracer();
+        auto const& records = tracer.recent_records();
+        if (records.empty()) {
+            printf("还没有记录\n");
+            return;
+        }
+        auto first = records.size() > n ? records.size() - n : 0;
+        auto base = records[first].ns;
+        for (auto i = first; i < records.size(); ++i) {
+            auto const& record = records[i];
+            auto const& site = tracer.all().at(record.site);
+            printf("%12.3f us  [LWP %u] #%u %s", (record.ns - base) / 1000.0, record.tid, record.site,
+                site.location.c_str());
+            for (std::size_t r = 0; r < site.regs.size() && r < TraceRing::max_regs; ++r) {
+                printf("  %s=0x%lx", TraceRing::register_name(site.regs[r]), record.regs[r]);
+            }
+            printf("\n");
+        }
+    }
+};
+
+}
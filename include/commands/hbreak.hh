@@ -0,0 +1,40 @@
+#pragma once
+
+/**
+ * 硬件断点命令，位置的写法和 break 相同
+ * 使用调试寄存器，不修改代码，最多同时存在 4 个（和观察点共用）
+ **/
+
+#include <commands/break.hh>
+
+namespace BitTech {
+
+class HBreak : public Break {
+public:
+    HBreak(Inferior& inferior): Break(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "hbreak";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "hb";
+    }
+
+    auto brief() const -> std::string override {
+        return "打硬件断点。";
+    }
+
+protected:
+    auto set_at(std::intptr_t addr) const -> void override {
+        try {
+            auto slot = inferior.set_hardware_breakpoint(addr);
+            printf("硬件断点 %d: 0x%lx\n", slot, addr);
+        } catch (exception const& exc) {
+            printf("%s\n", exc.reason.c_str());
+        }
+    }
+};
+
+}
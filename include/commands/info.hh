@@ -0,0 +1,73 @@
+#pragma once
+
+/**
+ * 查看 tracee 的状态
+ * info threads 列出所有线程：编号、LWP、停止原因和停下的位置，* 标出当前线程
+ **/
+
+#include <command.hh>
+
+namespace BitTech {
+
+class Info : public Command {
+public:
+    Info(Inferior& inferior): Command(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "info";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "i";
+    }
+
+    auto brief() const -> std::string override {
+        return "查看状态，目前支持 info threads。";
+    }
+
+public:
+    auto run(std::vector<std::string> const& args) const -> void {
+        if (args.size() == 0 || args[0] != "threads") {
+            printf("用法: info threads\n");
+            return;
+        }
+        if (!inferior.running()) {
+            printf("还未运行，先启动运行。\n");
+            return;
+        }
+
+        auto current = inferior.current_thread().tid;
+        printf("  编号  LWP      停止原因    位置\n");
+        for (auto thread : inferior.get_threads()) {
+            // 正在运行的线程读不了寄存器
+            auto location = thread->is_starting ? std::string{"(还未开始运行)"}
+                : thread->is_running ? std::string{"(运行中)"}
+                : inferior.describe_addr(inferior.get_thread_pc(*thread));
+            printf("%c %-5d %-8d %-10s  %s\n", thread->tid == current ? '*' : ' ',
+                thread->number, thread->tid, reason_name(thread->reason), location.c_str());
+        }
+    }
+
+private:
+    static auto reason_name(Thread::StopReason reason) -> char const * {
+        switch (reason) {
+        case Thread::StopReason::breakpoint:
+            return "断点";
+        case Thread::StopReason::watchpoint:
+            return "观察点";
+        case Thread::StopReason::step:
+            return "单步";
+        case Thread::StopReason::signal:
+            return "信号";
+        case Thread::StopReason::interrupt:
+            return "被暂停";
+        case Thread::StopReason::syscall:
+            return "系统调用";
+        default:
+            return "-";
+        }
+    }
+};
+
+}
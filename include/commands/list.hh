@@ -34,8 +34,8 @@ public:
 
         try {
             auto line_iter = inferior.get_line_iter_by_function_name(args[0]);
-            printf("%d\n", line_iter->line);
-            inferior.list_source(line_iter->file->path, line_iter->line, 4);
+            printf("%d\n", line_iter.line());
+            inferior.list_source(line_iter.file(), line_iter.line(), 4);
         } catch (no_debug_information const& exc) {
             printf("没有找到函数的调试信息\n");
         }
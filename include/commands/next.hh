@@ -28,7 +28,7 @@ public:
 protected:
     // step 和 next 的不同在这个函数里处理
     virtual auto single_step_handle() const -> void override {
-        inferior.continue_execute();
+        inferior.continue_in_step();
     }
 };
 
@@ -0,0 +1,43 @@
+#pragma once
+
+/**
+ * 切换非停止模式
+ * 非停止模式下一个线程停在断点上时其他线程继续运行，continue/step/next 只作用在当前线程上
+ * nonstop 显示当前模式，nonstop on|off 切换
+ **/
+
+#include <command.hh>
+
+namespace BitTech {
+
+class NonStop : public Command {
+public:
+    NonStop(Inferior& inferior): Command(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "nonstop";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "ns";
+    }
+
+    auto brief() const -> std::string override {
+        return "nonstop on|off，线程停下时其他线程是否继续运行。";
+    }
+
+public:
+    auto run(std::vector<std::string> const& args) const -> void {
+        if (args.size() > 0) {
+            if (args[0] != "on" && args[0] != "off") {
+                printf("用法: nonstop on|off\n");
+                return;
+            }
+            inferior.set_non_stop(args[0] == "on");
+        }
+        printf("非停止模式: %s\n", inferior.non_stop() ? "on" : "off");
+    }
+};
+
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+/**
+ * 采样分析 tracee
+ * profile <秒数> <频率> [文件]：所有线程继续运行，按频率暂停所有线程回溯调用栈，结束后所有线程停下
+ * 输出 folded stacks 格式，每行是从栈底到栈顶用分号连接的函数名和采样次数，可以直接交给 flamegraph.pl
+ * 有线程碰到断点或者收到信号时提前结束
+ **/
+
+#include <command.hh>
+#include <profiler.hh>
+#include <string>
+#include <unordered_map>
+#include <cstdio>
+
+namespace BitTech {
+
+class Profile : public Command {
+public:
+    Profile(Inferior& inferior): Command(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "profile";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "pf";
+    }
+
+    auto brief() const -> std::string override {
+        return "profile <秒数> <频率> [文件]，采样调用栈，输出 folded stacks。";
+    }
+
+public:
+    auto run(std::vector<std::string> const& args) const -> void {
+        if (!inferior.running()) {
+            printf("还未运行，先启动运行。\n");
+            return;
+        }
+        if (!inferior.current_thread_stopped()) {
+            printf("当前线程正在运行，用 thread 切换到停下的线程。\n");
+            return;
+        }
+        if (args.size() < 2) {
+            printf("用法: profile <秒数> <频率> [文件]\n");
+            return;
+        }
+
+        double seconds = 0;
+        int hz = 0;
+        try {
+            seconds = std::stod(args[0]);
+            hz = std::stoi(args[1]);
+        } catch (std::logic_error const& exc) {
+        }
+        if (seconds <= 0 || hz <= 0 || hz > 10000) {
+            printf("秒数要大于 0，频率在 1 到 10000 之间\n");
+            return;
+        }
+
+        auto output = stdout;
+        if (args.size() > 2) {
+            output = fopen(args[2].c_str(), "w");
+            if (output == nullptr) {
+                printf("无法写入 %s\n", args[2].c_str());
+                return;
+            }
+        }
+
+        Profiler profiler{seconds, hz};
+        try {
+            inferior.profile(profiler);
+        } catch (exception const& exc) {
+            printf("%s\n", exc.reason.c_str());
+        }
+
+        write_folded(profiler, output);
+        if (output != stdout) {
+            fclose(output);
+        }
+
+        printf("[采样 %.2f 秒%s: %lu 个调用栈，暂停 %lu 次，平均 %.1f us，最长 %.1f us]\n",
+            profiler.elapsed_seconds(), profiler.expired() ? "" : "（提前结束）", profiler.count(),
+            profiler.pauses(), profiler.average_pause_us(), profiler.max_pause_us());
+    }
+
+private:
+    // 采样结束后才把地址换成函数名，同一个地址只查询一次
+    auto write_folded(Profiler const& profiler, FILE *output) const -> void {
+        std::unordered_map<std::intptr_t, std::string> names{};
+        for (auto const& item : profiler.stacks()) {
+            std::string line{};
+            for (auto addr : item.first) {
+                auto it = names.find(addr);
+                if (it == names.end()) {
+                    it = names.insert({addr, symbolize(addr)}).first;
+                }
+                if (!line.empty()) {
+                    line += ';';
+                }
+                line += it->second;
+            }
+            fprintf(output, "%s %lu\n", line.c_str(), item.second);
+        }
+    }
+
+    auto symbolize(std::intptr_t addr) const -> std::string {
+        try {
+            return at_name(inferior.get_function_die_by_addr(addr));
+        } catch (no_debug_information const& exc) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "0x%lx", addr);
+            return buf;
+        }
+    }
+};
+
+}
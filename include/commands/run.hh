@@ -28,6 +28,10 @@ public:
 
 public:
     auto run(std::vector<std::string> const& args) const -> void {
+        if (inferior.running() && inferior.attached()) {
+            printf("已经附加到进程 %d，先 detach\n", inferior.pid);
+            return;
+        }
         if (inferior.running()) {
             printf("已经在运行，重启\n");
             inferior.stop();
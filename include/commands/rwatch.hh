@@ -0,0 +1,35 @@
+#pragma once
+
+/**
+ * 访问观察点命令，数据被读取或者写入时停下
+ * x86 的调试寄存器没有只读的条件，写入也会触发，这时会同时显示新旧值
+ **/
+
+#include <commands/watch.hh>
+
+namespace BitTech {
+
+class RWatch : public Watch {
+public:
+    RWatch(Inferior& inferior): Watch(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "rwatch";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "rw";
+    }
+
+    auto brief() const -> std::string override {
+        return "设置访问观察点，数据被读取或写入时停下。";
+    }
+
+protected:
+    auto kind() const -> DebugRegisters::Kind override {
+        return DebugRegisters::Kind::access;
+    }
+};
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+/**
+ * 打印调试器自身的统计信息，用来观察每次停下时的系统调用开销
+ **/
+
+#include <command.hh>
+#include <register_cache.hh>
+
+namespace BitTech {
+
+class Stats : public Command {
+public:
+    Stats(Inferior& inferior): Command(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "stats";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "st";
+    }
+
+    auto brief() const -> std::string override {
+        return "打印调试器的系统调用统计和加载调试信息的耗时。";
+    }
+
+public:
+    auto run(std::vector<std::string> const& args) const -> void {
+        auto const& c = PtraceProxy::counters();
+        printf("ptrace GETREGS:     %lu\n", c.getregs);
+        printf("ptrace SETREGS:     %lu\n", c.setregs);
+        printf("寄存器缓存读取:     %lu\n", RegisterCache::reads());
+        printf("恢复运行:           %lu\n", c.resumes);
+        printf("内存读系统调用:     %lu\n", c.memory_reads);
+        printf("内存写系统调用:     %lu\n", c.memory_writes);
+
+        auto const& times = inferior.get_load_times();
+        auto const& index = inferior.get_dwarf_index();
+        printf("读取 ELF:           %.1f ms\n", times.elf_ms);
+        printf("读取 DWARF 头:      %.1f ms\n", times.dwarf_ms);
+        printf("编译单元地址表:     %.1f ms\n", times.index_ms);
+        printf("索引缓存:           %s\n", index.from_cache() ? "命中" : "未命中");
+        printf("已建立索引的单元:   %zu/%zu\n", index.loaded_unit_count(), index.unit_count());
+        if (index.full_index_time() > 0) {
+            printf("并行建立完整索引:   %.1f ms\n", index.full_index_time());
+        }
+        auto const& names = inferior.get_name_index();
+        if (names.ready()) {
+            printf("函数名索引:         %.1f ms\n", names.build_time());
+        } else {
+            printf("函数名索引:         建立中\n");
+        }
+    }
+};
+
+}
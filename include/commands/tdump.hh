@@ -0,0 +1,131 @@
+#pragma once
+
+/**
+ * 解码跟踪点的记录文件，不需要 tracee 在运行
+ * tdump [文件]：按顺序打印文件中的跟踪点定义和每次命中收集的数据，默认是 tracepoint 当前的记录文件
+ **/
+
+#include <command.hh>
+#include <trace_file.hh>
+#include <string>
+#include <vector>
+#include <map>
+#include <ctime>
+#include <cctype>
+#include <cstdio>
+
+namespace BitTech {
+
+class Tdump : public Command {
+public:
+    Tdump(Inferior& inferior): Command(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "tdump";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "td";
+    }
+
+    auto brief() const -> std::string override {
+        return "tdump [文件]，打印跟踪点记录文件中的数据。";
+    }
+
+public:
+    auto run(std::vector<std::string> const& args) const -> void {
+        auto path = args.empty() ? inferior.get_tracepoints().path() : args[0];
+        TraceFileReader reader;
+        if (!reader.open_file(path)) {
+            printf("%s 不是跟踪点的记录文件\n", path.c_str());
+            return;
+        }
+
+        // 编号 -> 定义，同一个文件中后面的定义覆盖前面的
+        std::map<uint32_t, std::string> definitions{};
+        uint64_t hits = 0;
+        TraceFileReader::Entry entry;
+        while (reader.next(entry)) {
+            if (entry.type == TraceFile::definition && entry.size >= sizeof(TraceFile::Definition)) {
+                TraceFile::Definition def;
+                memcpy(&def, entry.data, sizeof(def));
+                auto text = std::string{entry.data + sizeof(def), std::min<std::size_t>(def.text_len, entry.size - sizeof(def))};
+                definitions[def.id] = text;
+                printf("跟踪点 %u 0x%lx: %s\n", def.id, def.addr, text.c_str());
+            } else if (entry.type == TraceFile::hit && entry.size >= sizeof(TraceFile::Hit)) {
+                print_hit(entry, definitions);
+                ++hits;
+            }
+        }
+        printf("共 %lu 次命中\n", hits);
+    }
+
+private:
+    auto print_hit(TraceFileReader::Entry const& entry, std::map<uint32_t, std::string> const& definitions) const -> void {
+        TraceFile::Hit hit;
+        memcpy(&hit, entry.data, sizeof(hit));
+        char when[32];
+        auto seconds = static_cast<time_t>(hit.ns / 1000000000);
+        tm local;
+        strftime(when, sizeof(when), "%H:%M:%S", localtime_r(&seconds, &local));
+        auto it = definitions.find(hit.id);
+        printf("[%s.%06lu] 跟踪点 %u (%s) LWP %u pc=0x%lx\n", when, hit.ns % 1000000000 / 1000, hit.id,
+            it != definitions.end() ? it->second.c_str() : "?", hit.tid, hit.pc);
+
+        auto at = sizeof(hit);
+        for (uint32_t i = 0; i < hit.item_count && at + sizeof(TraceFile::ItemHeader) <= entry.size; ++i) {
+            TraceFile::ItemHeader item;
+            memcpy(&item, entry.data + at, sizeof(item));
+            auto data = entry.data + at + sizeof(item);
+            auto got = std::min<std::size_t>(item.got, entry.size - at - sizeof(item));
+            if (item.kind == TraceFile::registers && got >= sizeof(user_regs_struct)) {
+                print_registers(data);
+            } else if (item.kind == TraceFile::memory) {
+                printf("    0x%lx，%u 字节", item.addr, item.requested);
+                if (got < item.requested) {
+                    printf("（只读到 %zu 字节）", got);
+                }
+                printf(":\n");
+                print_memory(item.addr, data, got);
+            }
+            at += sizeof(item) + TraceFile::align(item.requested);
+        }
+    }
+
+    // 每行 4 个寄存器
+    auto print_registers(char const *data) const -> void {
+        user_regs_struct regs;
+        memcpy(&regs, data, sizeof(regs));
+        auto const& table = TraceFile::register_table();
+        for (std::size_t i = 0; i < table.size(); ++i) {
+            printf("%s%-7s 0x%016lx", i % 4 == 0 ? "    " : "  ", table[i].name,
+                TraceFile::register_value(regs, table[i].offset));
+            if (i % 4 == 3 || i + 1 == table.size()) {
+                printf("\n");
+            }
+        }
+    }
+
+    // 每行 16 字节，右边是可打印的字符
+    auto print_memory(uint64_t addr, char const *data, std::size_t size) const -> void {
+        for (std::size_t line = 0; line < size; line += 16) {
+            printf("    0x%012lx ", addr + line);
+            for (std::size_t i = line; i < line + 16; ++i) {
+                if (i < size) {
+                    printf(" %02x", static_cast<unsigned char>(data[i]));
+                } else {
+                    printf("   ");
+                }
+            }
+            printf("  ");
+            for (std::size_t i = line; i < line + 16 && i < size; ++i) {
+                auto c = static_cast<unsigned char>(data[i]);
+                printf("%c", isprint(c) ? c : '.');
+            }
+            printf("\n");
+        }
+    }
+};
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+/**
+ * 查看或者切换当前线程
+ * thread 显示当前线程，thread <编号> 切换到该线程，之后 step/next 作用在它上面
+ **/
+
+#include <command.hh>
+#include <stdexcept>
+
+namespace BitTech {
+
+class SwitchThread : public Command {
+public:
+    SwitchThread(Inferior& inferior): Command(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "thread";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "t";
+    }
+
+    auto brief() const -> std::string override {
+        return "显示当前线程，或者用 thread <编号> 切换线程。";
+    }
+
+public:
+    auto run(std::vector<std::string> const& args) const -> void {
+        if (!inferior.running()) {
+            printf("还未运行，先启动运行。\n");
+            return;
+        }
+
+        if (args.size() == 0) {
+            auto& thread = inferior.current_thread();
+            printf("当前线程 %d (LWP %d)\n", thread.number, thread.tid);
+            return;
+        }
+
+        try {
+            auto& thread = inferior.select_thread(std::stoi(args[0]));
+            auto location = thread.is_running || thread.is_starting ? std::string{"(运行中)"}
+                : inferior.describe_addr(inferior.get_thread_pc(thread));
+            printf("[切换到线程 %d (LWP %d)] %s\n", thread.number, thread.tid, location.c_str());
+        } catch (std::logic_error const& exc) {
+            printf("线程编号的格式不正确\n");
+        } catch (exception const& exc) {
+            printf("%s\n", exc.reason.c_str());
+        }
+    }
+};
+
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+/**
+ * 跟踪函数的调用次数和耗时
+ * trace-calls <正则>：跟踪名称中能找到正则的函数，之后用 continue 运行，命中时不停下也不打印
+ * trace-calls：打印每个函数的调用次数、耗时和耗时分布
+ * trace-calls off：停止跟踪，删除跟踪用的断点和统计数据
+ **/
+
+#include <command.hh>
+#include <call_tracer.hh>
+#include <string>
+#include <regex>
+#include <algorithm>
+#include <cstdio>
+
+namespace BitTech {
+
+class TraceCalls : public Command {
+public:
+    TraceCalls(Inferior& inferior): Command(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "trace-calls";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "tc";
+    }
+
+    auto brief() const -> std::string override {
+        return "trace-calls [正则|off]，跟踪函数的调用次数和耗时，不带参数时打印统计。";
+    }
+
+public:
+    auto run(std::vector<std::string> const& args) const -> void {
+        if (args.empty()) {
+            summary();
+            return;
+        }
+
+        try {
+            if (args[0] == "off") {
+                inferior.stop_tracing_calls();
+                printf("已停止跟踪函数调用\n");
+                return;
+            }
+
+            std::regex pattern{};
+            try {
+                pattern = std::regex{args[0]};
+            } catch (std::regex_error const& exc) {
+                printf("正则表达式的格式不正确\n");
+                return;
+            }
+            auto added = inferior.trace_calls(pattern);
+            printf("新跟踪 %zu 个函数，共 %zu 个\n", added, inferior.get_call_tracer().all().size());
+        } catch (exception const& exc) {
+            printf("%s\n", exc.reason.c_str());
+        }
+    }
+
+private:
+    // 按总耗时从大到小打印每个函数，之后打印有调用的函数的耗时分布
+    auto summary() const -> void {
+        auto const& tracer = inferior.get_call_tracer();
+        if (!tracer.active()) {
+            printf("没有跟踪任何函数，用 trace-calls <正则> 开始跟踪\n");
+            return;
+        }
+
+        std::vector<CallTracer::Function const *> funcs{};
+        for (auto const& func : tracer.all()) {
+            funcs.push_back(&func);
+        }
+        std::stable_sort(funcs.begin(), funcs.end(), [](CallTracer::Function const *a, CallTracer::Function const *b) {
+            return a->total_ns > b->total_ns;
+        });
+
+        printf("%-32s %10s %10s %12s %10s %10s %10s %10s %10s\n",
+            "函数", "调用", "返回", "总计(us)", "平均(us)", "最小(us)", "p50(us)", "p99(us)", "最大(us)");
+        for (auto func : funcs) {
+            printf("%-32s %10lu %10lu %12.1f %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+                func->name.c_str(), func->calls, func->returns, us(func->total_ns),
+                func->returns == 0 ? 0 : us(func->total_ns) / func->returns,
+                func->returns == 0 ? 0 : us(func->min_ns),
+                us(CallTracer::percentile_ns(*func, 50)), us(CallTracer::percentile_ns(*func, 99)), us(func->max_ns));
+        }
+
+        for (auto func : funcs) {
+            if (func->returns > 0) {
+                printf("\n%s:\n", func->name.c_str());
+                histogram(*func);
+            }
+        }
+    }
+
+    // 只打印第一个到最后一个非空的桶，条形按最多的桶缩放到 40 个字符
+    auto histogram(CallTracer::Function const& func) const -> void {
+        static const int width = 40;
+        auto first = CallTracer::bucket_count;
+        auto last = -1;
+        uint64_t most = 0;
+        for (auto i = 0; i < CallTracer::bucket_count; ++i) {
+            if (func.histogram[i] > 0) {
+                first = std::min(first, i);
+                last = i;
+                most = std::max(most, func.histogram[i]);
+            }
+        }
+        for (auto i = first; i <= last; ++i) {
+            auto count = func.histogram[i];
+            auto bar = static_cast<int>((count * width + most - 1) / most);
+            printf("  [%10s, %10s) %10lu |%-*s|\n", duration(i == 0 ? 0 : uint64_t{1} << i).c_str(),
+                duration(uint64_t{1} << (i + 1)).c_str(), count, width, std::string(bar, '#').c_str());
+        }
+    }
+
+    static auto us(uint64_t ns) -> double {
+        return ns / 1000.0;
+    }
+
+    static auto duration(uint64_t ns) -> std::string {
+        char buf[32];
+        if (ns < 1000) {
+            snprintf(buf, sizeof(buf), "%luns", ns);
+        } else if (ns < 1000000) {
+            snprintf(buf, sizeof(buf), "%.1fus", ns / 1e3);
+        } else if (ns < 1000000000) {
+            snprintf(buf, sizeof(buf), "%.1fms", ns / 1e6);
+        } else {
+            snprintf(buf, sizeof(buf), "%.1fs", ns / 1e9);
+        }
+        return buf;
+    }
+};
+
+}
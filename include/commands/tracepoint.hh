@@ -0,0 +1,115 @@
+#pragma once
+
+/**
+ * 收集数据的跟踪点
+ * tracepoint <位置> collect <项> [<项> ...]：命中时收集这些项，追加到记录文件后继续运行，不停下也不打印
+ *   项：regs、*0x地址,长度、$寄存器[+-偏移],长度、全局变量名[,长度]
+ * tracepoint：打印每个跟踪点的命中次数和记录文件
+ * tracepoint file <路径>：之后的记录写到这个文件，默认是 bdb.trace
+ * tracepoint off：删除所有跟踪点，已经写入的记录保留
+ * 位置的写法和 break 相同；记录文件用 tdump 查看
+ **/
+
+#include <command.hh>
+#include <tracepoints.hh>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+namespace BitTech {
+
+class Tracepoint : public Command {
+public:
+    Tracepoint(Inferior& inferior): Command(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "tracepoint";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "tp";
+    }
+
+    auto brief() const -> std::string override {
+        return "tracepoint [<位置> collect <项 ...>|file <路径>|off]，命中时收集数据写入记录文件，不停下。";
+    }
+
+public:
+    auto run(std::vector<std::string> const& args) const -> void {
+        try {
+            if (args.empty()) {
+                summary();
+            } else if (args[0] == "off") {
+                inferior.clear_tracepoints();
+                printf("已删除所有跟踪点\n");
+            } else if (args[0] == "file") {
+                if (args.size() != 2) {
+                    printf("用法: tracepoint file <路径>\n");
+                    return;
+                }
+                inferior.set_trace_file(args[1]);
+                printf("记录写到 %s\n", args[1].c_str());
+            } else {
+                add(args);
+            }
+        } catch (exception const& exc) {
+            printf("%s\n", exc.reason.c_str());
+        }
+    }
+
+private:
+    auto add(std::vector<std::string> const& args) const -> void {
+        if (args.size() < 3 || args[1] != "collect") {
+            printf("用法: tracepoint <位置> collect <regs|*0x地址,长度|$寄存器[+-偏移],长度|变量名[,长度]> ...\n");
+            return;
+        }
+        if (args.size() - 2 > Tracepoints::max_items) {
+            printf("每个跟踪点最多收集 %zu 项\n", Tracepoints::max_items);
+            return;
+        }
+
+        // 全局变量换成链接地址，tracee 重新运行时按新的装载偏移换算
+        auto find_variable = [this](std::string const& name, std::intptr_t& addr, std::size_t& size) {
+            try {
+                auto variable = inferior.get_variable_by_name(name);
+                addr = inferior.to_link(variable.first);
+                size = variable.second;
+                return true;
+            } catch (no_debug_information const& exc) {
+                return false;
+            }
+        };
+        std::vector<Tracepoints::Item> items{};
+        std::string text{args[0] + " collect"};
+        for (std::size_t i = 2; i < args.size(); ++i) {
+            Tracepoints::Item item;
+            if (!Tracepoints::parse_item(args[i], item, find_variable)) {
+                printf("无法收集 %s\n", args[i].c_str());
+                return;
+            }
+            items.push_back(item);
+            text += " " + args[i];
+        }
+
+        auto addr = inferior.resolve_location(args[0]);
+        auto id = inferior.add_tracepoint(addr, text, items);
+        printf("跟踪点 %zu 在 0x%lx，记录写到 %s\n", id, addr, inferior.get_tracepoints().path().c_str());
+    }
+
+    auto summary() const -> void {
+        auto& tracepoints = inferior.get_tracepoints();
+        if (!tracepoints.active()) {
+            printf("没有跟踪点，用 tracepoint <位置> collect <项 ...> 加入\n");
+            return;
+        }
+        printf("%-4s %-18s %12s  %s\n", "编号", "地址", "命中", "定义");
+        auto const& all = tracepoints.all();
+        for (std::size_t id = 0; id < all.size(); ++id) {
+            printf("%-4zu 0x%-16lx %12lu  %s\n", id, all[id].addr, all[id].hits, all[id].text.c_str());
+        }
+        printf("记录文件: %s\n", tracepoints.path().c_str());
+    }
+};
+
+}
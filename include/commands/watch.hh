@@ -0,0 +1,94 @@
+#pragma once
+
+/**
+ * 观察点命令，在数据被写入时停下
+ * watch <全局变量名>  或者  watch *0x<地址> [字节数]，字节数默认为 8
+ * 优先使用调试寄存器；区间超过 8 字节、没有对齐或者调试寄存器用完时，改用页保护实现的软件观察点
+ **/
+
+#include <command.hh>
+#include <debug_registers.hh>
+#include <stdexcept>
+
+namespace BitTech {
+
+class Watch : public Command {
+public:
+    Watch(Inferior& inferior): Command(inferior) {}
+
+public:
+    auto name() const -> std::string override {
+        return "watch";
+    }
+
+    auto shortcut() const -> std::string override {
+        return "wa";
+    }
+
+    auto brief() const -> std::string override {
+        return "设置观察点，数据被写入时停下。";
+    }
+
+public:
+    auto run(std::vector<std::string> const& args) const -> void {
+        if (args.size() == 0) {
+            printf("需要给出观察的位置：全局变量名或者 *0x 开头的地址\n");
+            return;
+        }
+
+        std::intptr_t addr = 0;
+        std::size_t len = 8;
+        try {
+            if (args[0][0] == '*') {
+                addr = std::stol(std::string{args[0], 3}, 0, 16);
+                if (args.size() > 1) {
+                    len = std::stoul(args[1]);
+                }
+            } else {
+                auto variable = inferior.get_variable_by_name(args[0]);
+                addr = variable.first;
+                len = variable.second;
+            }
+        } catch (std::logic_error const& exc) {
+            printf("地址或者长度的格式不正确\n");
+            return;
+        } catch (no_debug_information const& exc) {
+            printf("没有找到变量的调试信息\n");
+            return;
+        }
+
+        if (len == 0) {
+            printf("不知道变量的大小，用 watch *0x<地址> <字节数> 指定\n");
+            return;
+        }
+
+        try {
+            auto slot = inferior.set_hardware_watchpoint(addr, len, kind());
+            printf("%s %d: 0x%lx (%zu 字节)\n", kind() == DebugRegisters::Kind::write ? "观察点" : "访问观察点",
+                slot, addr, len);
+            return;
+        } catch (exception const& exc) {
+            if (kind() != DebugRegisters::Kind::write) {
+                printf("%s\n", exc.reason.c_str());
+                return;
+            }
+            printf("%s，改用软件观察点\n", exc.reason.c_str());
+        }
+
+        try {
+            auto id = inferior.set_software_watchpoint(addr, len);
+            printf("软件观察点 %d: 0x%lx (%zu 字节)\n", id, addr, len);
+            printf("被观察的页没有写权限，系统调用向这些页写入时会以 EFAULT 失败\n");
+        } catch (exception const& exc) {
+            printf("%s\n", exc.reason.c_str());
+        }
+    }
+
+protected:
+    // 触发的条件，rwatch 改为读写都触发
+    virtual auto kind() const -> DebugRegisters::Kind {
+        return DebugRegisters::Kind::write;
+    }
+};
+
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+/**
+ * x86 调试寄存器，用于硬件断点和数据观察点
+ * DR0~DR3 存放地址，DR7 中每个槽位有启用位、触发条件（执行/写/读写）和长度，触发后 DR6 的低 4 位记录是哪个槽位
+ * 硬件断点不修改代码，越过它也不需要 disable/单步/enable；观察点在写入发生时以原生速度停下
+ */
+
+#include <exception.hh>
+#include <ptrace_proxy.hh>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+namespace BitTech {
+
+class DebugRegisters {
+public:
+    // 触发条件，取值就是 DR7 中 R/W 字段的编码
+    enum class Kind {
+        execute = 0,  // 执行到地址处的指令
+        write = 1,    // 写入
+        access = 3,   // 读或者写，x86 没有只读的条件
+    };
+
+    struct Slot {
+        bool used;
+        std::intptr_t addr;
+        Kind kind;
+        std::size_t len;
+    };
+
+    static const int count = 4;
+
+public:
+    DebugRegisters(): slots{} {}
+
+public:
+    // 占用一个空闲槽位，返回槽位编号
+    // len 只能是 1/2/4/8 并且 addr 要按 len 对齐，执行断点的 len 是 1
+    auto add(std::intptr_t addr, Kind kind, std::size_t len) -> int {
+        if (kind == Kind::execute) {
+            len = 1;
+        }
+        if (len != 1 && len != 2 && len != 4 && len != 8) {
+            EXCEPTION("硬件观察点的长度只能是 1、2、4 或 8 字节");
+        }
+        if (addr % len != 0) {
+            EXCEPTION("硬件观察点的地址必须按长度对齐");
+        }
+
+        for (auto i = 0; i < count; ++i) {
+            if (!slots[i].used) {
+                slots[i] = Slot{true, addr, kind, len};
+                return i;
+            }
+        }
+        EXCEPTION("调试寄存器已经用完（最多 4 个硬件断点/观察点）");
+    }
+
+    auto remove(int slot) -> void {
+        slots[slot] = Slot{false, 0, Kind::execute, 0};
+    }
+
+    // 地址和条件都相同的槽位，没有返回 -1
+    auto find(std::intptr_t addr, Kind kind) const -> int {
+        for (auto i = 0; i < count; ++i) {
+            if (slots[i].used && slots[i].addr == addr && slots[i].kind == kind) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // 装载偏移变化时整体平移所有槽位的地址，偏移按页对齐，不会破坏地址的对齐
+    auto rebase(std::intptr_t delta) -> void {
+        for (auto& s : slots) {
+            if (s.used) {
+                s.addr += delta;
+            }
+        }
+    }
+
+    auto slot(int i) const -> Slot const& {
+        return slots[i];
+    }
+
+    auto empty() const -> bool {
+        for (auto const& s : slots) {
+            if (s.used) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    // 把槽位写入线程的调试寄存器
+    // 内核会检查 DR7 中启用的槽位地址是否合法，所以先关闭 DR7，写完地址再写 DR7
+    auto install(pid_t tid) const -> void {
+        PtraceProxy::set_debug_register(tid, 7, 0);
+        for (auto i = 0; i < count; ++i) {
+            if (slots[i].used) {
+                PtraceProxy::set_debug_register(tid, i, slots[i].addr);
+            }
+        }
+        auto dr7 = control();
+        if (dr7 != 0 && !PtraceProxy::set_debug_register(tid, 7, dr7)) {
+            EXCEPTION("设置调试寄存器失败");
+        }
+    }
+
+    // 读取并清除 DR6，返回触发的槽位，没有槽位触发返回 -1
+    static auto triggered(pid_t tid) -> int {
+        auto dr6 = PtraceProxy::get_debug_register(tid, 6);
+        if ((dr6 & 0x0F) == 0) {
+            return -1;
+        }
+        // DR6 不会被处理器清除，不清除的话下次还会看到这次的结果
+        PtraceProxy::set_debug_register(tid, 6, 0);
+        for (auto i = 0; i < count; ++i) {
+            if (dr6 & (1u << i)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+private:
+    // DR7：槽位 i 的本地启用位在第 2i 位，R/W 在 16+4i 开始的 2 位，长度在 18+4i 开始的 2 位
+    auto control() const -> uint64_t {
+        uint64_t dr7 = 0;
+        for (auto i = 0; i < count; ++i) {
+            if (!slots[i].used) {
+                continue;
+            }
+            dr7 |= 1ull << (2 * i);
+            dr7 |= static_cast<uint64_t>(slots[i].kind) << (16 + 4 * i);
+            dr7 |= length_bits(slots[i].len) << (18 + 4 * i);
+        }
+        return dr7;
+    }
+
+    // 长度的编码：1 字节 00，2 字节 01，8 字节 10，4 字节 11
+    static auto length_bits(std::size_t len) -> uint64_t {
+        switch (len) {
+        case 2:
+            return 1;
+        case 8:
+            return 2;
+        case 4:
+            return 3;
+        default:
+            return 0;
+        }
+    }
+
+private:
+    std::array<Slot, count> slots;
+};
+
+}
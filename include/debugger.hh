@@ -8,16 +8,32 @@
 #include <exception.hh>
 #include <string_utils.hh>
 #include <inferior.hh>
+#include <event_loop.hh>
 #include <command.hh>
 #include <commands/run.hh>
 #include <commands/continue.hh>
 #include <commands/break.hh>
+#include <commands/hbreak.hh>
+#include <commands/watch.hh>
+#include <commands/rwatch.hh>
 #include <commands/list.hh>
 #include <commands/step.hh>
 #include <commands/next.hh>
+#include <commands/stats.hh>
+#include <commands/thread.hh>
+#include <commands/info.hh>
+#include <commands/nonstop.hh>
+#include <commands/attach.hh>
+#include <commands/detach.hh>
+#include <commands/profile.hh>
+#include <commands/backtrace.hh>
+#include <commands/trace_calls.hh>
+#include <commands/catch.hh>
+#include <commands/ftrace.hh>
+#include <commands/tracepoint.hh>
+#include <commands/tdump.hh>
 #include <vector>
 #include <string>
-#include <iostream>
 #include <memory>
 #include <cstdio>
 
@@ -30,9 +46,35 @@ public:
         commands.push_back(std::make_shared<Run>(inferior));
         commands.push_back(std::make_shared<Continue>(inferior));
         commands.push_back(std::make_shared<Break>(inferior));
+        commands.push_back(std::make_shared<HBreak>(inferior));
+        commands.push_back(std::make_shared<Watch>(inferior));
+        commands.push_back(std::make_shared<RWatch>(inferior));
         commands.push_back(std::make_shared<List>(inferior));
         commands.push_back(std::make_shared<Step>(inferior));
         commands.push_back(std::make_shared<Next>(inferior));
+        commands.push_back(std::make_shared<Stats>(inferior));
+        commands.push_back(std::make_shared<SwitchThread>(inferior));
+        commands.push_back(std::make_shared<Info>(inferior));
+        commands.push_back(std::make_shared<NonStop>(inferior));
+        commands.push_back(std::make_shared<Attach>(inferior));
+        commands.push_back(std::make_shared<Detach>(inferior));
+        commands.push_back(std::make_shared<Profile>(inferior));
+        commands.push_back(std::make_shared<Backtrace>(inferior));
+        commands.push_back(std::make_shared<TraceCalls>(inferior));
+        commands.push_back(std::make_shared<Catch>(inferior));
+        commands.push_back(std::make_shared<Ftrace>(inferior));
+        commands.push_back(std::make_shared<Tracepoint>(inferior));
+        commands.push_back(std::make_shared<Tdump>(inferior));
+    }
+
+public:
+    // bdb -p <pid> 启动时先附加到进程上
+    auto attach(pid_t pid) -> void {
+        try {
+            inferior.attach(pid);
+        } catch (exception const& exc) {
+            printf("%s\n", exc.reason.c_str());
+        }
     }
 
 public:
@@ -44,9 +86,8 @@ public:
         std::string line;
         while (1) {
             prompt();
-            auto &in = std::getline(std::cin, line);
             // EOF 退出
-            if (!in) {
+            if (!read_command(line)) {
                 break;
             }
 
@@ -76,6 +117,9 @@ public:
             } catch (no_such_command const& exc) {
                 printf("不支持的命令\n");
                 help();
+            } catch (exception const& exc) {
+                // 命令执行中的错误不结束调试器，否则附加的进程来不及脱离
+                printf("%s\n", exc.reason.c_str());
             }
         }
 
@@ -101,9 +145,54 @@ private:
 
     auto prompt() const -> void {
         printf("(bdb) ");
+        fflush(stdout);
+    }
+
+    // 等待用户输入一行命令，等待期间处理后台运行的 tracee 的停止和 Ctrl-C，EOF 时返回 false
+    auto read_command(std::string& line) -> bool {
+        auto& events = inferior.get_event_loop();
+        while (!events.take_line(line)) {
+            if (events.input_closed()) {
+                return false;
+            }
+            try {
+                switch (events.wait(true, inferior.drain_interval())) {
+                case EventLoop::Event::input:
+                    events.read_input();
+                    break;
+                case EventLoop::Event::child:
+                    if (inferior.poll_events()) {
+                        prompt();
+                    }
+                    break;
+                case EventLoop::Event::interrupt:
+                    printf("\n");
+                    inferior.interrupt();
+                    prompt();
+                    break;
+                case EventLoop::Event::idle:
+                    inferior.drain_fast_tracepoints();
+                    break;
+                default:
+                    break;
+                }
+            } catch (exception const& exc) {
+                printf("%s\n", exc.reason.c_str());
+                prompt();
+            }
+        }
+        return true;
     }
 
     auto quit() -> void {
+        // 附加上的进程不能随调试器一起结束，先恢复所有修改再脱离
+        if (inferior.running() && inferior.attached()) {
+            try {
+                inferior.detach();
+            } catch (exception const& exc) {
+                printf("%s\n", exc.reason.c_str());
+            }
+        }
         printf("quit\n");
     }
 
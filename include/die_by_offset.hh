@@ -0,0 +1,32 @@
+#pragma once
+
+/**
+ * 按 DIE 在 .debug_info 中的偏移找回 DIE
+ * 索引里只保存偏移，需要 DIE 本身时再从编译单元的根节点往下找
+ */
+
+#include <dwarf/dwarf++.hh>
+
+namespace BitTech {
+
+// DIE 的子节点按偏移递增排列，目标只可能在偏移不大于它的最后一个子节点之下
+// 找不到时返回无效的 DIE
+inline auto find_die_by_offset(dwarf::die const& parent, dwarf::section_offset offset) -> dwarf::die {
+    dwarf::die candidate{};
+    for (auto const& child : parent) {
+        if (child.get_section_offset() == offset) {
+            return child;
+        }
+        if (child.get_section_offset() > offset) {
+            break;
+        }
+        candidate = child;
+    }
+
+    if (!candidate.valid()) {
+        return dwarf::die{};
+    }
+    return find_die_by_offset(candidate, offset);
+}
+
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+/**
+ * 位移单步（displaced stepping）
+ * 越过断点时不恢复原来的字节，而是把原来的指令复制到 tracee 中的一块暂存页上单步执行，执行完再把 PC 改回原处
+ * 断点的 0xCC 一直留在原处，其他线程不会越过它，也就不需要暂停其他线程
+ * 本类负责选择暂存页的位置、改写复制的指令和执行后的修正；映射暂存页、读写内存和寄存器由 Inferior 完成
+ */
+
+#include <x86_decoder.hh>
+#include <vector>
+#include <array>
+#include <limits>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <sys/types.h>
+
+namespace BitTech {
+
+class DisplacedStepper {
+public:
+    static const std::intptr_t page_size = 4096;
+    // 每个槽位放一条指令，最长 15 字节
+    static const std::size_t slot_size = 16;
+    static const std::size_t slot_count = page_size / slot_size;
+
+    // 准备好的一次位移单步
+    struct Plan {
+        // 指令原来的地址
+        std::intptr_t from;
+        // 暂存页中执行的地址
+        std::intptr_t to;
+        X86Decoder::Instruction insn;
+        // 改写之后放到暂存页的指令
+        std::vector<uint8_t> code;
+        // 槽位中已经是这条指令时不需要再写
+        bool needs_write;
+    };
+
+public:
+    DisplacedStepper(): base{0}, is_unavailable{false}, cached{} {}
+
+public:
+    // 暂存页已经映射好了
+    auto ready() const -> bool {
+        return base != 0;
+    }
+
+    // 映射暂存页失败过，之后不再尝试
+    auto unavailable() const -> bool {
+        return is_unavailable;
+    }
+
+    auto set_page(std::intptr_t page) -> void {
+        base = page;
+        cached.fill(0);
+    }
+
+    auto mark_unavailable() -> void {
+        is_unavailable = true;
+    }
+
+    // tracee 结束后暂存页随着进程一起消失
+    auto reset() -> void {
+        base = 0;
+        is_unavailable = false;
+        cached.fill(0);
+    }
+
+    // 第 0 个槽位固定放一条 syscall 指令，向 tracee 注入系统调用时在这里执行，不需要修改代码段
+    auto syscall_address() const -> std::intptr_t {
+        return base;
+    }
+
+public:
+    // 为 from 处的指令准备位移单步，original 是指令原来的字节（断点换回原来的字节）
+    // 陷入内核的指令、解码失败或者 RIP 相对寻址的位移超出 32 位时返回 false
+    auto prepare(std::intptr_t from, uint8_t const *original, std::size_t size, Plan& plan) const -> bool {
+        if (!ready()) {
+            return false;
+        }
+
+        X86Decoder::Instruction insn;
+        if (!X86Decoder::decode(original, size, from, insn) || insn.flow == X86Decoder::Flow::system) {
+            return false;
+        }
+
+        // 同一个断点总是用同一个槽位，反复经过时不用重新写入
+        auto slot = 1 + static_cast<std::size_t>(from) % (slot_count - 1);
+        plan.from = from;
+        plan.to = base + static_cast<std::intptr_t>(slot * slot_size);
+        plan.insn = insn;
+        plan.code.assign(original, original + insn.length);
+
+        // RIP 相对寻址的位移是相对下一条指令的，换了地址后要调整，保证访问的还是原来的内存
+        if (insn.disp_offset >= 0) {
+            int32_t disp;
+            memcpy(&disp, plan.code.data() + insn.disp_offset, sizeof(disp));
+            auto moved = static_cast<int64_t>(disp) + (from - plan.to);
+            if (moved < std::numeric_limits<int32_t>::min() || moved > std::numeric_limits<int32_t>::max()) {
+                return false;
+            }
+            disp = static_cast<int32_t>(moved);
+            memcpy(plan.code.data() + insn.disp_offset, &disp, sizeof(disp));
+        }
+        plan.needs_write = cached[slot] != from;
+        return true;
+    }
+
+    // 槽位已经写入了 plan 的指令
+    auto mark_written(Plan const& plan) -> void {
+        cached[(plan.to - base) / slot_size] = plan.from;
+    }
+
+    // from 处的代码被改写了（例如换成了快速跟踪点的跳转），下次位移单步时重新写入槽位
+    auto forget(std::intptr_t from) -> void {
+        auto slot = 1 + static_cast<std::size_t>(from) % (slot_count - 1);
+        if (cached[slot] == from) {
+            cached[slot] = 0;
+        }
+    }
+
+public:
+    // 单步之后的 PC 换算回原来的位置
+    // 相对跳转的目标是相对暂存页算出来的，整体平移回去；ret 和间接跳转的目标本来就是对的
+    static auto relocate_pc(Plan const& plan, std::intptr_t pc) -> std::intptr_t {
+        switch (plan.insn.flow) {
+        case X86Decoder::Flow::jump:
+        case X86Decoder::Flow::cond_jump:
+        case X86Decoder::Flow::call:
+            return pc - plan.to + plan.from;
+        case X86Decoder::Flow::ret:
+        case X86Decoder::Flow::indirect_jump:
+        case X86Decoder::Flow::indirect_call:
+            return pc == plan.to ? plan.from : pc;
+        default:
+            if (pc >= plan.to && pc <= plan.to + static_cast<std::intptr_t>(plan.insn.length)) {
+                return pc - plan.to + plan.from;
+            }
+            return pc;
+        }
+    }
+
+    // 调用指令压栈的是暂存页中的返回地址，要改成原来的下一条指令
+    static auto is_call(Plan const& plan) -> bool {
+        return plan.insn.flow == X86Decoder::Flow::call || plan.insn.flow == X86Decoder::Flow::indirect_call;
+    }
+
+    static auto return_address(Plan const& plan) -> std::intptr_t {
+        return plan.from + static_cast<std::intptr_t>(plan.insn.length);
+    }
+
+public:
+    // 在 /proc/pid/maps 中找离 near 最近的空闲页，暂存页放在那里，RIP 相对寻址的位移才不会超出 32 位
+    // 找不到时返回 0
+    static auto find_free_page(pid_t pid, std::intptr_t near) -> std::intptr_t {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+        auto maps = fopen(path, "r");
+        if (maps == nullptr) {
+            return 0;
+        }
+
+        // 低于 mmap_min_addr 的地址不能映射，高于 user_limit 的是内核空间
+        static const std::intptr_t user_limit = 0x7ffffffff000;
+        std::intptr_t prev_end = 0x10000;
+        std::intptr_t best = 0;
+        auto best_distance = std::numeric_limits<std::intptr_t>::max();
+        auto consider = [&](std::intptr_t page) {
+            auto distance = page > near ? page - near : near - page;
+            if (distance < best_distance) {
+                best = page;
+                best_distance = distance;
+            }
+        };
+
+        unsigned long start, end;
+        char line[512];
+        while (fgets(line, sizeof(line), maps) != nullptr) {
+            if (sscanf(line, "%lx-%lx", &start, &end) != 2) {
+                continue;
+            }
+            auto low = std::min(static_cast<std::intptr_t>(start), user_limit);
+            if (low - prev_end >= page_size) {
+                // 空闲区间的两端离已有的映射最近
+                consider(prev_end);
+                consider(low - page_size);
+            }
+            prev_end = std::max(prev_end, static_cast<std::intptr_t>(end));
+        }
+        fclose(maps);
+        return best;
+    }
+
+private:
+    std::intptr_t base;
+    bool is_unavailable;
+    // 每个槽位里现在放的是哪个地址的指令
+    std::array<std::intptr_t, slot_count> cached;
+};
+
+}
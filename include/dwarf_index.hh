@@ -0,0 +1,352 @@
+#pragma once
+
+/**
+ * 按编译单元懒加载的调试信息索引
+ * 启动时只读取每个编译单元的地址区间（优先使用 .debug_aranges，否则只解析编译单元的根 DIE），
+ * 某个编译单元的函数区间表和行表在第一次被访问时才建立
+ * 需要完整索引时（例如按 文件:行号 查找），用多个线程并行建立所有编译单元的索引
+ * 有匹配的索引缓存文件时，编译单元的地址表和各编译单元的索引都直接取自缓存
+ */
+
+#include <function_index.hh>
+#include <line_index.hh>
+#include <index_cache.hh>
+#include <parallel.hh>
+#include <stopwatch.hh>
+#include <dwarf/dwarf++.hh>
+#include <elf/elf++.hh>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace BitTech {
+
+class DwarfIndex {
+public:
+    // 一个编译单元的索引
+    struct Shard {
+        FunctionIndex functions;
+        LineIndex lines;
+    };
+
+    using UnitRange = IndexCache::UnitRange;
+
+public:
+    DwarfIndex(): dwarf{nullptr}, cache{}, units{}, shards{}, full_index_ms{0} {}
+    // cache 与 dwarf 中的编译单元对不上时不使用缓存
+    DwarfIndex(dwarf::dwarf const& dwarf, elf::elf const& elf, std::shared_ptr<IndexCache const> cache)
+        : dwarf{&dwarf}, cache{}, units{}, shards{}, full_index_ms{0} {
+        auto const& cus = dwarf.compilation_units();
+        shards.resize(cus.size());
+
+        if (cache && matches(*cache, elf)) {
+            this->cache = cache;
+            units = cache->ranges();
+            return;
+        }
+
+        std::vector<UnitRange> ranges{};
+        std::vector<bool> covered(cus.size(), false);
+        read_aranges(elf, covered, ranges);
+
+        // .debug_aranges 中没有的编译单元，只解析根 DIE 得到地址区间
+        for (auto i = 0u; i < cus.size(); ++i) {
+            if (covered[i]) {
+                continue;
+            }
+            for (auto const& range : die_pc_range(cus[i].root())) {
+                add_unit_range(ranges, range.low, range.high, i);
+            }
+        }
+
+        std::sort(ranges.begin(), ranges.end(), [](UnitRange const& a, UnitRange const& b) {
+            return a.low < b.low;
+        });
+        units = Column<UnitRange>{std::move(ranges)};
+    }
+
+public:
+    // 建立完整的索引并写入缓存文件
+    // cancelled 被设置时放弃，返回 false
+    auto save(std::string const& path, std::string const& key, std::atomic<bool> const *cancelled = nullptr) const -> bool {
+        build_all(cancelled);
+        if (cancelled != nullptr && cancelled->load(std::memory_order_relaxed)) {
+            return false;
+        }
+
+        std::vector<UnitRange> ranges{units.begin(), units.end()};
+        std::vector<dwarf::section_offset> cu_offsets{};
+        std::vector<FunctionIndex const *> functions{};
+        std::vector<LineIndex const *> lines{};
+        auto const& cus = dwarf->compilation_units();
+        for (auto i = 0u; i < shards.size(); ++i) {
+            cu_offsets.push_back(cus[i].get_section_offset());
+            functions.push_back(&shards[i]->functions);
+            lines.push_back(&shards[i]->lines);
+        }
+        return IndexCache::write(path, key, ranges, cu_offsets, functions, lines);
+    }
+
+    // 后台线程的入口：使用自己打开的 elf/dwarf 建立完整的索引并写入缓存文件，不和调用者共享 libelfin 的状态
+    // cancelled 被设置后在编译单元之间停下，不写入缓存文件
+    static auto build_cache(std::string program, std::string path, std::string key, std::atomic<bool> const *cancelled) -> bool {
+        int fd = open(program.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        try {
+            elf::elf elf{elf::create_mmap_loader(fd)};
+            close(fd);
+            dwarf::dwarf dwarf{dwarf::elf::create_loader(elf)};
+            return DwarfIndex{dwarf, elf, nullptr}.save(path, key, cancelled);
+        } catch (std::exception const& exc) {
+            // 缓存只是加速，建立失败时下次启动还会重新尝试
+            return false;
+        }
+    }
+
+public:
+    // addr 所在编译单元的索引，第一次访问时建立；addr 不属于任何编译单元时返回 nullptr
+    auto shard_of(std::intptr_t addr) const -> Shard const * {
+        auto it = std::upper_bound(units.begin(), units.end(), addr, [](std::intptr_t addr, UnitRange const& unit) {
+            return addr < unit.low;
+        });
+        if (it == units.begin()) {
+            return nullptr;
+        }
+        --it;
+        if (addr >= it->high) {
+            return nullptr;
+        }
+        return &shard(it->unit);
+    }
+
+    auto find_function(std::intptr_t addr) const -> dwarf::die const * {
+        auto s = shard_of(addr);
+        return s == nullptr ? nullptr : s->functions.find(addr);
+    }
+
+    // 找到包含 addr 的行，找不到时返回的迭代器 at_end() 为 true
+    auto find_line(std::intptr_t addr) const -> LineIndex::iterator {
+        static LineIndex const empty{};
+        auto s = shard_of(addr);
+        return s == nullptr ? empty.end() : s->lines.find(addr);
+    }
+
+    // 所有编译单元中 file 第 line 行开始处的指令地址，需要完整的索引
+    auto find_addresses(std::string const& file, unsigned int line) const -> std::vector<std::intptr_t> {
+        build_all();
+
+        unsigned int best_line = 0;
+        std::vector<std::intptr_t> result{};
+        for (auto const& s : shards) {
+            unsigned int found_line = 0;
+            auto addrs = s->lines.find_addresses(file, line, found_line);
+            if (addrs.empty()) {
+                continue;
+            }
+            if (result.empty() || found_line < best_line) {
+                best_line = found_line;
+                result = addrs;
+            } else if (found_line == best_line) {
+                result.insert(result.end(), addrs.begin(), addrs.end());
+            }
+        }
+
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    // 并行建立所有还没有建立的编译单元索引，cancelled 被设置后剩下的编译单元不再建立
+    auto build_all(std::atomic<bool> const *cancelled = nullptr) const -> void {
+        std::vector<std::size_t> missing{};
+        for (auto i = 0u; i < shards.size(); ++i) {
+            if (!shards[i]) {
+                missing.push_back(i);
+            }
+        }
+        if (missing.empty()) {
+            return;
+        }
+
+        Stopwatch stopwatch{};
+        preload_sections();
+        auto const& cus = dwarf->compilation_units();
+        parallel_for(missing.size(), [&](std::size_t i) {
+            if (cancelled != nullptr && cancelled->load(std::memory_order_relaxed)) {
+                return;
+            }
+            auto unit = missing[i];
+            shards[unit].reset(new Shard{FunctionIndex{cus[unit]}, LineIndex{cus[unit]}});
+        });
+        full_index_ms = stopwatch.elapsed_ms();
+    }
+
+public:
+    auto unit_count() const -> std::size_t {
+        return shards.size();
+    }
+
+    auto loaded_unit_count() const -> std::size_t {
+        return std::count_if(shards.begin(), shards.end(), [](std::unique_ptr<Shard> const& s) {
+            return static_cast<bool>(s);
+        });
+    }
+
+    // 最近一次建立完整索引的耗时，没有建立过时为 0
+    auto full_index_time() const -> double {
+        return full_index_ms;
+    }
+
+    // 索引是否来自缓存文件
+    auto from_cache() const -> bool {
+        return static_cast<bool>(cache);
+    }
+
+private:
+    auto shard(std::size_t unit) const -> Shard const& {
+        if (!shards[unit]) {
+            auto const& cu = dwarf->compilation_units()[unit];
+            if (cache) {
+                shards[unit].reset(new Shard{cache->functions(unit, cu), cache->lines(unit)});
+            } else {
+                shards[unit].reset(new Shard{FunctionIndex{cu}, LineIndex{cu}});
+            }
+        }
+        return *shards[unit];
+    }
+
+    // 缓存中的编译单元和 dwarf 中的一一对应，每个编译单元的函数区间指向的 DIE 都在这个编译单元之内
+    auto matches(IndexCache const& cache, elf::elf const& elf) const -> bool {
+        auto const& cus = dwarf->compilation_units();
+        if (cache.unit_count() != cus.size()) {
+            return false;
+        }
+        auto const& info = elf.get_section(".debug_info");
+        auto info_size = info.valid() ? static_cast<dwarf::section_offset>(info.size()) : 0;
+        for (auto i = 0u; i < cus.size(); ++i) {
+            auto begin = cus[i].get_section_offset();
+            auto end = i + 1 < cus.size() ? cus[i + 1].get_section_offset() : info_size;
+            if (cache.cu_offset(i) != begin || !cache.dies_within(i, begin, end)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static auto add_unit_range(std::vector<UnitRange>& ranges, uint64_t low, uint64_t high, std::size_t unit) -> void {
+        if (low < high) {
+            ranges.push_back(UnitRange{static_cast<std::intptr_t>(low), static_cast<std::intptr_t>(high), unit});
+        }
+    }
+
+    // libelfin 在第一次用到某个节时才加载并记录下来，多个线程同时加载是不安全的
+    // 并行建立索引之前，先在当前线程把会用到的节都加载好
+    auto preload_sections() const -> void {
+        for (auto type : {dwarf::section_type::str, dwarf::section_type::line, dwarf::section_type::ranges}) {
+            try {
+                dwarf->get_section(type);
+            } catch (dwarf::format_error const& exc) {
+                // 程序没有这个节
+            }
+        }
+    }
+
+    // 解析 .debug_aranges，每组的格式为
+    // unit_length, version, debug_info_offset, address_size, segment_size, 对齐填充, 之后是 (address, length) 直到 (0, 0)
+    auto read_aranges(elf::elf const& elf, std::vector<bool>& covered, std::vector<UnitRange>& ranges) -> void {
+        elf::section const *section = nullptr;
+        for (auto const& sec : elf.sections()) {
+            if (sec.get_name() == ".debug_aranges") {
+                section = &sec;
+                break;
+            }
+        }
+        if (section == nullptr) {
+            return;
+        }
+
+        auto const& cus = dwarf->compilation_units();
+        auto const *begin = static_cast<const char *>(section->data());
+        auto const *end = begin + section->size();
+        auto const *p = begin;
+
+        while (p + 4 <= end) {
+            auto const *set_begin = p;
+            uint64_t length = read<uint32_t>(p);
+            std::size_t offset_size = 4;
+            if (length == 0xffffffff) {
+                if (p + 8 > end) {
+                    return;
+                }
+                length = read<uint64_t>(p);
+                offset_size = 8;
+            }
+            auto const *set_end = p + length;
+            if (set_end > end || p + 2 + offset_size + 2 > set_end) {
+                return;
+            }
+
+            p += 2;  // version
+            uint64_t info_offset = offset_size == 8 ? read<uint64_t>(p) : read<uint32_t>(p);
+            auto address_size = static_cast<std::size_t>(*p++);
+            auto segment_size = static_cast<std::size_t>(*p++);
+            if (address_size != 8 || segment_size != 0) {
+                p = set_end;
+                continue;
+            }
+            // 地址对按 2 * address_size 对齐
+            auto header = static_cast<std::size_t>(p - set_begin);
+            p = set_begin + (header + 2 * address_size - 1) / (2 * address_size) * (2 * address_size);
+
+            auto cu = std::lower_bound(cus.begin(), cus.end(), info_offset,
+                [](dwarf::compilation_unit const& unit, uint64_t offset) {
+                    return unit.get_section_offset() < offset;
+                });
+            if (cu == cus.end() || cu->get_section_offset() != info_offset) {
+                p = set_end;
+                continue;
+            }
+            std::size_t unit = cu - cus.begin();
+
+            while (p + 16 <= set_end) {
+                auto address = read<uint64_t>(p);
+                auto size = read<uint64_t>(p);
+                if (address == 0 && size == 0) {
+                    break;
+                }
+                add_unit_range(ranges, address, address + size, unit);
+                covered[unit] = true;
+            }
+
+            p = set_end;
+        }
+    }
+
+    template <typename T>
+    static auto read(const char *& p) -> T {
+        T value;
+        memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        return value;
+    }
+
+private:
+    dwarf::dwarf const *dwarf;
+    // 映射的缓存文件，没有缓存时为空
+    std::shared_ptr<IndexCache const> cache;
+    // 按起始地址排序的编译单元地址区间
+    Column<UnitRange> units;
+    // 每个编译单元的索引，没有建立时为空
+    mutable std::vector<std::unique_ptr<Shard>> shards;
+    mutable double full_index_ms;
+};
+
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+/**
+ * 调试器的事件循环：在一个 epoll 上同时等待 tracee 的状态变化、Ctrl-C、定时器和用户输入
+ * SIGCHLD 和 SIGINT 被屏蔽后改由 signalfd 读取，等待时不会阻塞在 waitpid 或者 getline 中，
+ * tracee 在后台运行时仍然可以输入命令，Ctrl-C 也只是打断 tracee，不会结束调试器
+ * tracee 和调试器在同一个前台进程组，Ctrl-C 两边都会收到，tracee 收到的那一份由 Inferior 丢掉，不投递给它
+ * 屏蔽的信号会被 fork 出的子进程继承，tracee 在 execv 之前要调用 restore_signals
+ */
+
+#include <string>
+#include <cerrno>
+#include <cstdint>
+#include <csignal>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+namespace BitTech {
+
+class EventLoop {
+public:
+    enum class Event {
+        child,      // 有子进程（tracee 的线程）状态变化
+        interrupt,  // 用户按下了 Ctrl-C
+        timer,      // arm_timer 设置的时间到了
+        input,      // 标准输入可读
+        idle,       // 等待超时，什么也没有发生
+        signal,     // 等待被别的信号（例如采样的 SIGALRM）打断
+    };
+
+public:
+    // 在创建任何线程之前构造，之后创建的线程都继承屏蔽的信号，SIGINT 不会被投递给别的线程
+    EventLoop(): epoll_fd{-1}, signal_fd{-1}, timer_fd{-1}, is_input_watched{false}, is_input_file{false}, is_input_closed{false}, input{} {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGCHLD);
+        sigaddset(&set, SIGINT);
+        pthread_sigmask(SIG_BLOCK, &set, nullptr);
+        signal_fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        watch(signal_fd, EPOLL_CTL_ADD);
+        watch(timer_fd, EPOLL_CTL_ADD);
+    }
+
+    ~EventLoop() {
+        close(epoll_fd);
+        close(signal_fd);
+        close(timer_fd);
+    }
+
+    EventLoop(EventLoop const&) = delete;
+    auto operator=(EventLoop const&) -> EventLoop& = delete;
+
+public:
+    // fork 出的 tracee 在 execv 之前恢复默认的信号屏蔽
+    static auto restore_signals() -> void {
+        sigset_t set;
+        sigemptyset(&set);
+        sigprocmask(SIG_SETMASK, &set, nullptr);
+    }
+
+    // 丢掉还没有读出的 SIGINT，tracee 已经报告了同一次 Ctrl-C 时使用
+    auto discard_interrupt() -> void {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGINT);
+        timespec now{0, 0};
+        while (sigtimedwait(&set, nullptr, &now) == SIGINT) {
+        }
+    }
+
+    // 等待下一个事件，with_input 为 true 时同时等待标准输入，timeout_ms 为负数时一直等待
+    // 同时发生的事件中 Ctrl-C 优先，其次是定时器，然后是子进程和输入
+    auto wait(bool with_input, int timeout_ms) -> Event {
+        if (with_input != is_input_watched && !is_input_closed && !is_input_file) {
+            if (watch(STDIN_FILENO, with_input ? EPOLL_CTL_ADD : EPOLL_CTL_DEL) || !with_input) {
+                is_input_watched = with_input;
+            } else {
+                // 普通文件不能加入 epoll（EPERM），总是可读
+                is_input_file = true;
+            }
+        }
+
+        auto always_readable = with_input && is_input_file && !is_input_closed;
+        epoll_event ready[3];
+        auto n = epoll_wait(epoll_fd, ready, 3, always_readable ? 0 : timeout_ms);
+        if (n < 0) {
+            return errno == EINTR ? Event::signal : Event::idle;
+        }
+        auto child = false;
+        auto interrupted = false;
+        auto expired = false;
+        auto readable = false;
+        for (auto i = 0; i < n; ++i) {
+            if (ready[i].data.fd == signal_fd) {
+                // 合并的 SIGCHLD 只读到一次，调用者要用 WNOHANG 把所有状态变化都取完
+                signalfd_siginfo info;
+                while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    (info.ssi_signo == SIGINT ? interrupted : child) = true;
+                }
+            } else if (ready[i].data.fd == timer_fd) {
+                uint64_t expirations;
+                expired = read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations);
+            } else {
+                readable = true;
+            }
+        }
+        if (interrupted) {
+            return Event::interrupt;
+        }
+        if (expired) {
+            return Event::timer;
+        }
+        if (child) {
+            return Event::child;
+        }
+        return readable || always_readable ? Event::input : Event::idle;
+    }
+
+    // ms 毫秒后产生一次 timer 事件
+    auto arm_timer(int ms) -> void {
+        itimerspec spec{{0, 0}, {ms / 1000, (ms % 1000) * 1000000L}};
+        timerfd_settime(timer_fd, 0, &spec, nullptr);
+    }
+
+    auto disarm_timer() -> void {
+        itimerspec spec{};
+        timerfd_settime(timer_fd, 0, &spec, nullptr);
+        uint64_t expirations;
+        while (read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+        }
+    }
+
+public:
+    // 标准输入可读时读一次，读到 EOF 后不再等待标准输入
+    auto read_input() -> void {
+        char buf[4096];
+        auto n = read(STDIN_FILENO, buf, sizeof(buf));
+        if (n > 0) {
+            input.append(buf, static_cast<std::size_t>(n));
+        } else if (n == 0 || (errno != EINTR && errno != EAGAIN)) {
+            is_input_closed = true;
+            if (is_input_watched) {
+                watch(STDIN_FILENO, EPOLL_CTL_DEL);
+                is_input_watched = false;
+            }
+        }
+    }
+
+    // 取出已经读到的一行，不含换行符；EOF 之前没有换行的最后一行也会取出
+    auto take_line(std::string& line) -> bool {
+        auto end = input.find('\n');
+        if (end == std::string::npos) {
+            if (!is_input_closed || input.empty()) {
+                return false;
+            }
+            end = input.size();
+        }
+        line = input.substr(0, end);
+        input.erase(0, end + 1);
+        return true;
+    }
+
+    // 标准输入已经结束，并且读到的内容都已经取完
+    auto input_closed() const -> bool {
+        return is_input_closed && input.empty();
+    }
+
+private:
+    auto watch(int fd, int op) -> bool {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        return epoll_ctl(epoll_fd, op, fd, &event) == 0;
+    }
+
+private:
+    int epoll_fd;
+    int signal_fd;
+    int timer_fd;
+    // 标准输入是否在 epoll 中
+    bool is_input_watched;
+    // 标准输入被重定向为普通文件
+    bool is_input_file;
+    bool is_input_closed;
+    // 读到但还没有取走的输入
+    std::string input;
+};
+
+}
@@ -0,0 +1,412 @@
+#pragma once
+
+/**
+ * 快速跟踪点：跟踪点处的指令换成 5 字节的 jmp，跳到蹦床中保存寄存器、调用 agent 写入共享内存，然后执行被换掉的指令再跳回来
+ * tracee 命中时不停下，调试器在停下时或者用户查看时从共享内存中读出记录
+ * 本类负责共享内存、跟踪点的记录和蹦床代码的生成；分配蹦床页、读写 tracee 内存由 Inferior 完成
+ */
+
+#include <trace_ring.hh>
+#include <x86_decoder.hh>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <limits>
+#include <initializer_list>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace BitTech {
+
+class FastTracer {
+public:
+    // 跳转指令的长度，被换掉的指令至少要有这么长
+    static const std::size_t jump_size = 5;
+    // 每个蹦床占用的字节数，一页放 32 个
+    static const std::size_t slot_size = 128;
+    static const std::intptr_t page_size = 4096;
+    // 最多保留的最近记录数
+    static const std::size_t recent_limit = 4096;
+
+    struct Site {
+        // 跟踪点的链接地址
+        std::intptr_t addr;
+        std::string location;
+        std::vector<uint8_t> regs;
+        // 本次运行中已经尝试过安装，失败的不再重试
+        bool attempted;
+        // 本次运行中已经安装了跳转
+        bool installed;
+        // 被换掉的原来的指令
+        std::vector<uint8_t> original;
+    };
+
+    // 生成好的蹦床
+    struct Trampoline {
+        std::vector<uint8_t> code;
+        // 被换掉的指令的总长度
+        std::size_t covered;
+        // 被换掉的指令条数
+        std::size_t instructions;
+    };
+
+public:
+    FastTracer(): fd{-1}, header{nullptr}, sites{}, pages{}, free_slots{}, recent{}, drained{0}, is_prepared{false} {}
+
+    ~FastTracer() {
+        if (header != nullptr) {
+            munmap(header, TraceRing::size());
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    FastTracer(FastTracer const&) = delete;
+    auto operator=(FastTracer const&) -> FastTracer& = delete;
+
+public:
+    // 加入跟踪点，返回编号
+    auto add(std::intptr_t addr, std::string const& location, std::vector<uint8_t> const& regs) -> int {
+        for (std::size_t i = 0; i < sites.size(); ++i) {
+            if (sites[i].addr == addr) {
+                return static_cast<int>(i);
+            }
+        }
+        if (sites.size() >= TraceRing::max_sites) {
+            return -1;
+        }
+        sites.push_back(Site{addr, location, regs, false, false, {}});
+        if (header != nullptr) {
+            write_site(sites.size() - 1);
+        }
+        return static_cast<int>(sites.size() - 1);
+    }
+
+    auto active() const -> bool {
+        return !sites.empty();
+    }
+
+    auto all() -> std::vector<Site>& {
+        return sites;
+    }
+
+    // link_addr 落在某个已经安装的跟踪点被换掉的指令中间，那里不能再写入断点
+    auto covers(std::intptr_t link_addr) const -> bool {
+        for (auto const& site : sites) {
+            if (site.installed && link_addr > site.addr
+                && link_addr < site.addr + static_cast<std::intptr_t>(site.original.size())) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 停止跟踪后丢掉所有跟踪点和记录
+    auto clear() -> void {
+        sites.clear();
+        recent.clear();
+        drained = 0;
+        if (header != nullptr) {
+            for (auto& site : header->sites) {
+                site = TraceRing::Site{};
+            }
+        }
+    }
+
+public:
+    // 启动 tracee 之前建立共享内存，tracee 通过继承的 fd 映射它，返回 fd，失败时返回 -1
+    // 每次运行重新开始记录，命中次数保留
+    auto prepare_run() -> int {
+        is_prepared = false;
+        if (header == nullptr && !create()) {
+            return -1;
+        }
+        __atomic_store_n(&header->ready, 0, __ATOMIC_RELEASE);
+        header->hit_function = 0;
+        header->agent_pid = 0;
+        header->head = 0;
+        header->tail = 0;
+        header->dropped = 0;
+        memset(TraceRing::records(header), 0, TraceRing::capacity * sizeof(TraceRing::Record));
+        is_prepared = true;
+        return fd;
+    }
+
+    // 这次运行的 tracee 预加载了 agent
+    auto prepared() const -> bool {
+        return is_prepared;
+    }
+
+    auto descriptor() const -> int {
+        return fd;
+    }
+
+    // agent 已经加载，可以安装蹦床
+    auto agent_ready() const -> bool {
+        return is_prepared && header != nullptr && __atomic_load_n(&header->ready, __ATOMIC_ACQUIRE) != 0;
+    }
+
+    // agent 加载后发出的 SIGTRAP 通知，每次运行只处理一次，处理过之后返回 false
+    auto take_handshake() -> bool {
+        uint32_t expected = 1;
+        return is_prepared && header != nullptr
+            && __atomic_compare_exchange_n(&header->ready, &expected, 2, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    }
+
+    // agent 已经加载，还有跟踪点没有安装
+    auto pending() const -> bool {
+        return agent_ready() && std::any_of(sites.begin(), sites.end(), [](Site const& site) { return !site.attempted; });
+    }
+
+    // tracee 结束后蹦床页和跳转都随着进程消失
+    auto reset() -> void {
+        for (auto& site : sites) {
+            site.attempted = false;
+            site.installed = false;
+            site.original.clear();
+        }
+        pages.clear();
+        free_slots.clear();
+        is_prepared = false;
+    }
+
+    // agent 的路径：环境变量 BDB_AGENT，否则是调试器所在目录下的 agent/libbdbagent.so
+    static auto agent_path() -> std::string {
+        auto env = getenv("BDB_AGENT");
+        if (env != nullptr) {
+            return env;
+        }
+        char exe[PATH_MAX];
+        auto len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+        if (len <= 0) {
+            return {};
+        }
+        std::string dir{exe, static_cast<std::size_t>(len)};
+        return dir.substr(0, dir.rfind('/')) + "/agent/libbdbagent.so";
+    }
+
+public:
+    // 找一个离 addr 足够近（rel32 能跳到）的空闲蹦床槽位，没有时返回 0，由调用者映射新的蹦床页
+    auto take_slot(std::intptr_t addr) -> std::intptr_t {
+        for (auto it = free_slots.begin(); it != free_slots.end(); ++it) {
+            if (reachable(addr, *it)) {
+                auto slot = *it;
+                free_slots.erase(it);
+                return slot;
+            }
+        }
+        for (auto& page : pages) {
+            if (page.used < static_cast<std::size_t>(page_size) / slot_size && reachable(addr, page.base)) {
+                return page.base + static_cast<std::intptr_t>(page.used++ * slot_size);
+            }
+        }
+        return 0;
+    }
+
+    // 跟踪点没有装上，归还 take_slot 取得的槽位
+    auto release_slot(std::intptr_t slot) -> void {
+        free_slots.push_back(slot);
+    }
+
+    auto add_page(std::intptr_t base) -> void {
+        pages.push_back(Page{base, 0});
+    }
+
+    static auto reachable(std::intptr_t from, std::intptr_t to) -> bool {
+        auto distance = to - from;
+        return distance > std::numeric_limits<int32_t>::min() / 2 && distance < std::numeric_limits<int32_t>::max() / 2;
+    }
+
+    // 为 addr 处的跟踪点生成放在 slot 处的蹦床，code 是 addr 处原来的指令
+    // 被换掉的指令只能是顺序执行的指令，RIP 相对寻址的位移按蹦床的位置调整；不能换掉时返回 false
+    // 换掉多条指令时，后面几条指令的开头不能是跳转目标，由调用者检查
+    auto build(int id, std::intptr_t addr, std::intptr_t slot, uint8_t const *code, std::size_t size,
+        Trampoline& trampoline, std::string& reason) const -> bool {
+        auto& out = trampoline.code;
+        out.clear();
+        // lea rsp, [rsp - 128]; pushfq; push rax, rcx, rdx, rbx, rbp, rsi, rdi, r8 ~ r15
+        emit(out, {0x48, 0x8D, 0x64, 0x24, 0x80, 0x9C, 0x50, 0x51, 0x52, 0x53, 0x55, 0x56, 0x57});
+        for (uint8_t r = 0; r < 8; ++r) {
+            emit(out, {0x41, static_cast<uint8_t>(0x50 + r)});
+        }
+        // mov rdi, rsp; mov esi, id; mov rbx, rsp; and rsp, -16; mov rax, hit; call rax; mov rsp, rbx
+        emit(out, {0x48, 0x89, 0xE7, 0xBE});
+        emit_value(out, static_cast<uint32_t>(id));
+        emit(out, {0x48, 0x89, 0xE3, 0x48, 0x83, 0xE4, 0xF0, 0x48, 0xB8});
+        emit_value(out, header->hit_function);
+        emit(out, {0xFF, 0xD0, 0x48, 0x89, 0xDC});
+        // pop r15 ~ r8, rdi, rsi, rbp, rbx, rdx, rcx, rax; popfq; lea rsp, [rsp + 128]
+        for (uint8_t r = 8; r > 0; --r) {
+            emit(out, {0x41, static_cast<uint8_t>(0x58 + r - 1)});
+        }
+        emit(out, {0x5F, 0x5E, 0x5D, 0x5B, 0x5A, 0x59, 0x58, 0x9D, 0x48, 0x8D, 0xA4, 0x24, 0x80, 0x00, 0x00, 0x00});
+
+        // 复制被换掉的指令
+        std::size_t covered = 0;
+        std::size_t instructions = 0;
+        while (covered < jump_size) {
+            X86Decoder::Instruction insn;
+            if (!X86Decoder::decode(code + covered, size - covered, addr + covered, insn)) {
+                reason = "无法解码指令";
+                return false;
+            }
+            if (insn.flow != X86Decoder::Flow::sequential) {
+                reason = "前 5 个字节中有跳转、调用或者返回指令";
+                return false;
+            }
+            auto at = out.size();
+            out.insert(out.end(), code + covered, code + covered + insn.length);
+            if (insn.disp_offset >= 0) {
+                int32_t disp;
+                memcpy(&disp, out.data() + at + insn.disp_offset, sizeof(disp));
+                auto moved = static_cast<int64_t>(disp) + (addr + static_cast<std::intptr_t>(covered))
+                    - (slot + static_cast<std::intptr_t>(at));
+                if (moved < std::numeric_limits<int32_t>::min() || moved > std::numeric_limits<int32_t>::max()) {
+                    reason = "RIP 相对寻址的位移超出范围";
+                    return false;
+                }
+                disp = static_cast<int32_t>(moved);
+                memcpy(out.data() + at + insn.disp_offset, &disp, sizeof(disp));
+            }
+            covered += insn.length;
+            ++instructions;
+        }
+
+        // jmp 回到被换掉的指令之后
+        auto back = static_cast<int32_t>(addr + static_cast<std::intptr_t>(covered)
+            - (slot + static_cast<std::intptr_t>(out.size() + jump_size)));
+        out.push_back(0xE9);
+        emit_value(out, back);
+        if (out.size() > slot_size) {
+            reason = "蹦床超出了槽位";
+            return false;
+        }
+        trampoline.covered = covered;
+        trampoline.instructions = instructions;
+        return true;
+    }
+
+    // 跟踪点处的 jmp，被换掉的多余字节用 nop 填充
+    static auto jump(std::intptr_t addr, std::intptr_t slot, std::size_t covered) -> std::vector<uint8_t> {
+        std::vector<uint8_t> code{0xE9};
+        emit_value(code, static_cast<int32_t>(slot - (addr + static_cast<std::intptr_t>(jump_size))));
+        code.resize(covered, 0x90);
+        return code;
+    }
+
+public:
+    // 读出所有已经提交的记录，返回读到的条数
+    auto drain() -> std::size_t {
+        if (header == nullptr || !is_prepared) {
+            return 0;
+        }
+        auto records = TraceRing::records(header);
+        auto tail = __atomic_load_n(&header->tail, __ATOMIC_RELAXED);
+        std::size_t count = 0;
+        while (true) {
+            auto const& record = records[tail & (TraceRing::capacity - 1)];
+            if (__atomic_load_n(&record.seq, __ATOMIC_ACQUIRE) != tail + 1) {
+                break;
+            }
+            recent.push_back(record);
+            if (recent.size() > recent_limit) {
+                recent.pop_front();
+            }
+            ++tail;
+            ++count;
+            // 及时让出位置，agent 才不会因为缓冲区满而丢弃记录
+            __atomic_store_n(&header->tail, tail, __ATOMIC_RELEASE);
+        }
+        drained += count;
+        return count;
+    }
+
+    auto hits(int id) const -> uint64_t {
+        return header == nullptr ? 0 : __atomic_load_n(&header->sites[id].hits, __ATOMIC_RELAXED);
+    }
+
+    auto dropped() const -> uint64_t {
+        return header == nullptr ? 0 : __atomic_load_n(&header->dropped, __ATOMIC_RELAXED);
+    }
+
+    auto drained_count() const -> uint64_t {
+        return drained;
+    }
+
+    auto recent_records() const -> std::deque<TraceRing::Record> const& {
+        return recent;
+    }
+
+private:
+    struct Page {
+        std::intptr_t base;
+        std::size_t used;
+    };
+
+    // memfd 不设置 close-on-exec，tracee 在 execv 之后还能拿到它
+    auto create() -> bool {
+        fd = static_cast<int>(syscall(SYS_memfd_create, "bdb-trace", 0));
+        if (fd < 0) {
+            return false;
+        }
+        if (ftruncate(fd, TraceRing::size()) != 0) {
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        auto mapped = mmap(nullptr, TraceRing::size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        header = static_cast<TraceRing::Header *>(mapped);
+        header->magic = TraceRing::magic;
+        for (std::size_t i = 0; i < sites.size(); ++i) {
+            write_site(i);
+        }
+        return true;
+    }
+
+    auto write_site(std::size_t id) -> void {
+        auto& site = header->sites[id];
+        site.reg_count = static_cast<uint8_t>(std::min<std::size_t>(sites[id].regs.size(), TraceRing::max_regs));
+        for (uint8_t i = 0; i < site.reg_count; ++i) {
+            site.regs[i] = sites[id].regs[i];
+        }
+    }
+
+    static auto emit(std::vector<uint8_t>& out, std::initializer_list<uint8_t> bytes) -> void {
+        out.insert(out.end(), bytes.begin(), bytes.end());
+    }
+
+    template <typename T>
+    static auto emit_value(std::vector<uint8_t>& out, T value) -> void {
+        uint8_t bytes[sizeof(T)];
+        memcpy(bytes, &value, sizeof(T));
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+private:
+    int fd;
+    TraceRing::Header *header;
+    std::vector<Site> sites;
+    // 本次运行中映射的蹦床页
+    std::vector<Page> pages;
+    // 安装失败后归还的槽位
+    std::vector<std::intptr_t> free_slots;
+    // 最近读出的记录
+    std::deque<TraceRing::Record> recent;
+    uint64_t drained;
+    bool is_prepared;
+};
+
+}
@@ -0,0 +1,249 @@
+#pragma once
+
+/**
+ * 地址到函数的区间索引
+ * 遍历一个编译单元，收集函数（subprogram）以及内联展开（inlined_subroutine）的地址区间，
+ * 展平成按地址排序、互不重叠的区间表，之后按地址查找函数只需要一次二分
+ * 区间表中只记录 DIE 的偏移，可以原样写入索引缓存文件，也可以直接使用缓存文件中的数据
+ */
+
+#include <column.hh>
+#include <die_by_offset.hh>
+#include <dwarf/dwarf++.hh>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+
+namespace BitTech {
+
+class FunctionIndex {
+public:
+    FunctionIndex(): unit{nullptr} {}
+    explicit FunctionIndex(dwarf::compilation_unit const& cu): unit{&cu} {
+        collect(cu.root(), 0, -1);
+        flatten();
+    }
+
+    // 使用已经建好的区间表，例如来自索引缓存文件
+    FunctionIndex(dwarf::compilation_unit const& cu, Column<std::intptr_t> lows, Column<std::intptr_t> highs,
+        Column<dwarf::section_offset> funcs, Column<dwarf::section_offset> inlines)
+        : unit{&cu}, lows(std::move(lows)), highs(std::move(highs)),
+          funcs(std::move(funcs)), inlines(std::move(inlines)) {}
+
+public:
+    // 返回 addr 所在的函数 DIE，找不到返回 nullptr
+    auto find(std::intptr_t addr) const -> dwarf::die const * {
+        auto i = find_segment(addr);
+        if (i < 0) {
+            return nullptr;
+        }
+        return die_at(funcs[i]);
+    }
+
+    // 返回 addr 处最内层的内联展开 DIE，不在内联展开中返回 nullptr
+    auto find_inlined(std::intptr_t addr) const -> dwarf::die const * {
+        auto i = find_segment(addr);
+        if (i < 0 || inlines[i] == no_inline) {
+            return nullptr;
+        }
+        return die_at(inlines[i]);
+    }
+
+    // [low, high) 中所有内联展开的地址区间
+    auto inlined_ranges(std::intptr_t low, std::intptr_t high) const -> std::vector<std::pair<std::intptr_t, std::intptr_t>> {
+        std::vector<std::pair<std::intptr_t, std::intptr_t>> ranges{};
+        auto i = static_cast<std::size_t>(std::lower_bound(highs.begin(), highs.end(), low + 1) - highs.begin());
+        for (; i < lows.size() && lows[i] < high; ++i) {
+            if (inlines[i] == no_inline) {
+                continue;
+            }
+            auto begin = std::max(lows[i], low);
+            auto end = std::min(highs[i], high);
+            // 相邻的内联区间合并
+            if (!ranges.empty() && ranges.back().second == begin) {
+                ranges.back().second = end;
+            } else {
+                ranges.push_back({begin, end});
+            }
+        }
+        return ranges;
+    }
+
+    // 区间表的段数
+    auto size() const -> std::size_t {
+        return lows.size();
+    }
+
+private:
+    friend class IndexCache;
+
+    // 不在内联展开中的段
+    enum : dwarf::section_offset { no_inline = 0 };
+
+    // 收集阶段使用的原始区间，区间之间可能互相嵌套
+    struct Interval {
+        std::intptr_t low;
+        std::intptr_t high;
+        int depth;
+        int func;
+        int inline_func;
+    };
+
+    static auto has_pc(dwarf::die const& die) -> bool {
+        return die.has(dwarf::DW_AT::low_pc) || die.has(dwarf::DW_AT::ranges);
+    }
+
+    // 递归收集 die 之下所有带地址的函数和内联展开
+    // owner 是当前所在的函数在 functions 中的下标
+    auto collect(dwarf::die const& die, int depth, int owner) -> void {
+        for (auto const& child : die) {
+            switch (child.tag) {
+            case dwarf::DW_TAG::subprogram:
+                // 只有声明或者抽象实例的函数没有地址，跳过
+                if (has_pc(child)) {
+                    functions.push_back(child);
+                    auto func = static_cast<int>(functions.size() - 1);
+                    add_ranges(child, depth, func, -1);
+                    collect(child, depth + 1, func);
+                }
+                break;
+            case dwarf::DW_TAG::inlined_subroutine:
+                if (owner >= 0 && has_pc(child)) {
+                    inlined.push_back(child);
+                    add_ranges(child, depth, owner, static_cast<int>(inlined.size() - 1));
+                }
+                collect(child, depth + 1, owner);
+                break;
+            case dwarf::DW_TAG::lexical_block:
+            case dwarf::DW_TAG::namespace_:
+            case dwarf::DW_TAG::class_type:
+            case dwarf::DW_TAG::structure_type:
+            case dwarf::DW_TAG::union_type:
+                collect(child, depth + 1, owner);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // DW_AT_ranges 描述的不连续区间，每一段都单独加入
+    auto add_ranges(dwarf::die const& die, int depth, int func, int inline_func) -> void {
+        for (auto const& range : dwarf::die_pc_range(die)) {
+            if (range.low < range.high) {
+                intervals.push_back(Interval{
+                    static_cast<std::intptr_t>(range.low),
+                    static_cast<std::intptr_t>(range.high),
+                    depth, func, inline_func});
+            }
+        }
+    }
+
+    // 扫描线展平嵌套区间，每一段地址归属于覆盖它的最内层区间
+    auto flatten() -> void {
+        std::vector<std::intptr_t> seg_lows{};
+        std::vector<std::intptr_t> seg_highs{};
+        std::vector<dwarf::section_offset> seg_funcs{};
+        std::vector<dwarf::section_offset> seg_inlines{};
+
+        // 区间起点记为 (addr, 1, i)，终点记为 (addr, 0, i)，同一地址先处理终点
+        std::vector<std::pair<std::intptr_t, std::pair<int, int>>> events{};
+        events.reserve(intervals.size() * 2);
+        for (auto i = 0u; i < intervals.size(); ++i) {
+            events.push_back({intervals[i].low, {1, static_cast<int>(i)}});
+            events.push_back({intervals[i].high, {0, static_cast<int>(i)}});
+        }
+        std::sort(events.begin(), events.end());
+
+        // 按 (depth, 下标) 排序，最内层的区间在最后
+        std::set<std::pair<int, int>> active{};
+        for (auto e = 0u; e < events.size(); ++e) {
+            auto const& interval = intervals[events[e].second.second];
+            if (events[e].second.first == 1) {
+                active.insert({interval.depth, events[e].second.second});
+            } else {
+                active.erase({interval.depth, events[e].second.second});
+            }
+
+            if (active.empty() || e + 1 == events.size() || events[e + 1].first == events[e].first) {
+                continue;
+            }
+
+            auto const& top = intervals[active.rbegin()->second];
+            auto low = events[e].first;
+            auto high = events[e + 1].first;
+            auto func = functions[top.func].get_section_offset();
+            auto inline_func = top.inline_func < 0 ? no_inline : inlined[top.inline_func].get_section_offset();
+            // 和前一段首尾相接且归属相同，直接合并
+            if (!seg_lows.empty() && seg_highs.back() == low
+                && seg_funcs.back() == func && seg_inlines.back() == inline_func) {
+                seg_highs.back() = high;
+                continue;
+            }
+            seg_lows.push_back(low);
+            seg_highs.push_back(high);
+            seg_funcs.push_back(func);
+            seg_inlines.push_back(inline_func);
+        }
+
+        lows = Column<std::intptr_t>{std::move(seg_lows)};
+        highs = Column<std::intptr_t>{std::move(seg_highs)};
+        funcs = Column<dwarf::section_offset>{std::move(seg_funcs)};
+        inlines = Column<dwarf::section_offset>{std::move(seg_inlines)};
+
+        // 收集到的 DIE 直接放进缓存，原始区间只在构建时使用
+        for (auto const& die : functions) {
+            dies[die.get_section_offset()] = die;
+        }
+        for (auto const& die : inlined) {
+            dies[die.get_section_offset()] = die;
+        }
+        std::vector<dwarf::die>{}.swap(functions);
+        std::vector<dwarf::die>{}.swap(inlined);
+        std::vector<Interval>{}.swap(intervals);
+    }
+
+    // 按偏移取得 DIE，第一次访问时从编译单元中找回
+    auto die_at(dwarf::section_offset offset) const -> dwarf::die const * {
+        auto it = dies.find(offset);
+        if (it == dies.end()) {
+            it = dies.insert({offset, find_die_by_offset(unit->root(), offset)}).first;
+        }
+        return it->second.valid() ? &it->second : nullptr;
+    }
+
+    auto find_segment(std::intptr_t addr) const -> int {
+        auto it = std::upper_bound(lows.begin(), lows.end(), addr);
+        if (it == lows.begin()) {
+            return -1;
+        }
+        auto i = static_cast<int>(it - lows.begin()) - 1;
+        return addr < highs[i] ? i : -1;
+    }
+
+private:
+    dwarf::compilation_unit const *unit;
+
+private:
+    // 收集阶段使用：所有带地址的函数和内联展开的 DIE，以及它们的原始区间
+    std::vector<dwarf::die> functions;
+    std::vector<dwarf::die> inlined;
+    std::vector<Interval> intervals;
+
+private:
+    // 展平后的区间表，分成几个数组存放，二分时只访问 lows
+    // funcs/inlines 是函数和内联展开 DIE 的偏移
+    Column<std::intptr_t> lows;
+    Column<std::intptr_t> highs;
+    Column<dwarf::section_offset> funcs;
+    Column<dwarf::section_offset> inlines;
+
+private:
+    // 已经取回的 DIE，只是缓存，所以在 const 成员函数中也可以更新
+    mutable std::unordered_map<dwarf::section_offset, dwarf::die> dies;
+};
+
+}
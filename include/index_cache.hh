@@ -0,0 +1,450 @@
+#pragma once
+
+/**
+ * 调试信息索引的磁盘缓存
+ * 把每个编译单元的函数区间表、行表以及编译单元的地址表按列写进一个文件，
+ * 以程序的 NT_GNU_BUILD_ID 为键（没有 build-id 时用路径、文件大小和修改时间），
+ * 之后启动时直接 mmap 这个文件，索引的各列指向映射的内存，不需要解析也不需要复制
+ *
+ * 文件布局（所有数组按 8 字节对齐）：
+ *   Header | 键 | UnitRange[range_count] | UnitEntry[unit_count] | 各编译单元的列 | 字符串表
+ */
+
+#include <column.hh>
+#include <function_index.hh>
+#include <line_index.hh>
+#include <dwarf/dwarf++.hh>
+#include <elf/elf++.hh>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+
+namespace BitTech {
+
+class IndexCache {
+public:
+    // 编译单元的一段地址区间 [low, high)，unit 是编译单元的下标
+    struct UnitRange {
+        std::intptr_t low;
+        std::intptr_t high;
+        uint64_t unit;
+    };
+
+    // 缓存格式变化时增加，旧版本的缓存文件会被忽略并重新生成
+    static const uint32_t version = 1;
+
+public:
+    IndexCache(IndexCache const&) = delete;
+    auto operator=(IndexCache const&) -> IndexCache& = delete;
+
+    ~IndexCache() {
+        munmap(const_cast<char *>(base), size);
+    }
+
+public:
+    // 程序的缓存键，优先使用 build-id
+    static auto key_of(std::string const& program, elf::elf const& elf) -> std::string {
+        auto build_id = read_build_id(elf);
+        if (!build_id.empty()) {
+            return "build-id-" + build_id;
+        }
+
+        struct stat st;
+        if (stat(program.c_str(), &st) != 0) {
+            return "";
+        }
+        char resolved[PATH_MAX];
+        std::string path = realpath(program.c_str(), resolved) == nullptr ? program : resolved;
+
+        char key[128];
+        snprintf(key, sizeof(key), "file-%016lx-%ld-%ld.%09ld", fnv1a(path),
+            static_cast<long>(st.st_size), static_cast<long>(st.st_mtim.tv_sec), static_cast<long>(st.st_mtim.tv_nsec));
+        return key;
+    }
+
+    // 缓存文件的路径：$XDG_CACHE_HOME/bdb 或者 ~/.cache/bdb，两者都没有时返回空字符串
+    static auto path_of(std::string const& key) -> std::string {
+        if (key.empty()) {
+            return "";
+        }
+
+        std::string dir{};
+        auto xdg = getenv("XDG_CACHE_HOME");
+        auto home = getenv("HOME");
+        if (xdg != nullptr && xdg[0] != '\0') {
+            dir = xdg;
+        } else if (home != nullptr && home[0] != '\0') {
+            dir = std::string{home} + "/.cache";
+        } else {
+            return "";
+        }
+        return dir + "/bdb/" + key + ".idx";
+    }
+
+    // 映射缓存文件，文件不存在、键不匹配或者内容不完整时返回 nullptr
+    static auto open(std::string const& path, std::string const& key) -> std::shared_ptr<IndexCache const> {
+        if (path.empty()) {
+            return nullptr;
+        }
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(Header)) {
+            close(fd);
+            return nullptr;
+        }
+        auto size = static_cast<std::size_t>(st.st_size);
+        auto base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            return nullptr;
+        }
+
+        std::shared_ptr<IndexCache const> cache{new IndexCache{static_cast<char const *>(base), size}};
+        if (!cache->validate(key)) {
+            return nullptr;
+        }
+        return cache;
+    }
+
+    // 把所有编译单元的索引写入 path，先写临时文件再改名，多个进程同时写也不会留下不完整的文件
+    static auto write(std::string const& path, std::string const& key, std::vector<UnitRange> const& ranges,
+        std::vector<dwarf::section_offset> const& cu_offsets,
+        std::vector<FunctionIndex const *> const& functions, std::vector<LineIndex const *> const& lines) -> bool {
+        if (path.empty() || !make_parent_dirs(path)) {
+            return false;
+        }
+
+        std::string out(sizeof(Header), '\0');
+        std::string strings{};
+        Header header{};
+        memcpy(header.magic, magic(), sizeof(header.magic));
+        header.version = version;
+        header.key_size = static_cast<uint32_t>(key.size());
+        header.unit_count = cu_offsets.size();
+        header.range_count = ranges.size();
+
+        out.append(key);
+        align(out);
+        header.ranges_offset = out.size();
+        append(out, ranges.data(), ranges.size());
+
+        // 各编译单元的列写在 UnitEntry 数组之后，先占位，最后回填
+        header.units_offset = out.size();
+        std::vector<UnitEntry> entries(cu_offsets.size());
+        append(out, entries.data(), entries.size());
+
+        for (auto i = 0u; i < cu_offsets.size(); ++i) {
+            auto& entry = entries[i];
+            auto const& f = *functions[i];
+            auto const& l = *lines[i];
+            entry.cu_offset = cu_offsets[i];
+
+            entry.segment_count = f.lows.size();
+            entry.segments_offset = out.size();
+            append(out, f.lows.data(), f.lows.size());
+            append(out, f.highs.data(), f.highs.size());
+            append(out, f.funcs.data(), f.funcs.size());
+            append(out, f.inlines.data(), f.inlines.size());
+
+            entry.row_count = l.addresses.size();
+            entry.rows_offset = out.size();
+            append(out, l.addresses.data(), l.addresses.size());
+            append(out, l.file_ids.data(), l.file_ids.size());
+            append(out, l.lines.data(), l.lines.size());
+            append(out, l.flags.data(), l.flags.size());
+            align(out);
+
+            std::vector<uint64_t> file_offsets{};
+            for (auto const& file : l.files) {
+                file_offsets.push_back(strings.size());
+                strings.append(file.c_str(), file.size() + 1);
+            }
+            entry.file_count = file_offsets.size();
+            entry.files_offset = out.size();
+            append(out, file_offsets.data(), file_offsets.size());
+        }
+
+        header.strings_offset = out.size();
+        header.strings_size = strings.size();
+        out.append(strings);
+        header.file_size = out.size();
+
+        memcpy(&out[0], &header, sizeof(header));
+        memcpy(&out[header.units_offset], entries.data(), entries.size() * sizeof(UnitEntry));
+
+        auto tmp = path + ".tmp." + std::to_string(getpid());
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        std::size_t written = 0;
+        while (written < out.size()) {
+            auto n = ::write(fd, out.data() + written, out.size() - written);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            written += n;
+        }
+        close(fd);
+        if (written != out.size() || rename(tmp.c_str(), path.c_str()) != 0) {
+            unlink(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+public:
+    auto unit_count() const -> std::size_t {
+        return header().unit_count;
+    }
+
+    auto cu_offset(std::size_t unit) const -> dwarf::section_offset {
+        return entry(unit).cu_offset;
+    }
+
+    // 编译单元的地址表，按 low 排序
+    auto ranges() const -> Column<UnitRange> {
+        return Column<UnitRange>{at<UnitRange>(header().ranges_offset), header().range_count};
+    }
+
+    // 编译单元的函数区间指向的 DIE 都在 [begin, end) 中，即这个编译单元在 .debug_info 中的范围
+    // DIE 的偏移只能和 dwarf 对照检查，由 DwarfIndex 在使用缓存之前调用
+    auto dies_within(std::size_t unit, dwarf::section_offset begin, dwarf::section_offset end) const -> bool {
+        auto const& e = entry(unit);
+        auto n = e.segment_count;
+        auto funcs = reinterpret_cast<dwarf::section_offset const *>(at<std::intptr_t>(e.segments_offset) + 2 * n);
+        auto inlines = funcs + n;
+        for (auto s = 0u; s < n; ++s) {
+            if (funcs[s] <= begin || funcs[s] >= end
+                || (inlines[s] != FunctionIndex::no_inline && (inlines[s] <= begin || inlines[s] >= end))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 直接使用映射内存的函数区间表
+    auto functions(std::size_t unit, dwarf::compilation_unit const& cu) const -> FunctionIndex {
+        auto const& e = entry(unit);
+        auto n = e.segment_count;
+        auto lows = at<std::intptr_t>(e.segments_offset);
+        auto highs = lows + n;
+        auto funcs = reinterpret_cast<dwarf::section_offset const *>(highs + n);
+        auto inlines = funcs + n;
+        return FunctionIndex{cu,
+            Column<std::intptr_t>{lows, n}, Column<std::intptr_t>{highs, n},
+            Column<dwarf::section_offset>{funcs, n}, Column<dwarf::section_offset>{inlines, n}};
+    }
+
+    // 直接使用映射内存的扁平行表，只有文件名需要复制出来
+    auto lines(std::size_t unit) const -> LineIndex {
+        auto const& e = entry(unit);
+        auto n = e.row_count;
+        auto addresses = at<std::intptr_t>(e.rows_offset);
+        auto file_ids = reinterpret_cast<uint32_t const *>(addresses + n);
+        auto line_numbers = file_ids + n;
+        auto flags = reinterpret_cast<uint8_t const *>(line_numbers + n);
+
+        std::vector<std::string> files{};
+        auto offsets = at<uint64_t>(e.files_offset);
+        auto strings = base + header().strings_offset;
+        for (auto i = 0u; i < e.file_count; ++i) {
+            auto p = strings + offsets[i];
+            files.emplace_back(p, strnlen(p, header().strings_size - offsets[i]));
+        }
+
+        return LineIndex{Column<std::intptr_t>{addresses, n}, Column<uint32_t>{file_ids, n},
+            Column<uint32_t>{line_numbers, n}, Column<uint8_t>{flags, n}, std::move(files)};
+    }
+
+private:
+    // 文件开头的 8 个字节（不含结尾的 0）
+    static auto magic() -> char const * {
+        return "BDBINDEX";
+    }
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t key_size;
+        uint64_t file_size;
+        uint64_t unit_count;
+        uint64_t range_count;
+        uint64_t ranges_offset;
+        uint64_t units_offset;
+        uint64_t strings_offset;
+        uint64_t strings_size;
+    };
+
+    struct UnitEntry {
+        uint64_t cu_offset;
+        // lows/highs/funcs/inlines 四列依次存放，每列 segment_count 个 8 字节
+        uint64_t segment_count;
+        uint64_t segments_offset;
+        // addresses(8 字节)/file_ids(4 字节)/lines(4 字节)/flags(1 字节) 四列依次存放
+        uint64_t row_count;
+        uint64_t rows_offset;
+        // 文件名在字符串表中的偏移
+        uint64_t file_count;
+        uint64_t files_offset;
+    };
+
+    IndexCache(char const *base, std::size_t size): base{base}, size{size} {}
+
+    auto header() const -> Header const& {
+        return *reinterpret_cast<Header const *>(base);
+    }
+
+    auto entry(std::size_t unit) const -> UnitEntry const& {
+        return at<UnitEntry>(header().units_offset)[unit];
+    }
+
+    template <typename T>
+    auto at(uint64_t offset) const -> T const * {
+        return reinterpret_cast<T const *>(base + offset);
+    }
+
+    // 检查 [offset, offset + count * width) 是否在文件内并且按 8 字节对齐
+    auto contains(uint64_t offset, uint64_t count, uint64_t width) const -> bool {
+        return offset % 8 == 0 && offset <= size && count <= (size - offset) / width;
+    }
+
+    // 映射之后只检查一次所有的偏移，之后的访问不再检查
+    auto validate(std::string const& key) const -> bool {
+        auto const& h = header();
+        if (memcmp(h.magic, magic(), sizeof(h.magic)) != 0 || h.version != version || h.file_size != size
+            || h.key_size != key.size() || key.size() > size - sizeof(Header)
+            || memcmp(base + sizeof(Header), key.data(), key.size()) != 0) {
+            return false;
+        }
+        if (!contains(h.ranges_offset, h.range_count, sizeof(UnitRange))
+            || !contains(h.units_offset, h.unit_count, sizeof(UnitEntry))
+            || h.strings_offset > size || h.strings_size > size - h.strings_offset) {
+            return false;
+        }
+
+        for (auto i = 0u; i < h.range_count; ++i) {
+            if (at<UnitRange>(h.ranges_offset)[i].unit >= h.unit_count) {
+                return false;
+            }
+        }
+        for (auto i = 0u; i < h.unit_count; ++i) {
+            auto const& e = entry(i);
+            if (!contains(e.segments_offset, e.segment_count, 4 * 8)
+                || !contains(e.rows_offset, e.row_count, 8 + 4 + 4 + 1)
+                || !contains(e.files_offset, e.file_count, 8)) {
+                return false;
+            }
+            auto offsets = at<uint64_t>(e.files_offset);
+            for (auto f = 0u; f < e.file_count; ++f) {
+                if (offsets[f] >= h.strings_size) {
+                    return false;
+                }
+            }
+            // 行表中的文件编号用来直接索引文件名表
+            auto file_ids = reinterpret_cast<uint32_t const *>(at<std::intptr_t>(e.rows_offset) + e.row_count);
+            for (auto r = 0u; r < e.row_count; ++r) {
+                if (file_ids[r] >= e.file_count) {
+                    return false;
+                }
+            }
+            // 函数区间按 low 二分查找
+            auto lows = at<std::intptr_t>(e.segments_offset);
+            auto highs = lows + e.segment_count;
+            for (auto s = 0u; s < e.segment_count; ++s) {
+                if (lows[s] >= highs[s] || (s > 0 && lows[s - 1] > lows[s])) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // 从 .note.gnu.build-id 中读出 build-id 的十六进制表示，没有时返回空字符串
+    // 每个 note 的格式为 namesz, descsz, type, name（4 字节对齐）, desc（4 字节对齐）
+    static auto read_build_id(elf::elf const& elf) -> std::string {
+        static const uint32_t NT_GNU_BUILD_ID = 3;
+        for (auto const& section : elf.sections()) {
+            if (section.get_hdr().type != elf::sht::note) {
+                continue;
+            }
+            auto const *p = static_cast<uint8_t const *>(section.data());
+            auto const *end = p + section.size();
+            while (p + 12 <= end) {
+                uint32_t namesz, descsz, type;
+                memcpy(&namesz, p, 4);
+                memcpy(&descsz, p + 4, 4);
+                memcpy(&type, p + 8, 4);
+                auto const *name = p + 12;
+                auto const *desc = name + ((namesz + 3) & ~3u);
+                auto const *next = desc + ((descsz + 3) & ~3u);
+                if (next > end) {
+                    break;
+                }
+                if (type == NT_GNU_BUILD_ID && namesz == 4 && memcmp(name, "GNU", 4) == 0) {
+                    std::string hex{};
+                    char digits[3];
+                    for (auto i = 0u; i < descsz; ++i) {
+                        snprintf(digits, sizeof(digits), "%02x", desc[i]);
+                        hex += digits;
+                    }
+                    return hex;
+                }
+                p = next;
+            }
+        }
+        return "";
+    }
+
+    static auto fnv1a(std::string const& s) -> unsigned long {
+        uint64_t hash = 14695981039346656037ull;
+        for (auto c : s) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static auto make_parent_dirs(std::string const& path) -> bool {
+        for (auto pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1)) {
+            if (mkdir(path.substr(0, pos).c_str(), 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename T>
+    static auto append(std::string& out, T const *data, std::size_t count) -> void {
+        if (count > 0) {
+            out.append(reinterpret_cast<char const *>(data), count * sizeof(T));
+        }
+    }
+
+    static auto align(std::string& out) -> void {
+        out.resize((out.size() + 7) / 8 * 8, '\0');
+    }
+
+private:
+    char const *base;
+    std::size_t size;
+};
+
+}
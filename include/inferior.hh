@@ -7,20 +7,50 @@
 #include <exception.hh>
 #include <ptrace_proxy.hh>
 #include <breakpoint.hh>
+#include <breakpoint_batch.hh>
+#include <register_cache.hh>
+#include <debug_registers.hh>
+#include <page_watcher.hh>
+#include <thread.hh>
+#include <displaced_stepper.hh>
+#include <profiler.hh>
+#include <call_tracer.hh>
+#include <syscall_catcher.hh>
+#include <fast_tracer.hh>
+#include <tracepoints.hh>
+#include <event_loop.hh>
+#include <source_cache.hh>
+#include <unwinder.hh>
+#include <dwarf_index.hh>
+#include <name_index.hh>
+#include <stopwatch.hh>
+#include <x86_decoder.hh>
+#include <step_plan.hh>
 #include <elf/elf++.hh>
 #include <dwarf/dwarf++.hh>
 #include <string>
 #include <set>
 #include <unordered_map>
+#include <array>
+#include <limits>
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#include <cerrno>
 #include <sys/types.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <climits>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <fstream>
+#include <future>
+#include <atomic>
+#include <regex>
 
 
 namespace BitTech {
@@ -28,20 +58,56 @@ namespace BitTech {
 class Inferior {
 public:
     Inferior(std::string const& program)
-        : signo{0}, pid{-1}, is_running{false}, program{program}, 
-          breakpoint_addrs_to_set{}, breakpoints{} {
+        : load_times{0, 0, 0}, is_cache_cancelled{false},
+          breakpoint_addrs_to_set{}, user_breakpoints{}, breakpoints{}, step_plans{}, armed_plan{nullptr, 0, 0, 0, {}}, watched_values{},
+          threads{}, current_tid{-1}, is_pie{false}, link_base{0}, load_bias{0}, profiler{nullptr}, unwinder{}, call_tracer{}, syscall_catcher{}, fast_tracer{}, tracepoints{}, events{}, sources{},
+          is_running{false}, is_quiet{false}, is_watch_triggered{false}, is_single_stepping{false}, is_all_running{false}, is_focus_changed{false},
+          is_non_stop{false}, is_waiting_any{false}, is_attached{false}, is_background{false}, is_interrupted{false},
+          program{program}, pid{-1} {
+
+        Stopwatch stopwatch{};
+        // 函数名索引在后台建立，不阻塞提示符的出现
+        name_index = NameIndex{program};
 
         int fd = open(program.c_str(), O_RDONLY);
 
         elf::elf elf{elf::create_mmap_loader(fd)};
+        load_times.elf_ms = stopwatch.restart();
+
+        // 位置无关的可执行文件每次运行都装载到不同的地址，记下链接时最低的装载地址，运行时算出装载偏移
+        is_pie = elf.get_hdr().type == elf::et::dyn;
+        link_base = std::numeric_limits<std::intptr_t>::max();
+        for (auto const& segment : elf.segments()) {
+            if (segment.get_hdr().type == elf::pt::load) {
+                link_base = std::min(link_base, static_cast<std::intptr_t>(segment.get_hdr().vaddr));
+            }
+        }
+        link_base = link_base == std::numeric_limits<std::intptr_t>::max() ? 0 : PageWatcher::page_of(link_base);
         try {
             dwarf = dwarf::dwarf{dwarf::elf::create_loader(elf)};
         } catch (dwarf::format_error const& exc) {
             printf("** 没有找到程序的调试信息 **\n");
             dwarf = dwarf::dwarf{};
         }
+        load_times.dwarf_ms = stopwatch.restart();
+
+        // 有索引缓存时直接映射缓存文件
+        // 否则启动时只建立编译单元的地址表，函数和行号索引在用到时按编译单元建立，同时在后台生成缓存文件
+        auto cache_key = IndexCache::key_of(program, elf);
+        auto cache_path = IndexCache::path_of(cache_key);
+        dwarf_index = DwarfIndex{dwarf, elf, IndexCache::open(cache_path, cache_key)};
+        if (!dwarf_index.from_cache() && dwarf_index.unit_count() > 0 && !cache_path.empty()) {
+            cache_writer = std::async(std::launch::async, &DwarfIndex::build_cache, program, cache_path, cache_key,
+                &is_cache_cancelled);
+        }
+        load_times.index_ms = stopwatch.restart();
 
         close(fd);
+
+        printf("[加载 %s: ELF %.1f ms, DWARF %.1f ms, %s %.1f ms (%zu 个编译单元)]\n",
+            program.c_str(), load_times.elf_ms, load_times.dwarf_ms,
+            dwarf_index.from_cache() ? "映射索引缓存" : "编译单元地址表", load_times.index_ms,
+            dwarf_index.unit_count());
     }
 
 public:
@@ -49,15 +115,51 @@ public:
         return is_running;
     }
 
+    // tracee 是附加上的，而不是由调试器启动的
+    auto attached() const -> bool {
+        return is_attached;
+    }
+
+    // 调试信息中的地址（链接地址）和 tracee 中的地址相差装载偏移，tracee 没有运行时两者相同
+    // 所以 tracee 运行之前记录的断点和观察点都是链接地址，开始运行或者附加时再换算
+    auto to_runtime(std::intptr_t addr) const -> std::intptr_t {
+        return addr + load_bias;
+    }
+
+    auto to_link(std::intptr_t addr) const -> std::intptr_t {
+        return addr - load_bias;
+    }
+
+public:
+    // 启动时各阶段的耗时，单位毫秒
+    struct LoadTimes {
+        double elf_ms;
+        double dwarf_ms;
+        double index_ms;
+    };
+
+    auto get_load_times() const -> LoadTimes const& {
+        return load_times;
+    }
+
+    auto get_dwarf_index() const -> DwarfIndex const& {
+        return dwarf_index;
+    }
+
+    auto get_name_index() const -> NameIndex const& {
+        return name_index;
+    }
+
 public:
     // 开始运行 tracee 程序
     auto start(std::vector<std::string> const& args) -> void {
+        prepare_agent();
         pid = fork();
         if (pid == -1) {
             EXCEPTION("fork 失败");
         } else if (pid == 0) {
-            // 标志自己被 trace
-            PtraceProxy::trace_me();
+            // 先停下来等调试器用 PTRACE_SEIZE 附加，再执行 program
+            kill(getpid(), SIGSTOP);
 
             // 执行 program
             tracee_routine(args);
@@ -79,15 +181,146 @@ public:
         }
         // 如 man ptrace 所说，SIGKILL 信号是会直接发送给 tracee 的
         kill(pid, SIGKILL);
-        // 等待子进程的结束
-        handle_wait_signal_and_exit();
+        // 等待所有线程结束，主线程最后一个报告
+        while (true) {
+            int status;
+            auto tid = waitpid(-1, &status, __WALL);
+            if (tid == -1 && errno != EINTR) {
+                reset();
+                return;
+            }
+            if (tid == pid && handle_exit(status)) {
+                return;
+            }
+        }
+    }
+
+    // 附加到正在运行的进程 target 的所有线程上，附加后所有线程停下
+    // 不设置 PTRACE_O_EXITKILL，调试器退出时先脱离，进程继续运行
+    auto attach(pid_t target) -> void {
+        if (running()) {
+            EXCEPTION("已经在调试进程 " + std::to_string(pid) + "，先 detach");
+        }
+        char resolved[PATH_MAX];
+        auto exe = executable_of(target);
+        if (exe.empty()) {
+            EXCEPTION("无法读取进程 " + std::to_string(target) + " 的可执行文件");
+        }
+        if (realpath(program.c_str(), resolved) == nullptr || exe != resolved) {
+            EXCEPTION("进程 " + std::to_string(target) + " 运行的是 " + exe + "，不是 " + program);
+        }
+
+        if (!PtraceProxy::seize(target, PTRACE_O_TRACECLONE)) {
+            EXCEPTION(std::string{"PTRACE_SEIZE 失败: "} + strerror(errno));
+        }
+        pid = target;
+        is_running = true;
+        is_attached = true;
+        current_tid = target;
+        threads.add(target);
+
+        // 附加的过程中线程还可能创建新的线程，反复扫描 /proc/pid/task 直到没有新线程
+        // 已经附加的线程创建的新线程会自动被附加，通过 PTRACE_EVENT_CLONE 加入线程表
+        auto seized = true;
+        while (seized) {
+            seized = false;
+            for (auto tid : tasks_of(target)) {
+                if (threads.find(tid) == nullptr && PtraceProxy::seize(tid, PTRACE_O_TRACECLONE)) {
+                    threads.add(tid);
+                    seized = true;
+                }
+            }
+        }
+        // PTRACE_SEIZE 不会让线程停下，这些线程都在运行
+        for (auto& item : threads) {
+            item.second.is_starting = false;
+            item.second.is_running = true;
+        }
+
+        stop_all_threads();
+        if (!running()) {
+            EXCEPTION("进程在附加的过程中结束了");
+        }
+        arm_tracee();
+        printf("[附加到进程 %d，%zu 个线程，停在 %s]\n", pid, threads.size(), describe_addr(get_pc()).c_str());
+    }
+
+    // 撤销对 tracee 的所有修改后脱离，tracee 继续运行：
+    // 断点恢复原来的字节，被保护的页恢复权限，调试寄存器清零，暂存页解除映射
+    // 线程停下时收到、还没有发送的信号在脱离时发送
+    auto detach() -> void {
+        if (!running()) {
+            EXCEPTION("inferior 没有运行");
+        }
+        if (syscall_catcher.filter_installed()) {
+            // seccomp 过滤器不能卸载，没有 tracer 时 SECCOMP_RET_TRACE 的系统调用都会以 ENOSYS 失败
+            EXCEPTION("tracee 中安装了捕获系统调用的 seccomp 过滤器，脱离后这些系统调用都会失败");
+        }
+        stop_all_threads();
+        wait_starting_threads();
+        if (!running()) {
+            return;
+        }
+
+        disarm_step_plan();
+        fast_tracer.drain();
+        uninstall_fast_tracepoints();
+        std::vector<Breakpoint *> bps{};
+        for (auto& item : breakpoints) {
+            if (item.second.enabled()) {
+                bps.push_back(&item.second);
+            }
+        }
+        BreakpointBatch::disable(pid, bps);
+
+        // 页权限和暂存页都借用当前线程注入系统调用来恢复
+        // 先恢复页权限，munmap 要在暂存页之外执行，所以先把暂存页标记为不可用
+        auto& thread = current_thread();
+        for (auto const& item : page_watcher.protected_pages()) {
+            set_page_protection(thread, item.first, item.second);
+        }
+        page_watcher.clear_protections();
+        if (displaced.ready()) {
+            auto page = displaced.syscall_address();
+            displaced.reset();
+            inject_syscall(thread, SYS_munmap, page, DisplacedStepper::page_size, 0);
+        }
+
+        auto detached = pid;
+        for (auto& item : threads) {
+            auto& t = item.second;
+            if (!debug_registers.empty()) {
+                PtraceProxy::set_debug_register(t.tid, 7, 0);
+            }
+            // 停在断点上的线程 PC 已经回退到断点处，要先写回
+            t.registers.flush();
+            PtraceProxy::detach(t.tid, t.pending_signal);
+        }
+        reset();
+        printf("[脱离进程 %d]\n", detached);
+    }
+
+    // 进程正在运行的可执行文件的路径，读不到时返回空字符串
+    static auto executable_of(pid_t target) -> std::string {
+        char path[64];
+        char exe[PATH_MAX];
+        snprintf(path, sizeof(path), "/proc/%d/exe", target);
+        auto len = readlink(path, exe, sizeof(exe) - 1);
+        if (len <= 0) {
+            return {};
+        }
+        return std::string{exe, static_cast<std::size_t>(len)};
     }
 
 public:
     // 在 addr 地址处设置 或者 准备设置断点
     auto set_breakpoint_at_addr(std::intptr_t addr) -> void {
+        if (running() && fast_tracer.covers(to_link(addr))) {
+            EXCEPTION("地址在快速跟踪点换掉的指令中间，不能设置断点");
+        }
         if (!running()) {
             // tracee 还未开始运行，只记录地址，不真正添加断点
+            user_breakpoints.insert(addr);
             breakpoint_addrs_to_set.insert(addr);
             return;
         }
@@ -97,264 +330,2708 @@ public:
             bp.enable();
             breakpoints[addr] = bp;
         }
+        // 断点写入成功之后才算用户的断点，enable 失败时地址不留下记录
+        user_breakpoints.insert(addr);
+        // 地址上已经有单步计划的断点时，转为用户的断点，撤销单步计划时不再删除
+        armed_plan.owned.erase(addr);
     }
 
-public:
-    // 继续执行 tracee
-    auto continue_execute() -> void {
-        // 因为当前指令可能仍然是 0xCC
-        // 所以我们先确认下，如果是，就先暂停断点
-        // 使用单步指令跳到下一条指令后再继续
-        step_over_breakpoint();
+    // 在 addrs 中的每个地址处批量设置断点，同一页上的断点只读写一次内存
+    // 返回这一次新加入的断点地址，之后交给 remove_breakpoints_at_addrs 整体撤销
+    auto set_breakpoints_at_addrs(std::set<std::intptr_t> const& addrs) -> std::set<std::intptr_t> {
+        std::set<std::intptr_t> added{};
+        if (!running()) {
+            breakpoint_addrs_to_set.insert(addrs.begin(), addrs.end());
+            return added;
+        }
 
-        if (signo != 0) {
-            // 因为收到非 SIGTRAP 信号而停止，将信号重新发送给 tracee
-            PtraceProxy::delivery_signal_tracee(pid, signo);
-            signo = 0;  // 重置信号记录
-        } else {
-            // 不发送信号继续
-            PtraceProxy::continue_tracee(pid);
+        std::vector<Breakpoint *> bps{};
+        for (auto addr : addrs) {
+            // 快速跟踪点换掉的指令中间不再有指令边界，线程也不会执行到那里
+            if (breakpoints.count(addr) == 0 && !fast_tracer.covers(to_link(addr))) {
+                breakpoints[addr] = Breakpoint{pid, addr};
+                added.insert(addr);
+            }
+        }
+        // 全部插入之后再取指针，避免 rehash 使指针失效
+        for (auto addr : added) {
+            bps.push_back(&breakpoints[addr]);
         }
 
-        handle_wait_signal_and_exit();
+        try {
+            BreakpointBatch::enable(pid, bps);
+        } catch (exception const& exc) {
+            for (auto addr : added) {
+                breakpoints.erase(addr);
+            }
+            throw;
+        }
+        return added;
     }
 
-    // 执行下一条机器码，如果有断点，则用 step_over 跳过，否则直接调用 ptrace
-    auto single_step_instruction_with_breakpoint_check() -> void {
-        if (breakpoints.count(PtraceProxy::get_pc(pid))) {
-            step_over_breakpoint();
-        } else {
-            single_step_instruction();
+    // 批量删除 addrs 中的断点
+    auto remove_breakpoints_at_addrs(std::set<std::intptr_t> const& addrs) -> void {
+        std::vector<Breakpoint *> bps{};
+        for (auto addr : addrs) {
+            auto it = breakpoints.find(addr);
+            if (it != breakpoints.end()) {
+                bps.push_back(&it->second);
+            }
+        }
+
+        // tracee 已经结束时，不需要恢复内存
+        if (running()) {
+            BreakpointBatch::disable(pid, bps);
+        }
+        for (auto addr : addrs) {
+            breakpoints.erase(addr);
         }
     }
 
 public:
-    // 打印 filename 第 line 行左右的代码，上下文分别 n_context
-    auto list_source(std::string const& filename, unsigned int line, unsigned int n_context) const -> void {
-        std::ifstream source_file{filename};
-        unsigned int start = n_context > line ? 1 : line - n_context;
-        unsigned int end = line + n_context;
-        unsigned int current = 1u;
-
-        std::string source_line{};
-        while (current < start && std::getline(source_file, source_line)) {
-            ++current;
+    // 在 addr 处设置硬件断点，返回占用的调试寄存器编号
+    auto set_hardware_breakpoint(std::intptr_t addr) -> int {
+        auto slot = debug_registers.find(addr, DebugRegisters::Kind::execute);
+        if (slot >= 0) {
+            return slot;
         }
+        return add_debug_register(addr, DebugRegisters::Kind::execute, 1);
+    }
+
+    // 监视 [addr, addr + len) 的写入（kind 为 write）或者访问（kind 为 access），返回占用的调试寄存器编号
+    auto set_hardware_watchpoint(std::intptr_t addr, std::size_t len, DebugRegisters::Kind kind) -> int {
+        return add_debug_register(addr, kind, len);
+    }
 
-        while (current <= end && std::getline(source_file, source_line)) {
-            printf("%s%3d|%s\n", current == line ? "->" : "  ", current, source_line.c_str());
-            ++current;
+    // 软件观察点：去掉 [addr, addr + len) 所在页的写权限，长度和数量都没有限制，返回观察点编号
+    auto set_software_watchpoint(std::intptr_t addr, std::size_t len) -> int {
+        if (running() && !current_thread_stopped()) {
+            EXCEPTION("当前线程正在运行，先切换到停下的线程");
         }
+        if (running() && overlaps_stack(addr, addr + static_cast<std::intptr_t>(len))) {
+            EXCEPTION("观察的区间在线程的栈上，软件观察点不能去掉栈的写权限");
+        }
+        auto& watch = page_watcher.add(addr, len);
+        auto id = watch.id;
+        if (running()) {
+            PtraceProxy::read_memory(pid, addr, watch.value.data(), len);
+            protect_watched_pages();
+        }
+        return id;
     }
 
 public:
-    // 根据机器码地址返回函数 DIE
-    auto get_function_die_by_addr(std::intptr_t addr) const -> dwarf::die {
-        for (auto const&cu : dwarf.compilation_units()) {
-            if (die_pc_range(cu.root()).contains(addr)) {
-                for (auto const& die : cu.root()) {
-                    if (die.tag == dwarf::DW_TAG::subprogram
-                        && die_pc_range(die).contains(addr)) {
-                        return die;
-                    }
-                }
+    // 跟踪名称中能找到 pattern 的函数的调用，返回新加入的函数个数
+    // tracee 还未运行时只记录函数，开始运行时再设置断点
+    auto trace_calls(std::regex const& pattern) -> std::size_t {
+        if (running() && !current_thread_stopped()) {
+            EXCEPTION("当前线程正在运行，先切换到停下的线程");
+        }
+        std::size_t added = 0;
+        for (auto const& die : get_dies_by_function_regex(pattern)) {
+            if (call_tracer.add(at_name(die), at_low_pc(die))) {
+                ++added;
             }
         }
+        if (running()) {
+            install_call_entries();
+        }
+        return added;
+    }
 
-        NO_DEBUG_INFORMATION("没有找到地址的调试信息");
+    // 停止跟踪函数调用，删除跟踪加入的断点，用户在同一地址设置的断点保留
+    auto stop_tracing_calls() -> void {
+        if (running() && !current_thread_stopped()) {
+            EXCEPTION("当前线程正在运行，先切换到停下的线程");
+        }
+        std::set<std::intptr_t> addrs{};
+        std::size_t id;
+        for (auto addr : call_tracer.owned_breakpoints()) {
+            if (tracepoints.find(to_link(addr), id)) {
+                // 同一地址上的跟踪点还要用这个断点，转给跟踪点
+                tracepoints.owned_breakpoints().insert(addr);
+            } else if (user_breakpoints.count(addr) == 0) {
+                addrs.insert(addr);
+            }
+        }
+        remove_breakpoints_at_addrs(addrs);
+        call_tracer.clear();
     }
 
-    // 根据当前 PC 返回函数 DIE
-    auto get_function_die_by_pc() const -> dwarf::die {
-        auto pc = PtraceProxy::get_pc(pid);
-        return get_function_die_by_addr(pc);
+    auto get_call_tracer() const -> CallTracer const& {
+        return call_tracer;
     }
 
-    // 根据机器码地址返回行调试信息
-    auto get_line_iter_by_addr(std::intptr_t addr) const -> dwarf::line_table::iterator {
-        for (auto const& cu : dwarf.compilation_units()) {
-            if (die_pc_range(cu.root()).contains(addr)) {
-                auto &line_table = cu.get_line_table();
-                auto it = line_table.find_address(addr);
-                if (it != line_table.end()) {
-                    return it;
-                }
-                break;
+public:
+    // 捕获系统调用 nrs，all 为 true 时捕获所有系统调用
+    // 返回已经安装的过滤器不会停下的系统调用，它们要到下次 run 时才生效；all 没有立即生效时返回的是 {-1}
+    auto catch_syscalls(std::vector<long> const& nrs, bool all, SyscallCatcher::Mode mode) -> std::vector<long> {
+        if (all) {
+            syscall_catcher.set_all(mode);
+            if (running() && !syscall_catcher.is_filtered_all()) {
+                return {-1};
+            }
+            return {};
+        }
+        std::vector<long> later{};
+        for (auto nr : nrs) {
+            syscall_catcher.set(nr, mode);
+            if (running() && !syscall_catcher.is_filtered(nr)) {
+                later.push_back(nr);
             }
         }
+        return later;
+    }
 
-        NO_DEBUG_INFORMATION("没有找到函数的调试信息");
+    // 取消所有系统调用的捕获，已经安装的过滤器还会停下，停下后直接继续运行
+    auto clear_syscall_catches() -> void {
+        syscall_catcher.clear();
     }
 
-    // 根据当前 PC 返回行调试信息
-    auto get_line_iter_by_pc() const -> dwarf::line_table::iterator {
-        auto pc = PtraceProxy::get_pc(pid);
-        return get_line_iter_by_addr(pc);
+    auto get_syscall_catcher() -> SyscallCatcher& {
+        return syscall_catcher;
     }
 
-    // 根据函数名称返回函数起始的行调试信息
-    auto get_line_iter_by_function_name(std::string const& name) const -> dwarf::line_table::iterator {
-        auto die = get_die_by_function_name(name);
-        auto low_pc = at_low_pc(die);
-        return get_line_iter_by_addr(low_pc);
+public:
+    // 在 addr 处加入快速跟踪点，命中时记下 regs 中的寄存器，返回跟踪点的编号
+    // tracee 由 run 启动时预加载 agent，agent 加载后安装跳转；已经在运行的 tracee 没有 agent 时要到下次 run 才生效
+    auto add_fast_tracepoint(std::intptr_t addr, std::string const& location, std::vector<uint8_t> const& regs) -> int {
+        if (running() && !current_thread_stopped()) {
+            EXCEPTION("当前线程正在运行，先切换到停下的线程");
+        }
+        auto id = fast_tracer.add(to_link(addr), location, regs);
+        if (id < 0) {
+            EXCEPTION("快速跟踪点最多 " + std::to_string(TraceRing::max_sites) + " 个");
+        }
+        if (running() && fast_tracer.pending()) {
+            install_fast_tracepoints(current_thread());
+        }
+        return id;
     }
 
-    // 根据函数名称返回 DIE 信息
-    auto get_die_by_function_name(std::string const& name) const -> dwarf::die {
-        // 遍历调试信息的每个编译单元
-        for (auto const& cu : dwarf.compilation_units()) {
-            // 遍历编译单元的每个 DWARF Information Entries
-            for (auto const& die : cu.root()) {
-                // 如果 tag 表明是函数（subprogram）、有 name 并且 name 就是要查找的函数名
-                if (die.tag == dwarf::DW_TAG::subprogram 
-                    && die.has(dwarf::DW_AT::name) 
-                    && at_name(die) == name) {
-                    // 找到了函数对应的 DIE
-                    return die;
-                }
+    // 删除所有快速跟踪点，已经安装的跳转恢复为原来的指令，蹦床页留在 tracee 中，正在蹦床中的线程照常返回
+    auto clear_fast_tracepoints() -> void {
+        if (running()) {
+            if (!current_thread_stopped()) {
+                EXCEPTION("当前线程正在运行，先切换到停下的线程");
             }
+            fast_tracer.drain();
+            // 非停止模式下别的线程还在运行，恢复 5 字节以上的指令期间先暂停它们，不会执行到写了一半的 jmp
+            auto paused = pause_threads();
+            if (running()) {
+                uninstall_fast_tracepoints();
+            }
+            resume_threads(paused);
         }
+        fast_tracer.clear();
+    }
 
-        NO_DEBUG_INFORMATION("没有找到函数的调试信息");
+    // 读出 agent 写入共享内存的记录
+    auto drain_fast_tracepoints() -> std::size_t {
+        return fast_tracer.drain();
     }
 
-private:
-    // 将 inferior 的状态重置
-    auto reset() -> void {
-        // 将已设置的断点全部清空
-        breakpoints.clear();
-        pid = -1;
-        is_running = false;
+    auto get_fast_tracer() -> FastTracer& {
+        return fast_tracer;
     }
 
-    // 处理 tracee 停止后信号的工作或者 tracee 直接退出的工作
-    auto handle_wait_signal_and_exit() -> void {
-        int status;
-        waitpid(pid, &status, 0);
+public:
+    // 在 addr 处加入收集 items 的跟踪点，text 是定义它的命令，返回跟踪点的编号
+    // tracee 还未运行时只记录，开始运行时再设置断点
+    auto add_tracepoint(std::intptr_t addr, std::string const& text, std::vector<Tracepoints::Item> const& items) -> std::size_t {
+        if (running() && !current_thread_stopped()) {
+            EXCEPTION("当前线程正在运行，先切换到停下的线程");
+        }
+        if (!tracepoints.open_file()) {
+            EXCEPTION("无法打开记录文件 " + tracepoints.path() + ": " + strerror(errno));
+        }
+        auto id = tracepoints.add(to_link(addr), text, items);
+        if (running()) {
+            own_tracepoint_breakpoints({addr});
+        }
+        return id;
+    }
 
-        if (WIFEXITED(status)) {
-            printf("[(进程 %d) 正常结束]\n", pid);
-            reset();
-            return;
-        } else if (WIFSIGNALED(status)) {
-            printf("[进程 %d] 因为信号被杀.\n", pid);
-            reset();
-            return;
+    // 删除所有跟踪点和它们加入的断点，用户的断点和函数调用跟踪还要用的断点保留
+    auto clear_tracepoints() -> void {
+        if (running() && !current_thread_stopped()) {
+            EXCEPTION("当前线程正在运行，先切换到停下的线程");
         }
+        std::set<std::intptr_t> addrs{};
+        for (auto addr : tracepoints.owned_breakpoints()) {
+            if (is_call_trace_site(addr)) {
+                call_tracer.owned_breakpoints().insert(addr);
+            } else if (user_breakpoints.count(addr) == 0) {
+                addrs.insert(addr);
+            }
+        }
+        remove_breakpoints_at_addrs(addrs);
+        tracepoints.clear();
+    }
 
-        auto siginfo = PtraceProxy::get_signal_info(pid);
-        switch (siginfo.si_signo) {
-        case SIGTRAP:
-            // 触发断点而停止
-            handle_sigtrap(siginfo);
-            break;
-        default:
-            signo = siginfo.si_signo;
-            printf("收到信号 %s\n", strsignal(siginfo.si_signo));
+    // 之后的记录写到 path
+    auto set_trace_file(std::string const& path) -> void {
+        if (!tracepoints.set_path(path)) {
+            EXCEPTION("无法打开记录文件 " + path + ": " + strerror(errno));
         }
     }
 
-    auto handle_sigtrap(siginfo_t siginfo) -> void {
-        if (siginfo.si_code != SI_KERNEL && siginfo.si_code != TRAP_BRKPT) {
-            // 不是因为断点触发的，直接返回
-            return;
+    auto get_tracepoints() -> Tracepoints& {
+        return tracepoints;
+    }
+
+public:
+    // 当前线程，寄存器的读写和单步都针对它
+    auto current_thread() const -> Thread& {
+        return threads.at(current_tid);
+    }
+
+    // 按编号排好序的所有线程
+    auto get_threads() const -> std::vector<Thread *> {
+        return threads.sorted();
+    }
+
+    // 切换当前线程，之后 step/next 等命令作用在这个线程上
+    auto select_thread(int number) -> Thread& {
+        auto thread = threads.find_by_number(number);
+        if (thread == nullptr) {
+            EXCEPTION("没有编号为 " + std::to_string(number) + " 的线程");
         }
+        current_tid = thread->tid;
+        return *thread;
+    }
 
-        // 确实是因为断点停下来的
-        // 需要将 PC 回退到执行 0xCC 之前的位置
-        // 然后重新执行原状态的指令
-        // 这里只处理 PC 的回退
-        // 执行原状态的操作在 step_over_breakpoint 中
-        auto pc = PtraceProxy::get_pc(pid);
-        PtraceProxy::set_pc(pid, pc - 1);
+    auto non_stop() const -> bool {
+        return is_non_stop;
+    }
 
-        try {
-            auto line_iter = get_line_iter_by_addr(pc - 1);
-            list_source(line_iter->file->path, line_iter->line, 1);
-        } catch (no_debug_information const& exc) {
+    // 切换非停止模式，回到全停止模式时让还在运行的线程都停下
+    auto set_non_stop(bool enable) -> void {
+        if (!enable && is_non_stop && running()) {
+            stop_all_threads();
         }
+        is_non_stop = enable;
     }
 
-    // 执行机器码级别单步运行的
-    // 然后等 tracee 停下来
-    auto single_step_instruction() -> void {
-        PtraceProxy::single_step(pid);
-        handle_wait_signal_and_exit();
+    // 命令只能作用在停下的线程上
+    auto current_thread_stopped() const -> bool {
+        return running() && !current_thread().is_running;
     }
 
-    // 判断当前要执行的指令是否是 0xCC 断点指令
-    // 如果是，则暂时关闭掉该断点
-    // 等执行过后再打开
-    auto step_over_breakpoint() -> void {
-        auto pc = PtraceProxy::get_pc(pid);
-        if (breakpoints.count(pc)) {
-            auto &bp = breakpoints[pc];
-            if (bp.enabled()) {
-                bp.disable();
-                // 利用指令单步操作运行过该指令
-                single_step_instruction();
-                bp.enable();
-            }
+    auto get_thread_pc(Thread& thread) const -> std::intptr_t {
+        return thread.registers.pc();
+    }
+
+    // 地址所在的函数和代码行，没有调试信息时只有地址
+    auto describe_addr(std::intptr_t addr) const -> std::string {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "0x%lx", addr);
+        std::string result{buf};
+        try {
+            result += " in " + at_name(get_function_die_by_addr(addr));
+            auto line_iter = get_line_iter_by_addr(addr);
+            result += " at " + line_iter.file() + ":" + std::to_string(line_iter.line());
+        } catch (no_debug_information const& exc) {
         }
+        return result;
     }
 
-private:
-    // 将传入的 args 重新组织成 execv 需要的格式
-    auto tracee_routine(std::vector<std::string> const& args) -> void {
-        // 多出的两个空间，一个留给开头的 program，一个留给最后的 nullptr
-        char **argv = new char *[args.size() + 2];  
+public:
+    // 取得函数的单步计划，每个函数只计算一次
+    auto get_step_plan(dwarf::die const& func_die) -> StepPlan const& {
+        auto ranges = die_pc_range(func_die);
+        auto key = std::numeric_limits<std::intptr_t>::max();
+        for (auto const& range : ranges) {
+            key = std::min(key, static_cast<std::intptr_t>(range.low));
+        }
 
-        argv[0] = const_cast<char *>(program.c_str());
-        for (auto i = 0; i < args.size(); ++i) {
-            argv[1 + i] = const_cast<char *>(args[i].c_str());
+        auto it = step_plans.find(key);
+        if (it != step_plans.end()) {
+            return it->second;
         }
-        argv[args.size() + 1] = nullptr;
 
-        execv(program.c_str(), argv);
-        // 子进程抛出异常
-        EXCEPTION(std::string{"execv 失败: "} + strerror(errno));
+        StepPlan plan{};
+        for (auto const& range : ranges) {
+            std::intptr_t low = range.low;
+            std::intptr_t high = range.high;
+            plan.ranges.push_back({low, high});
+            auto shard = dwarf_index.shard_of(low);
+            if (shard == nullptr) {
+                continue;
+            }
+            auto inlined = shard->functions.inlined_ranges(low, high);
+            plan.inlined.insert(plan.inlined.end(), inlined.begin(), inlined.end());
+
+            // 内联展开中的行属于被内联的函数，next 不应该停在那里
+            auto next_inlined = inlined.begin();
+            // 前一条记录的行号，与它相同说明不是这一行的开始
+            unsigned int last_line = 0;
+            for (auto line_iter = shard->lines.lower_bound(low);
+                !line_iter.at_end() && line_iter.address() < high; ++line_iter) {
+                if (line_iter.end_sequence()) {
+                    last_line = 0;
+                    continue;
+                }
+                auto line = line_iter.line();
+                auto is_start = line_iter.is_stmt() && line != last_line;
+                last_line = line;
+                if (!is_start) {
+                    continue;
+                }
+                auto addr = line_iter.address();
+                while (next_inlined != inlined.end() && next_inlined->second <= addr) {
+                    ++next_inlined;
+                }
+                if (next_inlined != inlined.end() && next_inlined->first <= addr) {
+                    continue;
+                }
+                plan.line_addrs[addr] = line;
+            }
+        }
+
+        return step_plans[key] = plan;
     }
 
-    auto tracer_routine(std::vector<std::string> const& args) -> void {
-        // 根据文档，execv 执行成功后，tracee 会收到 SIGTRAP 信号，我们等这个信号
-        int status = 0;
-        waitpid(pid, &status, 0);
-        if (WIFEXITED(status)) {
-            // execv 失败了，子进程抛出了异常，父进程也抛出异常
-            EXCEPTION("启动失败，退出");
+    // 在 tracee 中布置单步计划：除了当前行 line，函数每一行的开始处以及返回地址处都设置断点
+    // 还在同一个栈帧中时，之前布置的断点都还在，只需要换掉上一次和这一次当前行的断点
+    auto arm_step_plan(StepPlan const& plan, uint64_t frame, std::intptr_t return_address, unsigned int line) -> void {
+        if (armed_plan.plan == &plan && armed_plan.frame == frame
+            && armed_plan.return_address == return_address) {
+            if (armed_plan.line != line) {
+                rearm_step_plan_line(line);
+            }
+            return;
         }
 
-        // 将之前记录的断点地址真正设置为断点
-        for (auto addr : breakpoint_addrs_to_set) {
-            if (breakpoints.count(addr) == 0) {
-                Breakpoint bp{pid, addr};
-                bp.enable();
-                breakpoints[addr] = bp;
+        disarm_step_plan();
+
+        // 单步计划中是链接地址，按这次运行的装载偏移换算
+        std::set<std::intptr_t> addrs{};
+        for (auto const& item : plan.line_addrs) {
+            if (item.second != line) {
+                addrs.insert(to_runtime(item.first));
             }
         }
+        if (return_address != 0) {
+            addrs.insert(return_address);
+        }
+        // 已经存在的断点（例如用户设置的）不会出现在 owned 中
+        armed_plan = ArmedStepPlan{&plan, frame, return_address, line, set_breakpoints_at_addrs(addrs)};
+    }
 
-        // 继续执行
-        continue_execute();
+    // 同一个栈帧中换了一行继续单步：补上上一次当前行的断点，撤销这一次当前行的断点
+    auto rearm_step_plan_line(unsigned int line) -> void {
+        std::set<std::intptr_t> to_add{};
+        std::set<std::intptr_t> to_remove{};
+        for (auto const& item : armed_plan.plan->line_addrs) {
+            auto addr = to_runtime(item.first);
+            if (item.second == armed_plan.line) {
+                to_add.insert(addr);
+            } else if (item.second == line && addr != armed_plan.return_address && armed_plan.owned.erase(addr)) {
+                to_remove.insert(addr);
+            }
+        }
+        remove_breakpoints_at_addrs(to_remove);
+        auto added = set_breakpoints_at_addrs(to_add);
+        armed_plan.owned.insert(added.begin(), added.end());
+        armed_plan.line = line;
     }
 
-private:
-    // 提取 program 中的 debug 信息
-    dwarf::dwarf dwarf;
+    // 撤销已经布置的单步计划
+    auto disarm_step_plan() -> void {
+        if (armed_plan.plan == nullptr) {
+            return;
+        }
 
-private:
-    // tracee 未开始运行时，记录断点地址，在 tracee 开始运行时将断点加入
-    std::set<std::intptr_t> breakpoint_addrs_to_set;
+        remove_breakpoints_at_addrs(armed_plan.owned);
+        armed_plan = ArmedStepPlan{nullptr, 0, 0, 0, {}};
+    }
 
-public:
-    // step 和 run 命令会用到
-    // 真正设置到的断点
-    std::unordered_map<std::intptr_t, Breakpoint> breakpoints;
+    // continue 恢复运行：等待安装的快速跟踪点先安装，当前线程越过断点后按模式恢复线程
+    auto resume_for_continue(bool all_threads) -> void {
+        is_watch_triggered = false;
+        is_focus_changed = false;
+        is_interrupted = false;
+        disarm_step_plan();
+
+        if (fast_tracer.pending() && current_thread_stopped()) {
+            install_fast_tracepoints(current_thread());
+        }
+        step_over_breakpoint();
+        if (!running()) {
+            return;
+        }
+        if (is_non_stop && !all_threads) {
+            resume_thread(current_thread(), false);
+        } else {
+            resume_all_threads();
+        }
+    }
+
+public:
+    // 继续执行 tracee，单步命令布置的断点在这之前撤销
+    // 任何一个线程停下都会返回；非停止模式下只恢复当前线程，all_threads 为 true 时恢复所有停下的线程
+    // timeout_ms 大于 0 时运行超过这么长时间就让所有线程停下；Ctrl-C 随时可以打断
+    auto continue_execute(bool all_threads = false, int timeout_ms = 0) -> void {
+        if (timeout_ms > 0) {
+            events.arm_timer(timeout_ms);
+        }
+        is_waiting_any = true;
+        try {
+            resume_for_continue(all_threads);
+            if (running()) {
+                handle_wait_signal_and_exit();
+            }
+        } catch (...) {
+            is_waiting_any = false;
+            events.disarm_timer();
+            throw;
+        }
+        is_waiting_any = false;
+        events.disarm_timer();
+        fast_tracer.drain();
+    }
+
+    // continue &：恢复运行后立即回到命令行，停止在提示符下由 poll_events 报告
+    auto continue_in_background(bool all_threads = false) -> void {
+        resume_for_continue(all_threads);
+        is_background = running() && any_thread_running();
+    }
+
+    // tracee 在后台运行，还没有报告停止
+    auto in_background() const -> bool {
+        return is_background;
+    }
+
+    // 取出所有已经发生的线程状态变化并处理，不阻塞
+    // 后台运行时任何一个线程停下都报告；否则只有非停止模式下在运行的线程，它们停下时只停放，当前线程不变
+    // 有停止报告或者 tracee 结束时返回 true，调用者重新打印提示符
+    auto poll_events() -> bool {
+        auto reported = false;
+        auto was_waiting_any = is_waiting_any;
+        is_waiting_any = is_background;
+        try {
+            while (running() && any_thread_running()) {
+                int status;
+                auto tid = waitpid(-1, &status, __WALL | WNOHANG);
+                if (tid == 0 || (tid == -1 && errno == EINTR)) {
+                    break;
+                }
+                if (tid == -1) {
+                    reset();
+                    reported = true;
+                    break;
+                }
+                if (handle_wait_status(tid, status, is_background ? current_tid : -1) && (is_background || !running())) {
+                    reported = true;
+                    is_background = false;
+                    break;
+                }
+            }
+        } catch (...) {
+            is_waiting_any = was_waiting_any;
+            throw;
+        }
+        is_waiting_any = was_waiting_any;
+        if (!running()) {
+            is_background = false;
+        }
+        fast_tracer.drain();
+        return reported;
+    }
+
+    // 提示符下按了 Ctrl-C，有线程在运行时让它们停下，返回是否打断了 tracee
+    auto interrupt() -> bool {
+        if (!running() || !any_thread_running()) {
+            return false;
+        }
+        interrupt_threads();
+        return true;
+    }
+
+    // 提示符下等待输入的超时：有快速跟踪点在运行时定时读出共享内存中的记录，避免环形缓冲区写满
+    auto drain_interval() -> int {
+        return running() && fast_tracer.prepared() && any_thread_running() ? 100 : -1;
+    }
+
+    auto get_event_loop() -> EventLoop& {
+        return events;
+    }
+
+    // 让所有线程继续运行，同时按 profiler 的频率采样，直到采样时间结束或者有线程停下需要报告
+    // 采样时间结束后所有线程停下
+    auto profile(Profiler& sampler) -> void {
+        profiler = &sampler;
+        sampler.start();
+        try {
+            continue_execute(true);
+        } catch (...) {
+            sampler.stop();
+            profiler = nullptr;
+            throw;
+        }
+        sampler.stop();
+        profiler = nullptr;
+    }
+
+    // 单步命令内部使用的继续执行，保留已经布置的单步计划
+    auto continue_in_step() -> void {
+        // 因为当前指令可能仍然是 0xCC
+        // 所以我们先确认下，如果是，就先暂停断点
+        // 使用单步指令跳到下一条指令后再继续
+        step_over_breakpoint();
+        if (!running()) {
+            return;
+        }
+
+        // 全停止模式下所有线程一起恢复运行，停下时收到的信号这时发送给各自的线程
+        // 非停止模式下其他线程本来就在运行或者由用户分别恢复，这里只恢复当前线程
+        if (is_non_stop) {
+            resume_thread(current_thread(), false);
+        } else {
+            resume_all_threads();
+        }
+        handle_wait_signal_and_exit();
+    }
+
+    // 源码级单步：执行到 PC 所在的代码行变化为止
+    // 当前行的地址区间只计算一次，之后只比较 PC 是否还在区间内，不再查询调试信息
+    auto step_out_of_line() -> void {
+        auto line = get_line_iter_by_pc().line();
+
+        // 过程中临时断点停下时不打印代码
+        is_quiet = true;
+        is_watch_triggered = false;
+        is_focus_changed = false;
+        is_interrupted = false;
+        try {
+            while (keep_stepping()) {
+                auto line_iter = get_line_iter_by_pc();
+                if (line_iter.line() != line) {
+                    break;
+                }
+                auto range = line_iter.range();
+                run_out_of_range(to_runtime(range.first), to_runtime(range.second));
+            }
+        } catch (...) {
+            is_quiet = false;
+            throw;
+        }
+        is_quiet = false;
+    }
+
+    // 执行下一条机器码，如果有断点，则用 step_over 跳过，否则直接调用 ptrace
+    auto single_step_instruction_with_breakpoint_check() -> void {
+        if (breakpoints.count(get_pc())) {
+            step_over_breakpoint();
+        } else {
+            single_step_instruction();
+        }
+    }
+
+public:
+    // 寄存器都通过当前线程的缓存读写
+    auto get_pc() const -> std::intptr_t {
+        return thread_registers().pc();
+    }
+
+    auto set_pc(std::intptr_t pc) -> void {
+        thread_registers().set_pc(pc);
+    }
+
+    auto get_frame_pointer() const -> uint64_t {
+        return thread_registers().frame_pointer();
+    }
+
+public:
+    // 回溯线程的调用栈，最多 max_depth 帧，第 0 帧是线程停下的位置
+    auto backtrace(Thread& thread, std::size_t max_depth) -> std::vector<Unwinder::Frame> {
+        std::vector<Unwinder::Frame> frames{};
+        unwinder.unwind(pid, thread.registers.get(), max_depth, frames);
+        return frames;
+    }
+
+    // 当前线程的调用栈
+    auto backtrace(std::size_t max_depth) -> std::vector<Unwinder::Frame> {
+        return backtrace(current_thread(), max_depth);
+    }
+
+    // 地址所在的 ELF 文件，没有调试信息的栈帧显示它来自哪个库
+    auto module_of(std::intptr_t addr) -> std::string {
+        return unwinder.module_path(pid, addr);
+    }
+
+public:
+    // 打印 filename 第 line 行左右的代码，上下文分别 n_context
+    auto list_source(std::string const& filename, unsigned int line, unsigned int n_context) const -> void {
+        sources.list(filename, line, n_context);
+    }
+
+public:
+    // 根据机器码地址返回函数 DIE
+    auto get_function_die_by_addr(std::intptr_t addr) const -> dwarf::die const& {
+        auto die = dwarf_index.find_function(to_link(addr));
+        if (die == nullptr) {
+            NO_DEBUG_INFORMATION("没有找到地址的调试信息");
+        }
+
+        return *die;
+    }
+
+    // 根据当前 PC 返回函数 DIE
+    auto get_function_die_by_pc() const -> dwarf::die const& {
+        auto pc = get_pc();
+        return get_function_die_by_addr(pc);
+    }
+
+    // 根据机器码地址返回行调试信息
+    auto get_line_iter_by_addr(std::intptr_t addr) const -> LineIndex::iterator {
+        auto it = dwarf_index.find_line(to_link(addr));
+        if (it.at_end()) {
+            NO_DEBUG_INFORMATION("没有找到函数的调试信息");
+        }
+
+        return it;
+    }
+
+    // 根据当前 PC 返回行调试信息
+    auto get_line_iter_by_pc() const -> LineIndex::iterator {
+        auto pc = get_pc();
+        return get_line_iter_by_addr(pc);
+    }
+
+    // 根据函数名称返回函数起始的行调试信息
+    auto get_line_iter_by_function_name(std::string const& name) const -> LineIndex::iterator {
+        auto die = get_die_by_function_name(name);
+        auto low_pc = at_low_pc(die);
+        return get_line_iter_by_addr(to_runtime(low_pc));
+    }
+
+    // 根据 文件:行号 返回该行开始处的指令地址（升序）
+    auto get_addrs_by_file_line(std::string const& file, unsigned int line) const -> std::vector<std::intptr_t> {
+        auto addrs = dwarf_index.find_addresses(file, line);
+        if (addrs.empty()) {
+            NO_DEBUG_INFORMATION("没有找到行的调试信息");
+        }
+
+        for (auto& addr : addrs) {
+            addr = to_runtime(addr);
+        }
+        return addrs;
+    }
+
+    // 解析命令中的位置：*0x 开头的指令地址、函数名或者 文件:行号，返回运行时的地址
+    // break、ftrace 和 tracepoint 共用；文件:行号 有多个地址时取最小的一个
+    // 格式不正确时抛出 exception，找不到调试信息时抛出 no_debug_information
+    auto resolve_location(std::string const& location) const -> std::intptr_t {
+        if (location.empty()) {
+            EXCEPTION("需要给出位置：*0x 开头的指令地址、函数名或者 文件:行号");
+        }
+        char *end = nullptr;
+        if (location[0] == '*') {
+            errno = 0;
+            auto addr = strtoull(location.c_str() + 1, &end, 16);
+            if (location.size() == 1 || *end != '\0' || errno != 0) {
+                EXCEPTION("地址格式不正确");
+            }
+            return static_cast<std::intptr_t>(addr);
+        }
+
+        auto pos = location.rfind(':');
+        if (pos != std::string::npos) {
+            auto text = location.c_str() + pos + 1;
+            errno = 0;
+            auto line = strtoul(text, &end, 10);
+            if (*text == '\0' || *end != '\0' || errno != 0 || line == 0 || line > UINT_MAX) {
+                EXCEPTION("行号格式不正确");
+            }
+            auto addrs = get_addrs_by_file_line(location.substr(0, pos), static_cast<unsigned int>(line));
+            if (addrs.empty()) {
+                NO_DEBUG_INFORMATION("没有找到行的调试信息");
+            }
+            return addrs.front();
+        }
+        return to_runtime(at_low_pc(get_die_by_function_name(location)));
+    }
+
+    // 根据函数名称返回 DIE 信息
+    auto get_die_by_function_name(std::string const& name) const -> dwarf::die {
+        // 先查函数名索引，第一次查找时索引可能还在建立，会等待建立完成
+        for (auto const& location : name_index.find(name)) {
+            auto die = NameIndex::resolve(dwarf, location);
+            if (die.valid() && die.tag == dwarf::DW_TAG::subprogram
+                && (die.has(dwarf::DW_AT::low_pc) || die.has(dwarf::DW_AT::ranges))) {
+                return die;
+            }
+        }
+
+        // 索引包含了所有函数，没找到就是没有
+        if (name_index.complete()) {
+            NO_DEBUG_INFORMATION("没有找到函数的调试信息");
+        }
+
+        // 索引来自 pubnames，可能缺少静态函数，遍历调试信息的每个编译单元
+        for (auto const& cu : dwarf.compilation_units()) {
+            // 遍历编译单元的每个 DWARF Information Entries
+            for (auto const& die : cu.root()) {
+                // 如果 tag 表明是函数（subprogram）、有 name 并且 name 就是要查找的函数名
+                if (die.tag == dwarf::DW_TAG::subprogram 
+                    && die.has(dwarf::DW_AT::name) 
+                    && at_name(die) == name) {
+                    // 找到了函数对应的 DIE
+                    return die;
+                }
+            }
+        }
+
+        NO_DEBUG_INFORMATION("没有找到函数的调试信息");
+    }
+
+    // 返回名称中能找到 pattern 的所有带起始地址的函数 DIE，每个函数只出现一次
+    auto get_dies_by_function_regex(std::regex const& pattern) const -> std::vector<dwarf::die> {
+        std::vector<dwarf::die> dies{};
+        std::set<dwarf::section_offset> seen{};
+        auto add = [&](dwarf::die const& die) {
+            if (die.valid() && die.tag == dwarf::DW_TAG::subprogram && die.has(dwarf::DW_AT::low_pc)
+                && seen.insert(die.get_section_offset()).second) {
+                dies.push_back(die);
+            }
+        };
+
+        for (auto const& location : name_index.match(pattern)) {
+            add(NameIndex::resolve(dwarf, location));
+        }
+
+        // 索引来自 pubnames 时可能缺少静态函数，再遍历每个编译单元
+        if (!name_index.complete()) {
+            for (auto const& cu : dwarf.compilation_units()) {
+                for (auto const& die : cu.root()) {
+                    if (die.tag == dwarf::DW_TAG::subprogram && die.has(dwarf::DW_AT::name)
+                        && std::regex_search(at_name(die), pattern)) {
+                        add(die);
+                    }
+                }
+            }
+        }
+        return dies;
+    }
+
+    // 根据全局变量名称返回变量的地址和大小
+    // 只支持位置是 DW_OP_addr 的变量，也就是全局变量和静态变量
+    auto get_variable_by_name(std::string const& name) const -> std::pair<std::intptr_t, std::size_t> {
+        static const uint8_t DW_OP_addr = 0x03;
+        for (auto const& cu : dwarf.compilation_units()) {
+            for (auto const& die : cu.root()) {
+                if (die.tag != dwarf::DW_TAG::variable || !die.has(dwarf::DW_AT::name)
+                    || !die.has(dwarf::DW_AT::location) || at_name(die) != name) {
+                    continue;
+                }
+
+                std::size_t size = 0;
+                auto const *expr = static_cast<uint8_t const *>(die[dwarf::DW_AT::location].as_block(&size));
+                if (size != 1 + sizeof(uint64_t) || expr[0] != DW_OP_addr) {
+                    continue;
+                }
+                uint64_t addr;
+                memcpy(&addr, expr + 1, sizeof(addr));
+                return {to_runtime(static_cast<std::intptr_t>(addr)), type_size(die)};
+            }
+        }
+
+        NO_DEBUG_INFORMATION("没有找到变量的调试信息");
+    }
+
+private:
+    // 沿着 DW_AT_type（typedef、const 等）找到类型的大小，找不到时返回 0
+    static auto type_size(dwarf::die const& die) -> std::size_t {
+        auto current = die;
+        for (auto depth = 0; depth < 8 && current.valid(); ++depth) {
+            if (current.has(dwarf::DW_AT::byte_size)) {
+                return current[dwarf::DW_AT::byte_size].as_uconstant();
+            }
+            if (!current.has(dwarf::DW_AT::type)) {
+                break;
+            }
+            current = current[dwarf::DW_AT::type].as_reference();
+        }
+        return 0;
+    }
+
+private:
+    // 将 inferior 的状态重置
+    auto reset() -> void {
+        // 将已设置的断点全部清空，用户的断点只剩下运行之前记录的
+        breakpoints.clear();
+        user_breakpoints = breakpoint_addrs_to_set;
+        // 调试寄存器和软件观察点换回链接地址，下次运行时按新的装载偏移换算
+        debug_registers.rebase(-load_bias);
+        page_watcher.rebase(-load_bias);
+        load_bias = 0;
+        armed_plan = ArmedStepPlan{nullptr, 0, 0, 0, {}};
+        threads.clear();
+        current_tid = -1;
+        is_all_running = false;
+        page_watcher.clear_protections();
+        displaced.reset();
+        unwinder.reset();
+        call_tracer.reset();
+        syscall_catcher.reset();
+        tracepoints.reset();
+        // tracee 结束后共享内存还在，读出最后的记录
+        fast_tracer.drain();
+        fast_tracer.reset();
+        PtraceProxy::release_memory(pid);
+        pid = -1;
+        is_running = false;
+        is_attached = false;
+    }
+
+    // 单步的循环在 tracee 结束、收到信号、观察点触发、别的线程停下或者用户打断时停下
+    auto keep_stepping() const -> bool {
+        return running() && current_thread().pending_signal == 0 && !is_watch_triggered && !is_focus_changed && !is_interrupted;
+    }
+
+    auto add_debug_register(std::intptr_t addr, DebugRegisters::Kind kind, std::size_t len) -> int {
+        auto slot = debug_registers.add(addr, kind, len);
+        if (!running()) {
+            // tracee 开始运行时统一写入调试寄存器
+            return slot;
+        }
+
+        // 只能修改停下的线程的调试寄存器，非停止模式下先暂停还在运行的线程
+        auto paused = pause_threads();
+        try {
+            install_debug_registers();
+        } catch (exception const& exc) {
+            debug_registers.remove(slot);
+            install_debug_registers();
+            resume_threads(paused);
+            throw;
+        }
+        resume_threads(paused);
+        watched_values[slot] = read_watched_value(slot);
+        return slot;
+    }
+
+    // 读取观察点当前的值，最多 8 字节
+    auto read_watched_value(int slot) const -> uint64_t {
+        auto const& s = debug_registers.slot(slot);
+        uint64_t value = 0;
+        if (s.kind != DebugRegisters::Kind::execute) {
+            PtraceProxy::read_memory(pid, s.addr, &value, s.len);
+        }
+        return value;
+    }
+
+    // 调试寄存器是每个线程各自的，新线程也不会继承，写入所有已经开始运行的线程
+    auto install_debug_registers() -> void {
+        for (auto& item : threads) {
+            if (!item.second.is_starting) {
+                debug_registers.install(item.first);
+            }
+        }
+    }
+
+    auto thread_registers() const -> RegisterCache& {
+        return current_thread().registers;
+    }
+
+    // 恢复运行前写回修改过的寄存器，恢复运行后缓存失效
+    auto prepare_resume(Thread& thread) -> void {
+        auto& regs = thread.registers;
+        // 停在硬件断点上时，设置 RF 才能执行过这条指令
+        // 被 PTRACE_INTERRUPT 停下的线程还没有报告过这个断点，不能跳过
+        if (!debug_registers.empty() && thread.reason != Thread::StopReason::interrupt
+            && debug_registers.find(regs.pc(), DebugRegisters::Kind::execute) >= 0) {
+            regs.set_resume_flag();
+        }
+        regs.flush();
+        regs.invalidate();
+    }
+
+    auto prepare_resume() -> void {
+        prepare_resume(current_thread());
+    }
+
+    // 恢复一个线程的运行，step 为 true 时只执行一条指令
+    // 继续运行时把停下时收到的信号发送给线程，单步时信号留到之后继续运行时再发送
+    auto resume_thread(Thread& thread, bool step) -> void {
+        prepare_resume(thread);
+        if (step) {
+            // 从系统调用的入口单步会直接执行完系统调用，不会再有返回的停止
+            syscall_catcher.drop(thread.tid);
+            PtraceProxy::single_step(thread.tid);
+        } else if (syscall_catcher.in_syscall(thread.tid)) {
+            // 停在捕获的系统调用入口，下一次停止是系统调用返回
+            PtraceProxy::syscall_tracee(thread.tid, thread.pending_signal);
+            thread.pending_signal = 0;
+        } else {
+            PtraceProxy::delivery_signal_tracee(thread.tid, thread.pending_signal);
+            thread.pending_signal = 0;
+        }
+        thread.is_running = true;
+        thread.is_stepping = step;
+    }
+
+    // 恢复所有停下的线程，当前线程由调用者先越过断点
+    auto resume_all_threads() -> void {
+        is_all_running = true;
+        // 停在已经报告过的断点上的其他线程，恢复运行后马上又会停在这里，先让它们越过断点
+        std::vector<pid_t> on_breakpoint{};
+        for (auto& item : threads) {
+            auto& thread = item.second;
+            if (thread.tid != current_tid && !thread.is_running && !thread.is_starting && is_on_reported_breakpoint(thread)) {
+                on_breakpoint.push_back(thread.tid);
+            }
+        }
+        for (auto tid : on_breakpoint) {
+            auto thread = threads.find(tid);
+            if (running() && thread != nullptr) {
+                step_thread_over_breakpoint(*thread);
+            }
+        }
+
+        for (auto& item : threads) {
+            auto& thread = item.second;
+            if (!thread.is_running && !thread.is_starting) {
+                resume_thread(thread, false);
+            }
+        }
+    }
+
+    auto any_thread_running() -> bool {
+        for (auto const& item : threads) {
+            if (item.second.is_running) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 让所有还在运行的线程停下
+    auto stop_all_threads() -> void {
+        is_all_running = false;
+        pause_threads();
+    }
+
+    // 暂停所有还在运行的线程，返回被暂停的线程，之后交给 resume_threads 恢复
+    // 先给每个线程发出 PTRACE_INTERRUPT 再统一收集停止，不会一个线程一个线程地等
+    auto pause_threads() -> std::vector<pid_t> {
+        std::vector<pid_t> paused{};
+        for (auto& item : threads) {
+            auto& thread = item.second;
+            if (!thread.is_running) {
+                continue;
+            }
+            paused.push_back(thread.tid);
+            if (!thread.is_interrupting) {
+                PtraceProxy::interrupt(thread.tid);
+                thread.is_interrupting = true;
+            }
+        }
+
+        while (running() && any_thread_running()) {
+            int status;
+            auto tid = waitpid(-1, &status, __WALL);
+            if (tid == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                reset();
+                break;
+            }
+            if (handle_thread_exit(tid, status)) {
+                continue;
+            }
+
+            auto& thread = threads.add(tid);
+            thread.is_running = false;
+            thread.reason = Thread::StopReason::interrupt;
+            switch (status >> 16) {
+            case 0:
+                if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+                    finish_syscall(thread);
+                } else {
+                    record_stop_signal(thread);
+                }
+                break;
+            case PTRACE_EVENT_STOP:
+                if (thread.is_starting) {
+                    thread_started(thread);
+                } else {
+                    // 也可能是 group-stop，这时发出的请求在线程下次恢复运行后才生效
+                    thread.is_interrupting = false;
+                }
+                break;
+            case PTRACE_EVENT_SECCOMP:
+                // 暂停期间不能停下报告，进入时要停下的系统调用也只记录，返回时打印
+                start_syscall(thread);
+                break;
+            default:
+                // PTRACE_EVENT_CLONE 之类的事件停止，同样算作已经停下
+                // PTRACE_INTERRUPT 在线程下次恢复运行后才生效，由 handle_thread_event 处理
+                handle_clone(thread, status);
+                break;
+            }
+        }
+        return paused;
+    }
+
+    // 恢复被 pause_threads 暂停的线程，按它们原来的方式继续运行
+    auto resume_threads(std::vector<pid_t> const& paused) -> void {
+        for (auto tid : paused) {
+            auto thread = threads.find(tid);
+            if (running() && thread != nullptr && !thread->is_running && !thread->is_starting) {
+                resume_thread(*thread, thread->is_stepping);
+            }
+        }
+    }
+
+    // 停止其他线程的过程中，线程因为信号停下了
+    // 断点和被保护的页在线程恢复运行后还会再次触发，这里不报告，只记下需要发送的信号
+    auto record_stop_signal(Thread& thread) -> void {
+        auto siginfo = PtraceProxy::get_signal_info(thread.tid);
+        if (siginfo.si_signo == SIGTRAP) {
+            if (!debug_registers.empty() && (siginfo.si_code == TRAP_HWBKPT || siginfo.si_code == TRAP_TRACE)) {
+                auto slot = DebugRegisters::triggered(thread.tid);
+                // 写入已经发生了，观察点不会再次触发，现在就报告
+                if (slot >= 0 && debug_registers.slot(slot).kind != DebugRegisters::Kind::execute) {
+                    printf("\n[线程 %d (LWP %d)]", thread.number, thread.tid);
+                    handle_debug_register_trap(thread, slot);
+                }
+                if (slot >= 0) {
+                    return;
+                }
+            }
+            if (siginfo.si_code == SI_KERNEL || siginfo.si_code == TRAP_BRKPT) {
+                // PC 回退到断点处，恢复运行后重新执行 0xCC
+                auto pc = thread.registers.pc();
+                auto it = breakpoints.find(pc - 1);
+                if (it != breakpoints.end() && it->second.enabled()) {
+                    thread.registers.set_pc(pc - 1);
+                }
+            }
+            return;
+        }
+
+        if (siginfo.si_signo == SIGSEGV && siginfo.si_code == SEGV_ACCERR
+            && page_watcher.is_protected(reinterpret_cast<std::intptr_t>(siginfo.si_addr))) {
+            return;
+        }
+        // 调试器自己也收到了这次 Ctrl-C，正在因为它让线程停下，信号不再投递给 tracee
+        if (is_terminal_interrupt(siginfo)) {
+            return;
+        }
+        thread.pending_signal = siginfo.si_signo;
+        thread.reason = Thread::StopReason::signal;
+    }
+
+    // 新线程报告第一次停止之前不能对它做 ptrace 操作，脱离之前等它们停下
+    auto wait_starting_threads() -> void {
+        for (auto& item : threads) {
+            auto& thread = item.second;
+            int status;
+            while (running() && thread.is_starting && waitpid(thread.tid, &status, __WALL) == -1 && errno == EINTR) {
+            }
+            thread.is_starting = false;
+        }
+    }
+
+    // 进程现有的所有线程
+    static auto tasks_of(pid_t target) -> std::vector<pid_t> {
+        std::vector<pid_t> tids{};
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/task", target);
+        auto dir = opendir(path);
+        if (dir == nullptr) {
+            return tids;
+        }
+        while (auto entry = readdir(dir)) {
+            if (entry->d_name[0] != '.') {
+                tids.push_back(atoi(entry->d_name));
+            }
+        }
+        closedir(dir);
+        std::sort(tids.begin(), tids.end());
+        return tids;
+    }
+
+    // 线程结束时从线程表中删除，主线程结束表示整个 tracee 结束了
+    // 不是结束事件返回 false
+    auto handle_thread_exit(pid_t tid, int status) -> bool {
+        if (!WIFEXITED(status) && !WIFSIGNALED(status)) {
+            return false;
+        }
+        if (tid == pid) {
+            handle_exit(status);
+            return true;
+        }
+
+        threads.remove(tid);
+        if (tid == current_tid) {
+            current_tid = pid;
+            is_focus_changed = true;
+            printf("[当前线程 (LWP %d) 已结束，切换到主线程]\n", tid);
+        }
+        return true;
+    }
+
+    // 新线程第一次停下，从这之后才可以对它做 ptrace 操作
+    auto thread_started(Thread& thread) -> void {
+        thread.is_starting = false;
+        if (!debug_registers.empty()) {
+            debug_registers.install(thread.tid);
+        }
+        printf("[新线程 %d (LWP %d)]\n", thread.number, thread.tid);
+    }
+
+    // PTRACE_EVENT_CLONE：把新线程加入线程表，新线程的第一次停止可能在这之前已经收到了
+    auto handle_clone(Thread& parent, int status) -> void {
+        if ((status >> 16) == PTRACE_EVENT_CLONE) {
+            threads.add(PtraceProxy::get_event_message(parent.tid));
+        }
+    }
+
+    // 处理 PTRACE_EVENT_* 停止，处理完后线程按原来的方式恢复运行
+    // 信号停止返回 false，交给调用者处理
+    auto handle_thread_event(Thread& thread, int status) -> bool {
+        switch (status >> 16) {
+        case 0:
+            return false;
+        case PTRACE_EVENT_STOP:
+            if (thread.is_starting) {
+                thread_started(thread);
+                // 全停止模式下其他线程都停着的时候，新线程也先停着，之后和其他线程一起恢复运行
+                if (!is_all_running && !is_non_stop) {
+                    return true;
+                }
+            } else if (thread.is_interrupting) {
+                // 之前停止所有线程时发出的 PTRACE_INTERRUPT 现在才生效
+                thread.is_interrupting = false;
+            }
+            // 不是上面两种情况就是 group-stop，不支持作业控制，直接继续运行
+            break;
+        default:
+            handle_clone(thread, status);
+            break;
+        }
+
+        resume_thread(thread, thread.is_stepping);
+        return true;
+    }
+
+    // 等待线程的事件，直到有需要报告的停止或者 tracee 结束
+    // 新线程、迟到的 PTRACE_INTERRUPT、别的线程碰到单步用的临时断点等在这里处理，调用者感觉不到
+    // 非停止模式下执行单步命令时，别的线程停下只报告，继续等待当前线程
+    auto handle_wait_signal_and_exit() -> void {
+        auto waiting_tid = current_tid;
+        while (true) {
+            // 只单步一个线程时，这个线程结束后没有可以等待的事件了
+            if (!any_thread_running()) {
+                return;
+            }
+
+            int status;
+            auto tid = wait_next(status);
+            if (tid == 0) {
+                // 用户按下了 Ctrl-C 或者运行超时
+                interrupt_threads();
+                return;
+            }
+            if (tid == -1) {
+                if (errno != EINTR) {
+                    reset();
+                    return;
+                }
+                // 采样的定时器到期打断了等待
+                if (profiler != nullptr && profiler->take_tick()) {
+                    if (profiler->expired()) {
+                        stop_all_threads();
+                        return;
+                    }
+                    sample_threads();
+                }
+                continue;
+            }
+            if (handle_wait_status(tid, status, waiting_tid)) {
+                return;
+            }
+        }
+    }
+
+    // 取下一个线程状态变化，没有时在事件循环上等待，不会一直阻塞在 waitpid 中
+    // 返回 0 表示用户按下了 Ctrl-C 或者运行超时；返回 -1 并且 errno 为 EINTR 表示被采样的定时器打断
+    auto wait_next(int& status) -> pid_t {
+        while (true) {
+            auto tid = waitpid(-1, &status, __WALL | WNOHANG);
+            if (tid != 0) {
+                return tid;
+            }
+            switch (events.wait(false, fast_tracer.prepared() ? 100 : -1)) {
+            case EventLoop::Event::interrupt:
+                printf("\n[被 Ctrl-C 打断]\n");
+                return 0;
+            case EventLoop::Event::timer:
+                printf("\n[运行超时]\n");
+                return 0;
+            case EventLoop::Event::signal:
+                errno = EINTR;
+                return -1;
+            case EventLoop::Event::idle:
+                // 等待期间读出快速跟踪点的记录，避免环形缓冲区写满
+                fast_tracer.drain();
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // 用 PTRACE_INTERRUPT 让所有线程停下，正在进行的单步和后台运行都结束，打印当前线程停在哪里
+    auto interrupt_threads() -> void {
+        stop_all_threads();
+        is_interrupted = true;
+        is_background = false;
+        if (!running() || threads.find(current_tid) == nullptr) {
+            return;
+        }
+        auto& thread = current_thread();
+        printf("线程 %d (LWP %d) 停在 %s\n", thread.number, thread.tid, describe_addr(get_pc()).c_str());
+    }
+
+    // 处理一个线程的状态变化，返回 true 时等待结束：waiting_tid 结束了、tracee 结束了或者有停止报告了
+    // 其余的情况（内部断点、跟踪、捕获的系统调用、非停止模式下停放的线程）处理后线程继续运行或者停着，返回 false
+    auto handle_wait_status(pid_t tid, int status, pid_t waiting_tid) -> bool {
+        if (handle_thread_exit(tid, status)) {
+            return !running() || tid == waiting_tid;
+        }
+
+        // 新线程的第一次停止可能比创建它的线程的 PTRACE_EVENT_CLONE 先到
+        auto *thread = &threads.add(tid);
+        thread->is_running = false;
+        if (is_syscall_stop(status)) {
+            if (handle_syscall_stop(*thread, status)) {
+                return false;
+            }
+            if (should_park(*thread, waiting_tid)) {
+                printf("\n[线程 %d (LWP %d) 停下]\n", thread->number, tid);
+                print_syscall_entry(*thread);
+                return false;
+            }
+            report_stop(*thread);
+            if (running()) {
+                print_syscall_entry(current_thread());
+            }
+            return true;
+        }
+        if (handle_thread_event(*thread, status)) {
+            return false;
+        }
+
+        auto siginfo = PtraceProxy::get_signal_info(tid);
+        // 软件观察点的页被写入，没有写到观察的区间时直接继续运行
+        auto was_watch_triggered = is_watch_triggered;
+        if (siginfo.si_signo == SIGSEGV && handle_watch_fault(*thread, siginfo)) {
+            thread = threads.find(tid);
+            if (!running() || thread == nullptr) {
+                return true;
+            }
+            if (!is_watch_triggered && !(is_single_stepping && tid == waiting_tid) && thread->pending_signal == 0) {
+                resume_thread(*thread, false);
+                return false;
+            }
+            if (should_park(*thread, waiting_tid)) {
+                printf("[线程 %d (LWP %d) 停下]\n", thread->number, tid);
+                is_watch_triggered = was_watch_triggered;
+                return false;
+            }
+            report_stop(*thread);
+            return true;
+        }
+
+        if (handle_agent_ready(*thread, siginfo)) {
+            return !running();
+        }
+
+        if (handle_tracepoint_hit(*thread, siginfo)) {
+            return !running();
+        }
+
+        if (handle_traced_call(*thread, siginfo)) {
+            return !running();
+        }
+
+        if (step_over_internal_breakpoint(*thread, siginfo)) {
+            return !running();
+        }
+
+        if (should_park(*thread, waiting_tid)) {
+            park_thread(*thread, siginfo);
+            return false;
+        }
+
+        report_stop(*thread);
+        if (running()) {
+            handle_stop_signal(current_thread(), siginfo);
+        }
+        return true;
+    }
+
+    // 暂停所有运行中的线程，回溯每个线程的调用栈后立即按原来的方式恢复运行
+    // 暂停期间碰到断点或者收到信号的线程由 pause_threads 记下，恢复运行后照常报告
+    auto sample_threads() -> void {
+        Stopwatch stopwatch{};
+        std::vector<Unwinder::Frame> frames{};
+        auto paused = pause_threads();
+        for (auto tid : paused) {
+            auto thread = threads.find(tid);
+            if (running() && thread != nullptr && !thread->is_running && !thread->is_starting) {
+                unwinder.unwind(pid, thread->registers.get(), Profiler::max_depth, frames);
+                profiler->sample(frames);
+            }
+        }
+        resume_threads(paused);
+        profiler->add_pause(stopwatch.elapsed_ms());
+    }
+
+    // 捕获系统调用产生的停止：PTRACE_EVENT_SECCOMP 是系统调用的入口，SIGTRAP | 0x80 是 PTRACE_SYSCALL 之后的返回
+    static auto is_syscall_stop(int status) -> bool {
+        return WIFSTOPPED(status)
+            && ((status >> 16) == PTRACE_EVENT_SECCOMP || WSTOPSIG(status) == (SIGTRAP | 0x80));
+    }
+
+    // 不需要停下时记录后直接恢复运行，返回 true；进入时要停下的系统调用返回 false，由调用者报告
+    auto handle_syscall_stop(Thread& thread, int status) -> bool {
+        if ((status >> 16) == PTRACE_EVENT_SECCOMP) {
+            // 单步的线程碰到系统调用，继续单步，不记录
+            if (!thread.is_stepping && start_syscall(thread) == SyscallCatcher::Mode::stop) {
+                thread.reason = Thread::StopReason::syscall;
+                return false;
+            }
+        } else {
+            finish_syscall(thread);
+        }
+        resume_thread(thread, thread.is_stepping);
+        return true;
+    }
+
+    // 线程停在系统调用的入口，关心这个系统调用时记下参数，返回这个系统调用的捕获方式
+    auto start_syscall(Thread& thread) -> SyscallCatcher::Mode {
+        auto const& regs = thread.registers.get();
+        auto nr = static_cast<long>(regs.orig_rax);
+        auto mode = syscall_catcher.mode_of(nr);
+        if (mode != SyscallCatcher::Mode::none) {
+            uint64_t args[6] = {regs.rdi, regs.rsi, regs.rdx, regs.r10, regs.r8, regs.r9};
+            syscall_catcher.enter(thread.tid, nr, args);
+        }
+        return mode;
+    }
+
+    // 线程从系统调用返回，记下耗时，打印调用和返回值
+    auto finish_syscall(Thread& thread) -> void {
+        auto result = static_cast<long>(thread.registers.get().rax);
+        SyscallCatcher::Call call;
+        uint64_t ns = 0;
+        if (!syscall_catcher.leave(thread.tid, result, call, ns)
+            || syscall_catcher.mode_of(call.nr) == SyscallCatcher::Mode::none) {
+            return;
+        }
+        printf("[LWP %d] %s = %s <%.1f us>\n", thread.tid, SyscallTable::format_call(pid, call.nr, call.args).c_str(),
+            SyscallTable::format_result(call.nr, result).c_str(), ns / 1000.0);
+    }
+
+    // 线程停在捕获的系统调用的入口
+    auto print_syscall_entry(Thread& thread) -> void {
+        auto const& regs = thread.registers.get();
+        uint64_t args[6] = {regs.rdi, regs.rsi, regs.rdx, regs.r10, regs.r8, regs.r9};
+        printf("捕获系统调用 %s\n", SyscallTable::format_call(pid, static_cast<long>(regs.orig_rax), args).c_str());
+    }
+
+    // 非停止模式下，单步命令只等待当前线程，别的线程的停止不打断它
+    auto should_park(Thread const& thread, pid_t waiting_tid) const -> bool {
+        return is_non_stop && !is_waiting_any && thread.tid != waiting_tid;
+    }
+
+    // 只有这一个线程停下，打印停止的原因，当前线程不变
+    auto park_thread(Thread& thread, siginfo_t const& siginfo) -> void {
+        auto was_quiet = is_quiet;
+        auto was_watch_triggered = is_watch_triggered;
+        is_quiet = false;
+        printf("\n[线程 %d (LWP %d) 停下]\n", thread.number, thread.tid);
+        handle_stop_signal(thread, siginfo);
+        is_quiet = was_quiet;
+        is_watch_triggered = was_watch_triggered;
+    }
+
+    // 有线程的停止需要报告，把当前线程切换到这个线程
+    // 全停止模式下其他线程也停下，非停止模式下其他线程继续运行
+    auto report_stop(Thread& thread) -> void {
+        auto tid = thread.tid;
+        if (!is_non_stop) {
+            stop_all_threads();
+        }
+        if (!running() || threads.find(tid) == nullptr || tid == current_tid) {
+            return;
+        }
+        current_tid = tid;
+        is_focus_changed = true;
+        printf("[切换到线程 %d (LWP %d)]\n", thread.number, tid);
+    }
+
+    // 在跟踪的函数的入口设置断点，已经设置过的入口不会重复设置
+    auto install_call_entries() -> void {
+        std::set<std::intptr_t> addrs{};
+        for (auto const& func : call_tracer.all()) {
+            addrs.insert(to_runtime(func.low_pc));
+        }
+        own_call_breakpoints(addrs);
+    }
+
+    // 跟踪用的断点，地址上已经有单步计划的断点时转为跟踪所有，撤销单步计划时不再删除
+    auto own_call_breakpoints(std::set<std::intptr_t> const& addrs) -> void {
+        auto& owned = call_tracer.owned_breakpoints();
+        for (auto addr : addrs) {
+            if (armed_plan.owned.erase(addr)) {
+                owned.insert(addr);
+            }
+        }
+        auto added = set_breakpoints_at_addrs(addrs);
+        owned.insert(added.begin(), added.end());
+    }
+
+    // 线程碰到了函数调用跟踪的断点：记下进入或者返回，越过断点后继续运行，不回到命令行
+    // 同一地址上还有用户的断点或者当前线程的单步计划要停下时，记录之后照常报告
+    auto handle_traced_call(Thread& thread, siginfo_t const& siginfo) -> bool {
+        if (!call_tracer.active() || siginfo.si_signo != SIGTRAP
+            || (siginfo.si_code != SI_KERNEL && siginfo.si_code != TRAP_BRKPT)
+            || (is_single_stepping && thread.tid == current_tid)) {
+            return false;
+        }
+        auto addr = thread.registers.pc() - 1;
+        auto it = breakpoints.find(addr);
+        if (it == breakpoints.end() || !it->second.enabled()) {
+            return false;
+        }
+
+        auto rsp = static_cast<std::intptr_t>(thread.registers.get().rsp);
+        std::size_t index;
+        auto is_entry = call_tracer.find_entry(to_link(addr), index);
+        auto is_return = call_tracer.has_return_site(addr);
+        if (!is_entry && !is_return) {
+            return false;
+        }
+        // 返回地址也可能是另一个跟踪的函数的入口（例如紧跟在不返回的调用之后），先结束上一次调用
+        if (is_return) {
+            call_tracer.leave(thread.tid, rsp);
+        }
+        if (is_entry) {
+            // 刚执行完 call，栈顶是返回地址
+            uint64_t return_address = 0;
+            if (PtraceProxy::read_memory(pid, rsp, &return_address, sizeof(return_address)) == sizeof(return_address)) {
+                call_tracer.enter(thread.tid, index, rsp + sizeof(return_address));
+                auto site = static_cast<std::intptr_t>(return_address);
+                if (!call_tracer.has_return_site(site)) {
+                    call_tracer.add_return_site(site);
+                    own_call_breakpoints({site});
+                }
+            }
+        }
+
+        if (user_breakpoints.count(addr) || (thread.tid == current_tid && is_step_plan_addr(addr))) {
+            return false;
+        }
+        thread.registers.set_pc(addr);
+        if (step_thread_over_breakpoint(thread)) {
+            resume_thread(thread, false);
+        }
+        return true;
+    }
+
+    // 跟踪点用的断点，和 own_call_breakpoints 一样接管单步计划已经设置的断点
+    auto own_tracepoint_breakpoints(std::set<std::intptr_t> const& addrs) -> void {
+        auto& owned = tracepoints.owned_breakpoints();
+        for (auto addr : addrs) {
+            if (armed_plan.owned.erase(addr)) {
+                owned.insert(addr);
+            }
+        }
+        auto added = set_breakpoints_at_addrs(addrs);
+        owned.insert(added.begin(), added.end());
+    }
+
+    // addr 是函数调用跟踪的入口或者返回地址
+    auto is_call_trace_site(std::intptr_t addr) const -> bool {
+        std::size_t index;
+        return call_tracer.find_entry(to_link(addr), index) || call_tracer.has_return_site(addr);
+    }
+
+    // 线程碰到了跟踪点：一次读寄存器、一次读内存，记录追加到文件后越过断点继续运行
+    // 同一地址上还有函数调用跟踪、用户的断点或者当前线程的单步计划时，收集之后交给它们处理
+    auto handle_tracepoint_hit(Thread& thread, siginfo_t const& siginfo) -> bool {
+        if (!tracepoints.active() || siginfo.si_signo != SIGTRAP
+            || (siginfo.si_code != SI_KERNEL && siginfo.si_code != TRAP_BRKPT)
+            || (is_single_stepping && thread.tid == current_tid)) {
+            return false;
+        }
+        auto addr = thread.registers.pc() - 1;
+        auto it = breakpoints.find(addr);
+        std::size_t id;
+        if (it == breakpoints.end() || !it->second.enabled() || !tracepoints.find(to_link(addr), id)) {
+            return false;
+        }
+
+        auto const& regs = thread.registers.get();
+        auto& tp = tracepoints.all()[id];
+        std::vector<TraceFile::Item> items{};
+        for (auto const& item : tp.items) {
+            switch (item.kind) {
+            case Tracepoints::Item::Kind::registers:
+                items.push_back(TraceFile::Item{TraceFile::registers, 0, 0});
+                break;
+            case Tracepoints::Item::Kind::memory:
+                items.push_back(TraceFile::Item{TraceFile::memory, item.addr, item.len});
+                break;
+            case Tracepoints::Item::Kind::relative:
+                items.push_back(TraceFile::Item{TraceFile::memory,
+                    static_cast<std::intptr_t>(TraceFile::register_value(regs, item.reg)) + item.addr, item.len});
+                break;
+            case Tracepoints::Item::Kind::variable:
+                items.push_back(TraceFile::Item{TraceFile::memory, to_runtime(item.addr), item.len});
+                break;
+            }
+        }
+        // 寄存器中的 PC 还在断点之后，记录的是断点的地址
+        auto saved = regs;
+        saved.rip = static_cast<unsigned long long>(addr);
+        ++tp.hits;
+        tracepoints.trace_file().append_hit(pid, static_cast<uint32_t>(id), static_cast<uint32_t>(thread.tid), addr,
+            saved, items);
+
+        if (is_call_trace_site(addr) || user_breakpoints.count(addr)
+            || (thread.tid == current_tid && is_step_plan_addr(addr))) {
+            return false;
+        }
+        thread.registers.set_pc(addr);
+        if (step_thread_over_breakpoint(thread)) {
+            resume_thread(thread, false);
+        }
+        return true;
+    }
+
+    // addr 是已经布置的单步计划要停下的地址
+    auto is_step_plan_addr(std::intptr_t addr) const -> bool {
+        if (armed_plan.plan == nullptr) {
+            return false;
+        }
+        if (addr == armed_plan.return_address) {
+            return true;
+        }
+        auto it = armed_plan.plan->line_addrs.find(to_link(addr));
+        return it != armed_plan.plan->line_addrs.end() && it->second != armed_plan.line;
+    }
+
+    // agent 加载完成后用 raise(SIGTRAP) 通知调试器：安装快速跟踪点，不把 SIGTRAP 发给 tracee
+    auto handle_agent_ready(Thread& thread, siginfo_t const& siginfo) -> bool {
+        if (siginfo.si_signo != SIGTRAP || siginfo.si_code != SI_TKILL || siginfo.si_pid != pid
+            || !fast_tracer.take_handshake()) {
+            return false;
+        }
+        if (fast_tracer.pending()) {
+            try {
+                install_fast_tracepoints(thread);
+            } catch (exception const& exc) {
+                printf("** 安装快速跟踪点失败: %s **\n", exc.reason.c_str());
+            }
+            if (!running()) {
+                return true;
+            }
+        }
+        resume_thread(thread, false);
+        return true;
+    }
+
+    // 在 tracee 中安装还没有安装的快速跟踪点：蹦床写入跟踪点附近的蹦床页，再把跟踪点处的指令换成 jmp
+    // 改写期间其他线程先暂停，PC 落在要换掉的指令中间的跟踪点这次不安装
+    auto install_fast_tracepoints(Thread& thread) -> void {
+        // 通知用的 SIGTRAP 可能在暂停线程时被丢掉了，之后的 SIGTRAP 都不再当作通知
+        fast_tracer.take_handshake();
+        auto paused = pause_threads();
+        for (std::size_t id = 0; running() && id < fast_tracer.all().size(); ++id) {
+            auto& site = fast_tracer.all()[id];
+            if (site.attempted) {
+                continue;
+            }
+            site.attempted = true;
+            std::string reason{};
+            if (!install_fast_tracepoint(thread, static_cast<int>(id), reason)) {
+                printf("** 快速跟踪点 %zu (%s) 没有安装: %s **\n", id, site.location.c_str(), reason.c_str());
+            }
+        }
+        resume_threads(paused);
+    }
+
+    auto install_fast_tracepoint(Thread& thread, int id, std::string& reason) -> bool {
+        auto& site = fast_tracer.all()[id];
+        auto addr = to_runtime(site.addr);
+        uint8_t code[X86Decoder::max_length * 2];
+        auto size = PtraceProxy::read_memory(pid, addr, code, sizeof(code));
+        if (size < FastTracer::jump_size) {
+            reason = "无法读取指令";
+            return false;
+        }
+
+        auto slot = fast_tracer.take_slot(addr);
+        if (slot == 0) {
+            auto page = map_trampoline_page(thread, addr);
+            if (page == 0) {
+                reason = "无法在附近映射蹦床页";
+                return false;
+            }
+            fast_tracer.add_page(page);
+            slot = fast_tracer.take_slot(addr);
+        }
+
+        if (!install_fast_tracepoint_at(id, addr, slot, code, size, reason)) {
+            fast_tracer.release_slot(slot);
+            return false;
+        }
+        return true;
+    }
+
+    // 生成 slot 处的蹦床，检查通过后写入蹦床和 addr 处的跳转
+    auto install_fast_tracepoint_at(int id, std::intptr_t addr, std::intptr_t slot, uint8_t const *code, std::size_t size,
+        std::string& reason) -> bool {
+        auto& site = fast_tracer.all()[id];
+        FastTracer::Trampoline trampoline;
+        if (!fast_tracer.build(id, addr, slot, code, size, trampoline, reason)) {
+            return false;
+        }
+        auto end = addr + static_cast<std::intptr_t>(trampoline.covered);
+        for (auto at = addr; at < end; ++at) {
+            if (breakpoints.count(at)) {
+                reason = "换掉的指令上有断点";
+                return false;
+            }
+        }
+        for (auto& item : threads) {
+            auto pc = item.second.registers.pc();
+            if (!item.second.is_running && !item.second.is_starting && pc > addr && pc < end) {
+                reason = "有线程停在换掉的指令中间";
+                return false;
+            }
+        }
+        if (trampoline.instructions > 1 && !no_jump_into(addr, end, reason)) {
+            return false;
+        }
+
+        auto jump = FastTracer::jump(addr, slot, trampoline.covered);
+        if (PtraceProxy::patch_memory(pid, slot, trampoline.code.data(), trampoline.code.size()) != trampoline.code.size()
+            || PtraceProxy::patch_memory(pid, addr, jump.data(), jump.size()) != jump.size()) {
+            reason = "写入 tracee 内存失败";
+            return false;
+        }
+        site.original.assign(code, code + trampoline.covered);
+        site.installed = true;
+        displaced.forget(addr);
+        return true;
+    }
+
+    // 换掉了多条指令时，把所在函数解码一遍，确认没有直接跳转、调用的目标落在 (addr, end) 中，
+    // 否则跳过去会落在 jmp 的中间；跳转表之类的间接跳转看不到目标，函数中有间接跳转或者无法解码时不能确认，一律拒绝
+    auto no_jump_into(std::intptr_t addr, std::intptr_t end, std::string& reason) -> bool {
+        std::vector<std::pair<std::intptr_t, std::intptr_t>> ranges{};
+        try {
+            for (auto const& range : die_pc_range(get_function_die_by_addr(addr))) {
+                ranges.push_back({to_runtime(range.low), to_runtime(range.high)});
+            }
+        } catch (no_debug_information const& exc) {
+            reason = "没有所在函数的调试信息，无法确认换掉的指令中间不是跳转目标";
+            return false;
+        }
+
+        for (auto const& range : ranges) {
+            auto low = range.first;
+            std::vector<uint8_t> code(range.second - low);
+            code.resize(PtraceProxy::read_memory(pid, low, code.data(), code.size()));
+            // 读到的是被 0xCC 替换过的代码，换回原来的字节
+            for (auto const& item : breakpoints) {
+                if (item.second.enabled() && item.first >= low && item.first < low + static_cast<std::intptr_t>(code.size())) {
+                    code[item.first - low] = item.second.saved_byte();
+                }
+            }
+
+            std::size_t offset = 0;
+            while (offset < code.size()) {
+                X86Decoder::Instruction insn;
+                if (!X86Decoder::decode(code.data() + offset, code.size() - offset, low + offset, insn)) {
+                    reason = "无法解码所在函数，不能确认换掉的指令中间不是跳转目标";
+                    return false;
+                }
+                if (insn.flow == X86Decoder::Flow::indirect_jump) {
+                    reason = "所在函数中有间接跳转，不能确认换掉的指令中间不是跳转目标";
+                    return false;
+                }
+                if ((insn.flow == X86Decoder::Flow::jump || insn.flow == X86Decoder::Flow::cond_jump
+                    || insn.flow == X86Decoder::Flow::call) && insn.target > addr && insn.target < end) {
+                    reason = "换掉的指令中间是跳转目标";
+                    return false;
+                }
+                offset += insn.length;
+            }
+        }
+        return true;
+    }
+
+    // 借用 thread 在 addr 附近映射一页蹦床页，rel32 的 jmp 要能跳到，失败时返回 0
+    auto map_trampoline_page(Thread& thread, std::intptr_t addr) -> std::intptr_t {
+        auto hint = DisplacedStepper::find_free_page(pid, addr);
+        if (hint == 0 || !FastTracer::reachable(addr, hint)) {
+            return 0;
+        }
+        auto page = inject_syscall(thread, SYS_mmap, hint, FastTracer::page_size, PROT_READ | PROT_EXEC,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, static_cast<uint64_t>(-1), 0);
+        if (page < 0 && page > -4096) {
+            return 0;
+        }
+        return page;
+    }
+
+    // 已经安装的跳转恢复为原来的指令，跟踪点处用户设置的断点保留
+    // 调用者要先让所有线程停下
+    auto uninstall_fast_tracepoints() -> void {
+        for (auto& site : fast_tracer.all()) {
+            if (!site.installed) {
+                continue;
+            }
+            auto addr = to_runtime(site.addr);
+            PtraceProxy::patch_memory(pid, addr, site.original.data(), site.original.size());
+            auto it = breakpoints.find(addr);
+            if (it != breakpoints.end() && it->second.enabled()) {
+                static const uint8_t int3 = 0xCC;
+                it->second.mark_enabled(site.original[0]);
+                PtraceProxy::patch_memory(pid, addr, &int3, sizeof(int3));
+            }
+            displaced.forget(addr);
+            site.installed = false;
+        }
+    }
+
+    // 别的线程碰到了单步计划等内部使用的临时断点，让它越过断点后继续运行
+    auto step_over_internal_breakpoint(Thread& thread, siginfo_t const& siginfo) -> bool {
+        if (thread.tid == current_tid || siginfo.si_signo != SIGTRAP
+            || (siginfo.si_code != SI_KERNEL && siginfo.si_code != TRAP_BRKPT)) {
+            return false;
+        }
+        auto addr = thread.registers.pc() - 1;
+        auto it = breakpoints.find(addr);
+        if (it == breakpoints.end() || !it->second.enabled() || user_breakpoints.count(addr)) {
+            return false;
+        }
+
+        thread.registers.set_pc(addr);
+        if (step_thread_over_breakpoint(thread)) {
+            resume_thread(thread, false);
+        }
+        return true;
+    }
+
+    // 线程停在断点上，并且这个断点已经报告过了，恢复运行前要先越过它
+    auto is_on_reported_breakpoint(Thread& thread) -> bool {
+        if (thread.reason != Thread::StopReason::breakpoint) {
+            return false;
+        }
+        auto it = breakpoints.find(thread.registers.pc());
+        return it != breakpoints.end() && it->second.enabled();
+    }
+
+    // 让停在断点上的线程执行断点处原来的指令，线程结束时返回 false
+    // 优先用位移单步；不能位移执行时暂时关闭断点，关闭期间其他线程先暂停，不会有线程越过它
+    auto step_thread_over_breakpoint(Thread& thread) -> bool {
+        auto tid = thread.tid;
+        auto addr = thread.registers.pc();
+        int status;
+        if (displaced_step(thread, breakpoints[addr], status)) {
+            return finish_step_over(thread, status);
+        }
+
+        auto paused = pause_threads();
+        if (!running() || threads.find(tid) == nullptr) {
+            resume_threads(paused);
+            return false;
+        }
+
+        breakpoints[addr].disable();
+        status = step_thread(thread);
+        auto stepped = finish_step_over(thread, status);
+        if (!running()) {
+            return false;
+        }
+        breakpoints[addr].enable();
+        resume_threads(paused);
+        return stepped;
+    }
+
+    // 越过断点的单步之后按单步的结果处理，和 handle_wait_status 处理当前线程的单步一样：
+    // 写了软件观察点保护的页时由 handle_watch_fault 放开写权限执行并检查，触发的观察点照常报告，
+    // 只有 tracee 真正收到的信号才留到恢复运行时发送；线程结束时返回 false
+    auto finish_step_over(Thread& thread, int status) -> bool {
+        auto tid = thread.tid;
+        if (handle_thread_exit(tid, status)) {
+            return false;
+        }
+        auto siginfo = PtraceProxy::get_signal_info(tid);
+        if (siginfo.si_signo == SIGSEGV && handle_watch_fault(thread, siginfo)) {
+            return running() && threads.find(tid) != nullptr;
+        }
+        handle_stop_signal(thread, siginfo);
+        return true;
+    }
+
+    // 单步执行一个线程并等待它停下，返回 waitpid 的状态
+    // 之前发出的 PTRACE_INTERRUPT 可能在这时才生效，这种停止再单步一次
+    auto step_thread(Thread& thread) -> int {
+        int status;
+        while (true) {
+            resume_thread(thread, true);
+            while (waitpid(thread.tid, &status, __WALL) == -1 && errno == EINTR) {
+            }
+            if (WIFSTOPPED(status)) {
+                thread.is_running = false;
+            }
+            if (WIFSTOPPED(status) && (status >> 16) == PTRACE_EVENT_STOP && thread.is_interrupting) {
+                thread.is_interrupting = false;
+                continue;
+            }
+            // 单步执行到被过滤器停下的系统调用，继续单步执行完它
+            if (WIFSTOPPED(status) && (status >> 16) == PTRACE_EVENT_SECCOMP) {
+                continue;
+            }
+            return status;
+        }
+    }
+
+    // tracee 已经结束时打印并重置状态，返回 true
+    auto handle_exit(int status) -> bool {
+        if (WIFEXITED(status)) {
+            printf("[(进程 %d) 正常结束]\n", pid);
+            reset();
+            return true;
+        } else if (WIFSIGNALED(status)) {
+            printf("[进程 %d] 因为信号被杀.\n", pid);
+            reset();
+            return true;
+        }
+        return false;
+    }
+
+    auto handle_stop_signal(Thread& thread, siginfo_t const& siginfo) -> void {
+        switch (siginfo.si_signo) {
+        case SIGTRAP:
+            // 触发断点而停止
+            handle_sigtrap(thread, siginfo);
+            break;
+        case SIGINT:
+            if (is_terminal_interrupt(siginfo)) {
+                // tracee 比调试器先报告了终端上的 Ctrl-C，当作调试器的打断处理，
+                // 信号不投递给 tracee，调试器收到的那一份也丢掉，免得回到提示符后再打断一次
+                events.discard_interrupt();
+                thread.reason = Thread::StopReason::signal;
+                is_interrupted = true;
+                printf("\n[被 Ctrl-C 打断]\n");
+                break;
+            }
+            thread.pending_signal = siginfo.si_signo;
+            thread.reason = Thread::StopReason::signal;
+            printf("收到信号 %s\n", strsignal(siginfo.si_signo));
+            break;
+        default:
+            thread.pending_signal = siginfo.si_signo;
+            thread.reason = Thread::StopReason::signal;
+            printf("收到信号 %s\n", strsignal(siginfo.si_signo));
+        }
+    }
+
+    // 终端驱动发给整个前台进程组的 SIGINT，si_code 为 SI_KERNEL；kill 发来的是 SI_USER
+    static auto is_terminal_interrupt(siginfo_t const& siginfo) -> bool {
+        return siginfo.si_signo == SIGINT && siginfo.si_code == SI_KERNEL;
+    }
+
+    auto handle_sigtrap(Thread& thread, siginfo_t siginfo) -> void {
+        // 调试寄存器触发，单步过程中触发时 si_code 也可能是 TRAP_TRACE
+        if (!debug_registers.empty() && (siginfo.si_code == TRAP_HWBKPT || siginfo.si_code == TRAP_TRACE)) {
+            auto slot = DebugRegisters::triggered(thread.tid);
+            if (slot >= 0) {
+                handle_debug_register_trap(thread, slot);
+                return;
+            }
+        }
+
+        if (siginfo.si_code != SI_KERNEL && siginfo.si_code != TRAP_BRKPT) {
+            // 不是因为断点触发的，直接返回
+            thread.reason = Thread::StopReason::step;
+            return;
+        }
+
+        // 确实是因为断点停下来的
+        // 需要将 PC 回退到执行 0xCC 之前的位置
+        // 然后重新执行原状态的指令
+        // 这里只处理 PC 的回退
+        // 执行原状态的操作在 step_over_breakpoint 中
+        thread.reason = Thread::StopReason::breakpoint;
+        auto pc = thread.registers.pc();
+        thread.registers.set_pc(pc - 1);
+
+        if (is_quiet) {
+            return;
+        }
+
+        try {
+            auto line_iter = get_line_iter_by_addr(pc - 1);
+            list_source(line_iter.file(), line_iter.line(), 1);
+        } catch (no_debug_information const& exc) {
+        }
+    }
+
+    // 硬件断点停在指令执行之前，和软件断点一样显示代码，PC 不需要回退
+    // 观察点停在写入或者读取的指令执行之后，显示新旧值，并且结束正在进行的单步
+    auto handle_debug_register_trap(Thread& thread, int slot) -> void {
+        auto const& s = debug_registers.slot(slot);
+        if (s.kind == DebugRegisters::Kind::execute) {
+            thread.reason = Thread::StopReason::breakpoint;
+            if (is_quiet) {
+                return;
+            }
+            printf("硬件断点 %d, 0x%lx\n", slot, s.addr);
+        } else {
+            auto old_value = watched_values[slot];
+            auto new_value = read_watched_value(slot);
+            watched_values[slot] = new_value;
+            is_watch_triggered = true;
+            thread.reason = Thread::StopReason::watchpoint;
+
+            printf("\n%s %d: 0x%lx (%zu 字节)\n", s.kind == DebugRegisters::Kind::write ? "观察点" : "访问观察点",
+                slot, s.addr, s.len);
+            if (old_value != new_value) {
+                printf("旧值 = %lu (0x%lx)\n新值 = %lu (0x%lx)\n", old_value, old_value, new_value, new_value);
+            } else {
+                printf("值 = %lu (0x%lx)\n", new_value, new_value);
+            }
+        }
+
+        try {
+            auto line_iter = get_line_iter_by_addr(thread.registers.pc());
+            list_source(line_iter.file(), line_iter.line(), 1);
+        } catch (no_debug_information const& exc) {
+        }
+    }
+
+    // 地址区间的所有出口
+    struct RangeExits {
+        // 需要真正单步执行的指令：call/ret/间接跳转/系统调用，以及解码失败的位置
+        std::set<std::intptr_t> step_points;
+        // 跳出区间的直接跳转目标，以及顺序执行离开区间的位置
+        std::set<std::intptr_t> targets;
+        // 解码到的位置，之后的指令只能逐条单步
+        std::intptr_t decoded_end;
+    };
+
+    // 把 [low, high) 中的指令解码一遍，找出所有离开区间的出口
+    auto range_exits(std::intptr_t low, std::intptr_t high) -> RangeExits {
+        RangeExits exits{{}, {}, low};
+
+        std::vector<uint8_t> code(high - low);
+        code.resize(PtraceProxy::read_memory(pid, low, code.data(), code.size()));
+        // 读到的是被 0xCC 替换过的代码，换回原来的字节
+        for (auto const& item : breakpoints) {
+            if (item.second.enabled() && item.first >= low && item.first < low + static_cast<std::intptr_t>(code.size())) {
+                code[item.first - low] = item.second.saved_byte();
+            }
+        }
+
+        auto addr = low;
+        while (addr < low + static_cast<std::intptr_t>(code.size())) {
+            X86Decoder::Instruction insn;
+            auto offset = addr - low;
+            if (!X86Decoder::decode(code.data() + offset, code.size() - offset, addr, insn)) {
+                exits.step_points.insert(addr);
+                exits.decoded_end = addr;
+                return exits;
+            }
+
+            switch (insn.flow) {
+            case X86Decoder::Flow::sequential:
+                break;
+            case X86Decoder::Flow::jump:
+            case X86Decoder::Flow::cond_jump:
+                if (insn.target < low || insn.target >= high) {
+                    exits.targets.insert(insn.target);
+                }
+                break;
+            default:
+                exits.step_points.insert(addr);
+                break;
+            }
+            addr += insn.length;
+        }
+
+        exits.decoded_end = addr;
+        if (addr == high) {
+            exits.targets.insert(high);
+        }
+        return exits;
+    }
+
+    // 一直运行到 PC 离开 [low, high)
+    // 在区间的出口处放临时断点直接继续运行，区间内的循环全速执行，不会每条指令都停下
+    auto run_out_of_range(std::intptr_t low, std::intptr_t high) -> void {
+        auto exits = range_exits(low, high);
+        std::set<std::intptr_t> addrs{exits.targets};
+        addrs.insert(exits.step_points.begin(), exits.step_points.end());
+
+        while (keep_stepping()) {
+            auto pc = get_pc();
+            if (pc < low || pc >= high) {
+                break;
+            }
+
+            if (exits.step_points.count(pc) || pc >= exits.decoded_end) {
+                single_step_instruction_with_breakpoint_check();
+                continue;
+            }
+
+            auto added = set_breakpoints_at_addrs(addrs);
+            continue_in_step();
+            remove_breakpoints_at_addrs(added);
+        }
+    }
+
+    // 执行机器码级别单步运行的
+    // 然后等 tracee 停下来
+    // 只有当前线程执行，其他线程保持停止
+    auto single_step_instruction() -> void {
+        resume_thread(current_thread(), true);
+        is_single_stepping = true;
+        handle_wait_signal_and_exit();
+        is_single_stepping = false;
+    }
+
+private:
+    // 让 thread 执行一次系统调用，返回系统调用的返回值，执行后恢复所有寄存器
+    // 有暂存页时在暂存页中的 syscall 指令处执行
+    // 否则临时把 PC 处的两个字节换成 syscall 指令，这期间其他线程先暂停，以免它们执行到被换掉的代码
+    auto inject_syscall(Thread& thread, long nr, uint64_t arg0, uint64_t arg1, uint64_t arg2,
+        uint64_t arg3 = 0, uint64_t arg4 = 0, uint64_t arg5 = 0) -> long {
+        static const uint8_t syscall_insn[2] = {0x0F, 0x05};
+        // 改写寄存器会取消线程正在进入的系统调用
+        if (syscall_catcher.in_syscall(thread.tid)) {
+            EXCEPTION("线程停在系统调用的入口，先让它继续运行");
+        }
+
+        auto& regs = thread.registers;
+        auto saved = regs.get();
+        auto call = saved;
+        std::vector<pid_t> paused{};
+        uint8_t code[2];
+        if (displaced.ready()) {
+            call.rip = displaced.syscall_address();
+        } else {
+            paused = pause_threads();
+            if (PtraceProxy::read_memory(pid, saved.rip, code, sizeof(code)) != sizeof(code)
+                || PtraceProxy::patch_memory(pid, saved.rip, syscall_insn, sizeof(syscall_insn)) != sizeof(syscall_insn)) {
+                resume_threads(paused);
+                EXCEPTION("向 tracee 注入系统调用失败");
+            }
+        }
+
+        call.rax = nr;
+        call.rdi = arg0;
+        call.rsi = arg1;
+        call.rdx = arg2;
+        call.r10 = arg3;
+        call.r8 = arg4;
+        call.r9 = arg5;
+        // 不让内核把这次单步当作被信号打断的系统调用去重启
+        call.orig_rax = -1;
+        regs.set(call);
+
+        auto status = step_thread(thread);
+        long result = -1;
+        if (WIFSTOPPED(status)) {
+            result = regs.get().rax;
+        }
+
+        if (call.rip == saved.rip) {
+            PtraceProxy::patch_memory(pid, saved.rip, code, sizeof(code));
+            resume_threads(paused);
+        }
+        regs.set(saved);
+        if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGTRAP) {
+            EXCEPTION("注入的系统调用没有正常完成");
+        }
+        return result;
+    }
+
+    // 第一次位移单步时，在离代码最近的空闲地址映射暂存页，第 0 个槽位放一条 syscall 指令
+    // 映射失败后不再尝试，越过断点时退回到临时恢复原来字节的方式
+    auto ensure_scratch_page(Thread& thread) -> bool {
+        if (displaced.ready() || displaced.unavailable()) {
+            return displaced.ready();
+        }
+
+        static const uint8_t syscall_insn[2] = {0x0F, 0x05};
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+        auto hint = DisplacedStepper::find_free_page(pid, thread.registers.pc());
+        long page = -1;
+        try {
+            if (hint != 0) {
+                page = inject_syscall(thread, SYS_mmap, hint, DisplacedStepper::page_size, PROT_READ | PROT_EXEC,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, static_cast<uint64_t>(-1), 0);
+            }
+        } catch (exception const& exc) {
+            page = -1;
+        }
+        // 失败时返回的是 -errno
+        if (page < 0 && page > -4096) {
+            page = -1;
+        }
+        if (page == -1 || PtraceProxy::patch_memory(pid, page, syscall_insn, sizeof(syscall_insn)) != sizeof(syscall_insn)) {
+            displaced.mark_unavailable();
+            return false;
+        }
+        displaced.set_page(page);
+        return true;
+    }
+
+    // 位移单步：线程停在 bp 上，在暂存页中执行断点处原来的指令，然后把 PC 换算回原处
+    // 断点的 0xCC 一直都在，其他线程可以继续运行；status 是单步后 waitpid 的状态
+    // 不能位移执行时返回 false，由调用者用临时恢复原来字节的方式单步
+    auto displaced_step(Thread& thread, Breakpoint const& bp, int& status) -> bool {
+        if (!ensure_scratch_page(thread)) {
+            return false;
+        }
+
+        auto from = bp.address();
+        uint8_t code[X86Decoder::max_length];
+        auto size = PtraceProxy::read_memory(pid, from, code, sizeof(code));
+        if (size == 0) {
+            return false;
+        }
+        // 读到的是被 0xCC 替换过的代码，换回原来的字节
+        for (std::size_t i = 0; i < size; ++i) {
+            auto it = breakpoints.find(from + i);
+            if (it != breakpoints.end() && it->second.enabled()) {
+                code[i] = it->second.saved_byte();
+            }
+        }
+
+        DisplacedStepper::Plan plan;
+        if (!displaced.prepare(from, code, size, plan)) {
+            return false;
+        }
+        if (plan.needs_write) {
+            if (PtraceProxy::patch_memory(pid, plan.to, plan.code.data(), plan.code.size()) != plan.code.size()) {
+                return false;
+            }
+            displaced.mark_written(plan);
+        }
+
+        auto& regs = thread.registers;
+        regs.set_pc(plan.to);
+        status = step_thread(thread);
+        if (!WIFSTOPPED(status)) {
+            return true;
+        }
+
+        auto pc = regs.pc();
+        // 带 rep 前缀的指令单步一次只执行一次迭代，PC 不变
+        while (WSTOPSIG(status) == SIGTRAP && pc == plan.to && plan.insn.flow == X86Decoder::Flow::sequential) {
+            status = step_thread(thread);
+            if (!WIFSTOPPED(status)) {
+                return true;
+            }
+            pc = regs.pc();
+        }
+
+        if (WSTOPSIG(status) == SIGSEGV && pc == plan.to) {
+            // 指令没有执行（例如写了软件观察点保护的页），退回原处，交给调用者用原来的方式处理
+            regs.set_pc(from);
+            return false;
+        }
+
+        regs.set_pc(DisplacedStepper::relocate_pc(plan, pc));
+        if (DisplacedStepper::is_call(plan) && pc != plan.to) {
+            auto return_address = DisplacedStepper::return_address(plan);
+            PtraceProxy::write_memory(pid, regs.get().rsp, &return_address, sizeof(return_address));
+        }
+        return true;
+    }
+
+    auto set_page_protection(Thread& thread, std::intptr_t page, int prot) -> void {
+        if (inject_syscall(thread, SYS_mprotect, page, PageWatcher::page_size, prot) != 0) {
+            EXCEPTION("修改 tracee 的页权限失败");
+        }
+    }
+
+    // 去掉所有被观察的页的写权限，本来就不可写的页不需要处理
+    // 页权限是整个进程共享的，借用当前线程注入 mprotect
+    // 启动前设置的观察点这时才知道是否在栈上，栈上的页保持可写，给出提示
+    auto protect_watched_pages() -> void {
+        for (auto page : page_watcher.pages()) {
+            if (page_watcher.is_protected(page)) {
+                continue;
+            }
+            auto prot = PageWatcher::read_protection(pid, page);
+            if (prot < 0 || !(prot & PROT_WRITE)) {
+                continue;
+            }
+            if (overlaps_stack(page, page + PageWatcher::page_size)) {
+                printf("** 0x%lx 所在的页在线程的栈上，软件观察点不会在这一页上触发 **\n", page);
+                continue;
+            }
+            set_page_protection(current_thread(), page, prot & ~PROT_WRITE);
+            page_watcher.mark_protected(page, prot);
+        }
+    }
+
+    // [low, high) 和线程的栈重叠：主线程的 [stack]，或者停下的线程 rsp 所在的映射
+    // 运行中的线程读不到 rsp，非停止模式下它们的栈要等停下之后才能认出来
+    auto overlaps_stack(std::intptr_t low, std::intptr_t high) -> bool {
+        PageWatcher::Mapping mapping;
+        for (auto page = PageWatcher::page_of(low); page < high;) {
+            if (!PageWatcher::find_mapping(pid, page, mapping)) {
+                page += PageWatcher::page_size;
+                continue;
+            }
+            if (mapping.is_stack) {
+                return true;
+            }
+            page = mapping.end;
+        }
+        for (auto& item : threads) {
+            auto& thread = item.second;
+            if (thread.is_running || thread.is_starting) {
+                continue;
+            }
+            auto rsp = static_cast<std::intptr_t>(thread.registers.get().rsp);
+            if (PageWatcher::find_mapping(pid, rsp, mapping) && mapping.start < high && low < mapping.end) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // tracee 写了被保护的页：临时恢复写权限，单步执行这条指令，再去掉写权限，然后检查观察的区间有没有变化
+    // 不是软件观察点引起的 SIGSEGV 返回 false
+    auto handle_watch_fault(Thread& thread, siginfo_t const& siginfo) -> bool {
+        auto addr = reinterpret_cast<std::intptr_t>(siginfo.si_addr);
+        if (siginfo.si_code != SEGV_ACCERR || !page_watcher.is_protected(addr)) {
+            return false;
+        }
+
+        // 一条指令可能写到多个被保护的页
+        std::set<std::intptr_t> opened{};
+        while (true) {
+            auto page = PageWatcher::page_of(addr);
+            set_page_protection(thread, page, page_watcher.original_protection(page));
+            opened.insert(page);
+
+            auto status = step_thread(thread);
+            if (handle_thread_exit(thread.tid, status)) {
+                return true;
+            }
+
+            auto info = PtraceProxy::get_signal_info(thread.tid);
+            if (info.si_signo == SIGSEGV && info.si_code == SEGV_ACCERR) {
+                addr = reinterpret_cast<std::intptr_t>(info.si_addr);
+                if (page_watcher.is_protected(addr) && !opened.count(PageWatcher::page_of(addr))) {
+                    continue;
+                }
+            }
+            if (info.si_signo != SIGTRAP) {
+                // 指令还没执行就收到了别的信号，继续运行时信号会被送给 tracee，之后这条指令会再次触发
+                handle_stop_signal(thread, info);
+            }
+            break;
+        }
+
+        for (auto page : opened) {
+            set_page_protection(thread, page, page_watcher.original_protection(page) & ~PROT_WRITE);
+        }
+        check_software_watchpoints(thread);
+        return true;
+    }
+
+    // 比较每个软件观察点的内容，有变化时打印并结束正在进行的单步
+    auto check_software_watchpoints(Thread& thread) -> void {
+        bool changed = false;
+        for (auto& watch : page_watcher.all()) {
+            std::vector<uint8_t> current(watch.len);
+            PtraceProxy::read_memory(pid, watch.addr, current.data(), current.size());
+            if (current == watch.value) {
+                continue;
+            }
+
+            printf("\n软件观察点 %d: 0x%lx (%zu 字节)\n", watch.id, watch.addr, watch.len);
+            if (watch.len <= sizeof(uint64_t)) {
+                uint64_t old_value = 0;
+                uint64_t new_value = 0;
+                memcpy(&old_value, watch.value.data(), watch.len);
+                memcpy(&new_value, current.data(), watch.len);
+                printf("旧值 = %lu (0x%lx)\n新值 = %lu (0x%lx)\n", old_value, old_value, new_value, new_value);
+            } else {
+                auto first = std::mismatch(current.begin(), current.end(), watch.value.begin()).first - current.begin();
+                printf("偏移 %ld 处: 0x%02x -> 0x%02x\n", first, watch.value[first], current[first]);
+            }
+            watch.value = current;
+            changed = true;
+        }
+
+        if (!changed) {
+            return;
+        }
+        is_watch_triggered = true;
+        thread.reason = Thread::StopReason::watchpoint;
+        try {
+            auto line_iter = get_line_iter_by_addr(thread.registers.pc());
+            list_source(line_iter.file(), line_iter.line(), 1);
+        } catch (no_debug_information const& exc) {
+        }
+    }
+
+    // 判断当前要执行的指令是否是 0xCC 断点指令
+    // 如果是，则暂时关闭掉该断点
+    // 等执行过后再打开
+    // 优先用位移单步，断点一直保留；不能位移执行时暂时关闭断点，关闭期间先暂停其他线程
+    auto step_over_breakpoint() -> void {
+        auto pc = get_pc();
+        auto it = breakpoints.find(pc);
+        if (it == breakpoints.end() || !it->second.enabled()) {
+            return;
+        }
+
+        auto& thread = current_thread();
+        int status;
+        if (displaced_step(thread, it->second, status)) {
+            finish_step_over(thread, status);
+            return;
+        }
+
+        auto paused = pause_threads();
+        if (!running()) {
+            return;
+        }
+        breakpoints[pc].disable();
+        // 利用指令单步操作运行过该指令
+        single_step_instruction();
+        if (running()) {
+            breakpoints[pc].enable();
+        }
+        resume_threads(paused);
+    }
+
+private:
+    // fork 之前建立快速跟踪点的共享内存，tracee 继承它的文件描述符，找不到 agent 时不预加载
+    auto prepare_agent() -> void {
+        if (!fast_tracer.active()) {
+            return;
+        }
+        auto path = FastTracer::agent_path();
+        if (path.empty() || access(path.c_str(), R_OK) != 0) {
+            printf("** 找不到 agent %s，快速跟踪点不会生效 **\n", path.c_str());
+            return;
+        }
+        if (fast_tracer.prepare_run() < 0) {
+            printf("** 建立快速跟踪点的共享内存失败: %s **\n", strerror(errno));
+        }
+    }
+
+    // 将传入的 args 重新组织成 execv 需要的格式
+    auto tracee_routine(std::vector<std::string> const& args) -> void {
+        // 多出的两个空间，一个留给开头的 program，一个留给最后的 nullptr
+        char **argv = new char *[args.size() + 2];  
+
+        argv[0] = const_cast<char *>(program.c_str());
+        for (auto i = 0; i < args.size(); ++i) {
+            argv[1 + i] = const_cast<char *>(args[i].c_str());
+        }
+        argv[args.size() + 1] = nullptr;
+
+        // 只有捕获的系统调用会停下，过滤器在 execv 之后仍然有效
+        if (syscall_catcher.active() && !syscall_catcher.install()) {
+            fprintf(stderr, "** 安装 seccomp 过滤器失败: %s **\n", strerror(errno));
+        }
+
+        // 预加载快速跟踪点的 agent，它通过继承的 fd 映射共享内存
+        if (fast_tracer.prepared()) {
+            auto preload = FastTracer::agent_path();
+            auto old = getenv("LD_PRELOAD");
+            if (old != nullptr && *old != '\0') {
+                preload += ":" + std::string{old};
+            }
+            setenv("LD_PRELOAD", preload.c_str(), 1);
+            setenv("BDB_AGENT_FD", std::to_string(fast_tracer.descriptor()).c_str(), 1);
+        }
+
+        // 调试器屏蔽的 SIGCHLD 和 SIGINT 会被继承，先恢复
+        // tracee 和调试器留在同一个前台进程组，可以照常读写终端；终端上的 Ctrl-C 两边都会收到，由 handle_stop_signal 合并
+        EventLoop::restore_signals();
+
+        execv(program.c_str(), argv);
+        // 子进程抛出异常
+        EXCEPTION(std::string{"execv 失败: "} + strerror(errno));
+    }
+
+    auto tracer_routine(std::vector<std::string> const& args) -> void {
+        // 子进程在 execv 之前先用 SIGSTOP 停下，等我们附加
+        int status = 0;
+        waitpid(pid, &status, WUNTRACED);
+        if (!WIFSTOPPED(status)) {
+            reset();
+            EXCEPTION("启动失败，退出");
+        }
+
+        // 用 PTRACE_SEIZE 附加才能使用 PTRACE_INTERRUPT
+        // 跟踪 clone 出的新线程和 execv，调试器异常退出时 tracee 也被杀死
+        // 捕获系统调用需要 seccomp 停止，系统调用返回的停止用 SIGTRAP | 0x80 和断点区分
+        if (!PtraceProxy::seize(pid, PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL
+                | PTRACE_O_TRACESECCOMP | PTRACE_O_TRACESYSGOOD)) {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            reset();
+            EXCEPTION(std::string{"PTRACE_SEIZE 失败: "} + strerror(errno));
+        }
+        auto& main_thread = threads.add(pid);
+        main_thread.is_starting = false;
+        current_tid = pid;
+
+        // 让子进程继续，一直运行到 execv 成功（PTRACE_EVENT_EXEC）
+        // 途中的 group-stop 直接继续，信号停止把信号（SIGCONT）送回给子进程
+        kill(pid, SIGCONT);
+        while (true) {
+            waitpid(pid, &status, __WALL);
+            if (WIFEXITED(status) || WIFSIGNALED(status)) {
+                // execv 失败了，子进程抛出了异常，父进程也抛出异常
+                reset();
+                EXCEPTION("启动失败，退出");
+            }
+            auto event = status >> 16;
+            if (event == PTRACE_EVENT_EXEC) {
+                break;
+            }
+            PtraceProxy::delivery_signal_tracee(pid, event == 0 ? WSTOPSIG(status) : 0);
+        }
+
+        if (syscall_catcher.active()) {
+            if (has_seccomp_filter()) {
+                syscall_catcher.mark_installed();
+            } else {
+                printf("** tracee 中没有安装上 seccomp 过滤器，不能捕获系统调用 **\n");
+            }
+        }
+        arm_tracee();
+
+        // 继续执行
+        continue_execute();
+    }
+
+    // tracee 开始运行或者附加之后，所有线程都停着：算出装载偏移，把之前记录的断点和观察点布置到 tracee 中
+    auto arm_tracee() -> void {
+        load_bias = find_load_bias();
+        debug_registers.rebase(load_bias);
+        page_watcher.rebase(load_bias);
+
+        // 将之前记录的断点地址真正设置为断点
+        std::set<std::intptr_t> addrs{};
+        for (auto addr : breakpoint_addrs_to_set) {
+            addrs.insert(to_runtime(addr));
+        }
+        user_breakpoints = addrs;
+        set_breakpoints_at_addrs(addrs);
+        if (call_tracer.active()) {
+            install_call_entries();
+        }
+        if (tracepoints.active()) {
+            std::set<std::intptr_t> sites{};
+            for (auto const& tp : tracepoints.all()) {
+                sites.insert(to_runtime(tp.addr));
+            }
+            own_tracepoint_breakpoints(sites);
+        }
+
+        // 硬件断点和观察点写入调试寄存器，记下观察点的初始值
+        if (!debug_registers.empty()) {
+            install_debug_registers();
+            for (auto i = 0; i < DebugRegisters::count; ++i) {
+                watched_values[i] = debug_registers.slot(i).used ? read_watched_value(i) : 0;
+            }
+        }
+
+        // 软件观察点记下初始内容，去掉所在页的写权限
+        if (!page_watcher.empty()) {
+            for (auto& watch : page_watcher.all()) {
+                PtraceProxy::read_memory(pid, watch.addr, watch.value.data(), watch.len);
+            }
+            protect_watched_pages();
+        }
+    }
+
+    // /proc/pid/status 中 Seccomp 为 2 表示进程处于过滤模式
+    auto has_seccomp_filter() const -> bool {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/status", pid);
+        std::ifstream status{path};
+        std::string line{};
+        while (std::getline(status, line)) {
+            if (line.compare(0, 8, "Seccomp:") == 0) {
+                return std::stoi(line.substr(8)) == SECCOMP_MODE_FILTER;
+            }
+        }
+        return false;
+    }
+
+    // PIE 的装载偏移：/proc/pid/maps 中 program 文件偏移为 0 的映射的起始地址减去链接时的地址
+    // 不是 PIE 或者找不到映射时为 0
+    auto find_load_bias() const -> std::intptr_t {
+        if (!is_pie) {
+            return 0;
+        }
+        auto exe = executable_of(pid);
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+        auto maps = fopen(path, "r");
+        if (maps == nullptr || exe.empty()) {
+            if (maps != nullptr) {
+                fclose(maps);
+            }
+            printf("** 无法读取进程 %d 的装载地址 **\n", pid);
+            return 0;
+        }
+
+        std::intptr_t bias = 0;
+        unsigned long start, end, offset;
+        char perms[5];
+        char line[PATH_MAX + 128];
+        while (fgets(line, sizeof(line), maps) != nullptr) {
+            int name = 0;
+            if (sscanf(line, "%lx-%lx %4s %lx %*s %*s %n", &start, &end, perms, &offset, &name) != 4 || name == 0) {
+                continue;
+            }
+            std::string mapped{line + name};
+            if (!mapped.empty() && mapped.back() == '\n') {
+                mapped.pop_back();
+            }
+            if (offset == 0 && mapped == exe) {
+                bias = static_cast<std::intptr_t>(start) - link_base;
+                break;
+            }
+        }
+        fclose(maps);
+        return bias;
+    }
+
+public:
+    // 退出时不等待后台把整个程序的调试信息再解析一遍，缓存文件先写到临时文件再改名，中途放弃是安全的
+    ~Inferior() {
+        is_cache_cancelled.store(true, std::memory_order_relaxed);
+    }
+
+private:
+    // 提取 program 中的 debug 信息
+    dwarf::dwarf dwarf;
+    // 按编译单元懒加载的地址到函数、地址到行号索引
+    DwarfIndex dwarf_index;
+    // 函数名到 DIE 的索引
+    NameIndex name_index;
+    LoadTimes load_times;
+    // 设置后后台线程在编译单元之间停下，不写入缓存文件；要比 cache_writer 后析构
+    std::atomic<bool> is_cache_cancelled;
+    // 后台生成索引缓存文件，析构时会等待它停下
+    std::future<bool> cache_writer;
+
+private:
+    // tracee 未开始运行时，记录断点地址，在 tracee 开始运行时将断点加入
+    std::set<std::intptr_t> breakpoint_addrs_to_set;
+    // 用户设置的断点地址，其他断点是单步时内部使用的，别的线程碰到时直接越过
+    std::set<std::intptr_t> user_breakpoints;
+
+public:
+    // step 和 run 命令会用到
+    // 真正设置到的断点
+    std::unordered_map<std::intptr_t, Breakpoint> breakpoints;
+
+private:
+    // 按函数起始地址缓存的单步计划
+    std::unordered_map<std::intptr_t, StepPlan> step_plans;
+    // 当前布置在 tracee 中的单步计划
+    ArmedStepPlan armed_plan;
+
+private:
+    // 硬件断点和观察点占用的调试寄存器，tracee 重新运行时仍然保留
+    DebugRegisters debug_registers;
+    // 每个观察点上次看到的值
+    std::array<uint64_t, DebugRegisters::count> watched_values;
+    // 软件观察点以及被去掉写权限的页
+    PageWatcher page_watcher;
+    // 位移单步用的暂存页
+    DisplacedStepper displaced;
+
+private:
+    // tracee 的所有线程，包含各自的寄存器缓存，寄存器缓存在 const 成员函数中也可以更新
+    mutable ThreadTable threads;
+    // 当前线程，寄存器读写、单步都针对它
+    pid_t current_tid;
+
+private:
+    // program 是位置无关的可执行文件
+    bool is_pie;
+    // 链接时最低的装载地址（按页对齐）
+    std::intptr_t link_base;
+    // tracee 中的地址减去调试信息中的地址，tracee 没有运行时为 0
+    std::intptr_t load_bias;
+
+private:
+    // profile 命令进行中时不为空，等待线程的过程中定时采样
+    Profiler *profiler;
+    // 栈回溯，解析过的 CFI 缓存在里面
+    Unwinder unwinder;
+    // trace-calls 命令跟踪的函数和它们的调用统计，tracee 重新运行时仍然保留
+    CallTracer call_tracer;
+    // catch syscall 命令捕获的系统调用和它们的统计，tracee 启动时按它安装 seccomp 过滤器
+    SyscallCatcher syscall_catcher;
+    // ftrace 命令的快速跟踪点和共享内存，tracee 启动时预加载 agent
+    FastTracer fast_tracer;
+    // tracepoint 命令收集数据的跟踪点和记录文件，tracee 重新运行时仍然保留
+    Tracepoints tracepoints;
+    // 等待 tracee、Ctrl-C、超时和用户输入的事件循环，在启动任何线程之前创建
+    EventLoop events;
+    // 打印代码用的源文件缓存，每个文件只映射一次
+    mutable SourceCache sources;
 
 private:
     // 表示 tracee 目前是否在运行
     bool is_running;
-    // 表示 tracee 因为什么信号而停止，0 表示默认状态
-    int  signo;
+    // 为 true 时，触发断点不打印代码，用于内部的临时断点
+    bool is_quiet;
+    // 观察点触发了，正在进行的单步应该停下
+    bool is_watch_triggered;
+    // 正在执行单条指令的单步
+    bool is_single_stepping;
+    // 所有线程都在运行，为 false 时只有当前线程在单步，新线程第一次停下后也先停着
+    bool is_all_running;
+    // 别的线程停下，当前线程被切换了，正在进行的单步应该停下
+    bool is_focus_changed;
+    // 非停止模式：一个线程停下时其他线程继续运行
+    bool is_non_stop;
+    // continue 命令等待任何一个线程停下，单步命令只等待当前线程
+    bool is_waiting_any;
+    // tracee 是附加上的，调试器退出时要先脱离，不能杀死它
+    bool is_attached;
+    // continue & 之后 tracee 在后台运行，提示符下收到停止时报告
+    bool is_background;
+    // 用户按下了 Ctrl-C 或者运行超时，正在进行的单步应该停下
+    bool is_interrupted;
 
 private:
     // 记录要运行的程序
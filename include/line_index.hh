@@ -0,0 +1,312 @@
+#pragma once
+
+/**
+ * 地址到行号表
+ * 把编译单元的行表展开成一张按地址排序的扁平表，地址、文件、行号、标志分别存放在独立的数组里，
+ * 按地址查找只需要在地址数组上二分
+ * 另外建立 文件:行号 到地址的反向索引，用于 break file.c:NN
+ * 扁平表的各列可以直接使用索引缓存文件中的数据，这时反向索引在第一次按 文件:行号 查找时才建立
+ */
+
+#include <column.hh>
+#include <dwarf/dwarf++.hh>
+#include <vector>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+
+namespace BitTech {
+
+class LineIndex {
+public:
+    // 指向扁平行表中的某一行
+    class iterator {
+    public:
+        iterator(LineIndex const *index, std::size_t row): index{index}, row{row} {}
+
+    public:
+        auto address() const -> std::intptr_t {
+            return index->addresses[row];
+        }
+
+        auto file() const -> std::string const& {
+            return index->files[index->file_ids[row]];
+        }
+
+        auto line() const -> unsigned int {
+            return index->lines[row];
+        }
+
+        auto is_stmt() const -> bool {
+            return index->flags[row] & IS_STMT;
+        }
+
+        // 行表序列的结束标记，它的地址是序列最后一条指令之后的位置
+        auto end_sequence() const -> bool {
+            return index->flags[row] & END_SEQUENCE;
+        }
+
+        auto at_end() const -> bool {
+            return row >= index->addresses.size();
+        }
+
+        // 所在代码行连续的地址区间
+        auto range() const -> std::pair<std::intptr_t, std::intptr_t> {
+            return index->range_of(*this);
+        }
+
+    public:
+        auto operator++() -> iterator& {
+            ++row;
+            return *this;
+        }
+
+        auto operator==(iterator const& other) const -> bool {
+            return index == other.index && row == other.row;
+        }
+
+        auto operator!=(iterator const& other) const -> bool {
+            return !(*this == other);
+        }
+
+    private:
+        friend class LineIndex;
+
+        LineIndex const *index;
+        std::size_t row;
+    };
+
+public:
+    LineIndex(): has_reverse_index{false} {}
+    explicit LineIndex(dwarf::compilation_unit const& cu): has_reverse_index{false} {
+        std::vector<Row> rows{};
+        auto const& line_table = cu.get_line_table();
+        if (line_table.valid()) {
+            for (auto const& entry : line_table) {
+                uint8_t flags = (entry.is_stmt ? IS_STMT : 0) | (entry.end_sequence ? END_SEQUENCE : 0);
+                rows.push_back(Row{
+                    static_cast<std::intptr_t>(entry.address),
+                    file_id(entry.file->path),
+                    entry.line,
+                    flags});
+            }
+        }
+
+        // 同一地址上，前一个序列的结束标记排在后一个序列的开始之前
+        // 同一序列中地址相同的多行保持原有顺序，查找时取最后一行，与 line_table::find_address 一致
+        std::stable_sort(rows.begin(), rows.end(), [](Row const& a, Row const& b) {
+            if (a.address != b.address) {
+                return a.address < b.address;
+            }
+            return (a.flags & END_SEQUENCE) > (b.flags & END_SEQUENCE);
+        });
+
+        std::vector<std::intptr_t> row_addresses{};
+        std::vector<uint32_t> row_files{};
+        std::vector<uint32_t> row_lines{};
+        std::vector<uint8_t> row_flags{};
+        row_addresses.reserve(rows.size());
+        row_files.reserve(rows.size());
+        row_lines.reserve(rows.size());
+        row_flags.reserve(rows.size());
+        for (auto const& row : rows) {
+            row_addresses.push_back(row.address);
+            row_files.push_back(row.file);
+            row_lines.push_back(row.line);
+            row_flags.push_back(row.flags);
+        }
+        addresses = Column<std::intptr_t>{std::move(row_addresses)};
+        file_ids = Column<uint32_t>{std::move(row_files)};
+        lines = Column<uint32_t>{std::move(row_lines)};
+        flags = Column<uint8_t>{std::move(row_flags)};
+
+        build_reverse_index();
+    }
+
+    // 使用已经建好的扁平行表，例如来自索引缓存文件
+    LineIndex(Column<std::intptr_t> addresses, Column<uint32_t> file_ids, Column<uint32_t> lines,
+        Column<uint8_t> flags, std::vector<std::string> files)
+        : addresses(std::move(addresses)), file_ids(std::move(file_ids)), lines(std::move(lines)),
+          flags(std::move(flags)), files(std::move(files)), has_reverse_index{false} {}
+
+public:
+    auto begin() const -> iterator {
+        return iterator{this, 0};
+    }
+
+    auto end() const -> iterator {
+        return iterator{this, addresses.size()};
+    }
+
+    // 找到包含 addr 的那一行，找不到返回 end()
+    auto find(std::intptr_t addr) const -> iterator {
+        auto it = std::upper_bound(addresses.begin(), addresses.end(), addr);
+        if (it == addresses.begin()) {
+            return end();
+        }
+        std::size_t row = it - addresses.begin() - 1;
+        // 落在两个序列之间的空隙里
+        if (flags[row] & END_SEQUENCE) {
+            return end();
+        }
+        return iterator{this, row};
+    }
+
+    // 第一个地址不小于 addr 的行
+    auto lower_bound(std::intptr_t addr) const -> iterator {
+        auto it = std::lower_bound(addresses.begin(), addresses.end(), addr);
+        return iterator{this, static_cast<std::size_t>(it - addresses.begin())};
+    }
+
+    // it 所在代码行连续的地址区间 [low, high)，相邻的同文件同行的行表项合并在一起
+    auto range_of(iterator const& it) const -> std::pair<std::intptr_t, std::intptr_t> {
+        auto row = it.row;
+        auto first = row;
+        while (first > 0 && !(flags[first - 1] & END_SEQUENCE)
+            && file_ids[first - 1] == file_ids[row] && lines[first - 1] == lines[row]) {
+            --first;
+        }
+
+        auto last = row + 1;
+        while (last < addresses.size() && !(flags[last] & END_SEQUENCE)
+            && file_ids[last] == file_ids[row] && lines[last] == lines[row]) {
+            ++last;
+        }
+
+        // last 是下一行或者序列结束标记，它的地址就是本行的结束位置
+        auto high = last < addresses.size() ? addresses[last] : addresses[row] + 1;
+        return {addresses[first], high};
+    }
+
+    // 返回 file 第 line 行开始处的指令地址（升序），实际使用的行号放在 found_line 中
+    // file 可以是完整路径、路径后缀或者文件名；line 没有代码时，使用之后第一个有代码的行
+    auto find_addresses(std::string const& file, unsigned int line, unsigned int& found_line) const
+        -> std::vector<std::intptr_t> {
+        build_reverse_index();
+
+        // 找到的最小行号以及对应的地址
+        unsigned int best_line = 0;
+        std::vector<std::intptr_t> result{};
+
+        for (auto id : matched_file_ids(file)) {
+            auto const& lines_of_file = line_starts[id];
+            auto it = lines_of_file.lower_bound(line);
+            if (it == lines_of_file.end()) {
+                continue;
+            }
+            if (result.empty() || it->first < best_line) {
+                best_line = it->first;
+                result = it->second;
+            } else if (it->first == best_line) {
+                result.insert(result.end(), it->second.begin(), it->second.end());
+            }
+        }
+
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        found_line = best_line;
+        return result;
+    }
+
+private:
+    friend class IndexCache;
+
+    static const uint8_t IS_STMT = 1;
+    static const uint8_t END_SEQUENCE = 2;
+
+    // 构建阶段使用的一行
+    struct Row {
+        std::intptr_t address;
+        uint32_t file;
+        uint32_t line;
+        uint8_t flags;
+    };
+
+    auto file_id(std::string const& path) -> uint32_t {
+        auto it = file_id_by_path.find(path);
+        if (it != file_id_by_path.end()) {
+            return it->second;
+        }
+
+        auto id = static_cast<uint32_t>(files.size());
+        files.push_back(path);
+        file_id_by_path[path] = id;
+        return id;
+    }
+
+    // 记录每个文件中每一行开始的指令地址
+    auto build_reverse_index() const -> void {
+        if (has_reverse_index) {
+            return;
+        }
+        has_reverse_index = true;
+
+        line_starts.resize(files.size());
+        for (auto id = 0u; id < files.size(); ++id) {
+            file_id_by_path[files[id]] = id;
+            auto pos = files[id].rfind('/');
+            auto basename = pos == std::string::npos ? files[id] : files[id].substr(pos + 1);
+            file_ids_by_basename[basename].push_back(id);
+        }
+
+        for (auto row = 0u; row < addresses.size(); ++row) {
+            if (!(flags[row] & IS_STMT) || (flags[row] & END_SEQUENCE)) {
+                continue;
+            }
+            // 与前一行同文件同行，说明不是这一行的开始
+            if (row > 0 && !(flags[row - 1] & END_SEQUENCE) && addresses[row - 1] < addresses[row]
+                && file_ids[row - 1] == file_ids[row] && lines[row - 1] == lines[row]) {
+                continue;
+            }
+            line_starts[file_ids[row]][lines[row]].push_back(addresses[row]);
+        }
+    }
+
+    auto matched_file_ids(std::string const& file) const -> std::vector<uint32_t> {
+        auto exact = file_id_by_path.find(file);
+        if (exact != file_id_by_path.end()) {
+            return {exact->second};
+        }
+
+        if (file.find('/') == std::string::npos) {
+            auto it = file_ids_by_basename.find(file);
+            return it == file_ids_by_basename.end() ? std::vector<uint32_t>{} : it->second;
+        }
+
+        // 按路径后缀匹配
+        std::vector<uint32_t> ids{};
+        auto suffix = file[0] == '/' ? file : "/" + file;
+        for (auto id = 0u; id < files.size(); ++id) {
+            auto const& path = files[id];
+            if (path.size() >= suffix.size()
+                && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                ids.push_back(id);
+            }
+        }
+        return ids;
+    }
+
+private:
+    // 按地址排序的扁平行表
+    Column<std::intptr_t> addresses;
+    Column<uint32_t> file_ids;
+    Column<uint32_t> lines;
+    Column<uint8_t> flags;
+
+private:
+    // 文件 id 到路径
+    std::vector<std::string> files;
+
+private:
+    // 反向索引在第一次用到时建立，所以在 const 成员函数中也可以更新
+    mutable bool has_reverse_index;
+    mutable std::unordered_map<std::string, uint32_t> file_id_by_path;
+    mutable std::unordered_map<std::string, std::vector<uint32_t>> file_ids_by_basename;
+    // 文件 id -> 行号 -> 该行开始处的指令地址
+    mutable std::vector<std::map<unsigned int, std::vector<std::intptr_t>>> line_starts;
+};
+
+}
@@ -0,0 +1,263 @@
+#pragma once
+
+/**
+ * 函数名到 DIE 的哈希索引
+ * 在工作线程中建立，第一次查找时如果还没建好才会等待
+ * 程序带有 .debug_gnu_pubnames/.debug_pubnames 时直接从中读取，否则遍历所有 DIE
+ *
+ * 工作线程使用自己打开的 elf/dwarf 对象，不和主线程共享 libelfin 的内部状态，
+ * 索引里只记录 DIE 在 .debug_info 中的偏移，由主线程按偏移取回 DIE
+ */
+
+#include <stopwatch.hh>
+#include <die_by_offset.hh>
+#include <dwarf/dwarf++.hh>
+#include <elf/elf++.hh>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <future>
+#include <regex>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace BitTech {
+
+class NameIndex {
+public:
+    // DIE 所在的编译单元偏移和 DIE 自身的偏移
+    struct Location {
+        dwarf::section_offset cu;
+        dwarf::section_offset die;
+    };
+
+public:
+    NameIndex(): pending{}, table{} {}
+    explicit NameIndex(std::string const& program)
+        : pending{std::async(std::launch::async, &NameIndex::build, program)}, table{} {}
+
+public:
+    // 返回名称（或链接名）为 name 的所有 DIE 的位置
+    auto find(std::string const& name) const -> std::vector<Location> {
+        wait();
+        auto it = table.locations.find(name);
+        if (it == table.locations.end()) {
+            return {};
+        }
+        return it->second;
+    }
+
+    // 返回名称（或链接名）中能找到 pattern 的所有 DIE 的位置，同一个 DIE 可能出现多次
+    auto match(std::regex const& pattern) const -> std::vector<Location> {
+        wait();
+        std::vector<Location> result{};
+        for (auto const& item : table.locations) {
+            if (std::regex_search(item.first, pattern)) {
+                result.insert(result.end(), item.second.begin(), item.second.end());
+            }
+        }
+        return result;
+    }
+
+    // 索引是否包含了所有带地址的函数
+    // 从 pubnames 建立的索引只有公开的名字，找不到时还需要遍历 DIE
+    auto complete() const -> bool {
+        wait();
+        return table.complete;
+    }
+
+    // 索引是否已经建立完成，不会等待
+    auto ready() const -> bool {
+        return !pending.valid()
+            || pending.wait_for(std::chrono::seconds{0}) == std::future_status::ready;
+    }
+
+    // 工作线程建立索引的耗时
+    auto build_time() const -> double {
+        wait();
+        return table.build_ms;
+    }
+
+public:
+    // 按位置在 dwarf 中取回 DIE，找不到时返回无效的 DIE
+    static auto resolve(dwarf::dwarf const& dwarf, Location const& location) -> dwarf::die {
+        auto const& units = dwarf.compilation_units();
+        auto cu = std::lower_bound(units.begin(), units.end(), location.cu,
+            [](dwarf::compilation_unit const& unit, dwarf::section_offset offset) {
+                return unit.get_section_offset() < offset;
+            });
+        if (cu == units.end() || cu->get_section_offset() != location.cu) {
+            return dwarf::die{};
+        }
+        return find_die_by_offset(cu->root(), location.die);
+    }
+
+private:
+    struct Table {
+        std::unordered_map<std::string, std::vector<Location>> locations;
+        bool complete;
+        double build_ms;
+    };
+
+    auto wait() const -> void {
+        if (pending.valid()) {
+            table = pending.get();
+        }
+    }
+
+    // 工作线程的入口
+    static auto build(std::string program) -> Table {
+        Stopwatch stopwatch{};
+        Table table{{}, false, 0};
+
+        int fd = open(program.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return table;
+        }
+
+        try {
+            elf::elf elf{elf::create_mmap_loader(fd)};
+            close(fd);
+
+            if (read_pubnames(elf, ".debug_gnu_pubnames", true, table)
+                || read_pubnames(elf, ".debug_pubnames", false, table)) {
+                table.build_ms = stopwatch.elapsed_ms();
+                return table;
+            }
+
+            dwarf::dwarf dwarf{dwarf::elf::create_loader(elf)};
+            for (auto const& cu : dwarf.compilation_units()) {
+                collect(cu.get_section_offset(), cu.root(), table);
+            }
+            table.complete = true;
+        } catch (std::exception const& exc) {
+            // 索引建立失败时，查找会退回到遍历 DIE
+            table.locations.clear();
+            table.complete = false;
+        }
+
+        table.build_ms = stopwatch.elapsed_ms();
+        return table;
+    }
+
+    // 解析 pubnames 节，每组的格式为
+    // unit_length, version, debug_info_offset, debug_info_length, 之后是 (die_offset, [flags], name) 直到 die_offset 为 0
+    static auto read_pubnames(elf::elf const& elf, std::string const& name, bool gnu, Table& table) -> bool {
+        auto const *section = find_section(elf, name);
+        if (section == nullptr || section->size() == 0) {
+            return false;
+        }
+
+        auto const *begin = static_cast<const char *>(section->data());
+        auto const *end = begin + section->size();
+        auto const *p = begin;
+
+        while (p + 4 <= end) {
+            uint64_t length = read<uint32_t>(p);
+            std::size_t offset_size = 4;
+            if (length == 0xffffffff) {
+                if (p + 8 > end) {
+                    break;
+                }
+                length = read<uint64_t>(p);
+                offset_size = 8;
+            }
+            auto const *set_end = p + length;
+            if (set_end > end || p + 2 + 2 * offset_size > set_end) {
+                break;
+            }
+
+            p += 2;  // version
+            auto cu_offset = read_offset(p, offset_size);
+            read_offset(p, offset_size);  // debug_info_length
+
+            while (p + offset_size <= set_end) {
+                auto die_offset = read_offset(p, offset_size);
+                if (die_offset == 0) {
+                    break;
+                }
+                if (gnu) {
+                    ++p;  // flags
+                }
+                auto len = strnlen(p, set_end - p);
+                table.locations[std::string{p, len}].push_back(Location{cu_offset, cu_offset + die_offset});
+                p += len + 1;
+            }
+
+            p = set_end;
+        }
+
+        return !table.locations.empty();
+    }
+
+    // 递归收集带地址的函数的名称和链接名
+    static auto collect(dwarf::section_offset cu, dwarf::die const& die, Table& table) -> void {
+        for (auto const& child : die) {
+            if (child.tag == dwarf::DW_TAG::subprogram) {
+                if (child.has(dwarf::DW_AT::low_pc) || child.has(dwarf::DW_AT::ranges)) {
+                    Location location{cu, child.get_section_offset()};
+                    for (auto const& name : names_of(child)) {
+                        table.locations[name].push_back(location);
+                    }
+                }
+            } else if (child.tag == dwarf::DW_TAG::namespace_
+                || child.tag == dwarf::DW_TAG::class_type
+                || child.tag == dwarf::DW_TAG::structure_type) {
+                collect(cu, child, table);
+            }
+        }
+    }
+
+    // 函数的名称和链接名，类外定义的成员函数、内联函数的实体要沿着 specification/abstract_origin 去找
+    static auto names_of(dwarf::die const& die) -> std::vector<std::string> {
+        std::vector<std::string> names{};
+        auto current = die;
+        for (auto depth = 0; depth < 4 && current.valid(); ++depth) {
+            if (names.empty() && current.has(dwarf::DW_AT::name)) {
+                names.push_back(current[dwarf::DW_AT::name].as_string());
+            }
+            if (current.has(dwarf::DW_AT::linkage_name)) {
+                names.push_back(current[dwarf::DW_AT::linkage_name].as_string());
+                break;
+            }
+            if (current.has(dwarf::DW_AT::specification)) {
+                current = current[dwarf::DW_AT::specification].as_reference();
+            } else if (current.has(dwarf::DW_AT::abstract_origin)) {
+                current = current[dwarf::DW_AT::abstract_origin].as_reference();
+            } else {
+                break;
+            }
+        }
+        return names;
+    }
+
+    static auto find_section(elf::elf const& elf, std::string const& name) -> elf::section const * {
+        for (auto const& section : elf.sections()) {
+            if (section.get_name() == name) {
+                return &section;
+            }
+        }
+        return nullptr;
+    }
+
+    template <typename T>
+    static auto read(const char *& p) -> T {
+        T value;
+        memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        return value;
+    }
+
+    static auto read_offset(const char *& p, std::size_t offset_size) -> uint64_t {
+        return offset_size == 8 ? read<uint64_t>(p) : read<uint32_t>(p);
+    }
+
+private:
+    mutable std::future<Table> pending;
+    mutable Table table;
+};
+
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+/**
+ * 软件观察点：记录被观察的地址区间以及它们所在的页
+ * 这些页在 tracee 中被去掉写权限，写入时 tracee 收到 SIGSEGV，调试器再判断写的是不是被观察的区间
+ * 数量和长度都没有限制，可以观察整个结构体或者数组
+ * 内核不会因为写这些页产生 SIGSEGV：read 等系统调用向这些页写入时直接以 EFAULT 失败，调试器看不到
+ * 栈上的页不能去掉写权限，内核在那里构造信号栈帧失败时 tracee 会被结束，所以不观察线程的栈
+ * 本类只管理数据，修改页权限（向 tracee 注入 mprotect）由 Inferior 完成
+ */
+
+#include <ptrace_proxy.hh>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <sys/mman.h>
+
+namespace BitTech {
+
+class PageWatcher {
+public:
+    struct Watch {
+        int id;
+        std::intptr_t addr;
+        std::size_t len;
+        // 上次看到的内容
+        std::vector<uint8_t> value;
+    };
+
+    static const std::intptr_t page_size = 4096;
+
+public:
+    PageWatcher(): watches{}, protections{}, next_id{1} {}
+
+public:
+    auto add(std::intptr_t addr, std::size_t len) -> Watch& {
+        watches.push_back(Watch{next_id++, addr, len, std::vector<uint8_t>(len)});
+        return watches.back();
+    }
+
+    auto empty() const -> bool {
+        return watches.empty();
+    }
+
+    auto all() -> std::vector<Watch>& {
+        return watches;
+    }
+
+    // 所有被观察的区间覆盖的页
+    auto pages() const -> std::vector<std::intptr_t> {
+        std::vector<std::intptr_t> result{};
+        for (auto const& watch : watches) {
+            for (auto page = page_of(watch.addr); page < static_cast<std::intptr_t>(watch.addr + watch.len); page += page_size) {
+                result.push_back(page);
+            }
+        }
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+
+    // 地址所在的页是否已经被去掉写权限
+    auto is_protected(std::intptr_t addr) const -> bool {
+        return protections.count(page_of(addr)) != 0;
+    }
+
+    // 页原来的权限，恢复和临时放开写权限时使用
+    auto original_protection(std::intptr_t page) const -> int {
+        return protections.at(page);
+    }
+
+    auto mark_protected(std::intptr_t page, int prot) -> void {
+        protections[page] = prot;
+    }
+
+    // 已经去掉写权限的页 -> 原来的权限，脱离 tracee 时逐个恢复
+    auto protected_pages() const -> std::map<std::intptr_t, int> const& {
+        return protections;
+    }
+
+    // 装载偏移变化时整体平移所有观察的区间
+    auto rebase(std::intptr_t delta) -> void {
+        for (auto& watch : watches) {
+            watch.addr += delta;
+        }
+    }
+
+    // tracee 结束后，页的权限随着进程一起消失
+    auto clear_protections() -> void {
+        protections.clear();
+    }
+
+public:
+    static auto page_of(std::intptr_t addr) -> std::intptr_t {
+        return addr & ~(page_size - 1);
+    }
+
+    // /proc/pid/maps 中的一个映射
+    struct Mapping {
+        std::intptr_t start;
+        std::intptr_t end;
+        int prot;
+        // 主线程的栈 [stack]
+        bool is_stack;
+    };
+
+    // 从 /proc/pid/maps 中找出 addr 所在的映射，找不到时返回 false
+    static auto find_mapping(pid_t pid, std::intptr_t addr, Mapping& mapping) -> bool {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+        auto maps = fopen(path, "r");
+        if (maps == nullptr) {
+            return false;
+        }
+
+        auto found = false;
+        unsigned long start, end;
+        char perms[5];
+        char line[512];
+        while (fgets(line, sizeof(line), maps) != nullptr) {
+            if (sscanf(line, "%lx-%lx %4s", &start, &end, perms) != 3) {
+                continue;
+            }
+            if (static_cast<unsigned long>(addr) >= start && static_cast<unsigned long>(addr) < end) {
+                mapping.start = static_cast<std::intptr_t>(start);
+                mapping.end = static_cast<std::intptr_t>(end);
+                mapping.prot = (perms[0] == 'r' ? PROT_READ : 0) | (perms[1] == 'w' ? PROT_WRITE : 0)
+                    | (perms[2] == 'x' ? PROT_EXEC : 0);
+                mapping.is_stack = strstr(line, "[stack]") != nullptr;
+                found = true;
+                break;
+            }
+        }
+        fclose(maps);
+        return found;
+    }
+
+    // addr 所在映射的权限，找不到时返回 -1
+    static auto read_protection(pid_t pid, std::intptr_t addr) -> int {
+        Mapping mapping;
+        return find_mapping(pid, addr, mapping) ? mapping.prot : -1;
+    }
+
+private:
+    std::vector<Watch> watches;
+    // 已经去掉写权限的页 -> 原来的权限
+    std::map<std::intptr_t, int> protections;
+    int next_id;
+};
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+/**
+ * 简单的并行 for：启动一组工作线程，从共享的计数器中领取下标，直到全部处理完
+ */
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <exception>
+#include <algorithm>
+#include <mutex>
+
+namespace BitTech {
+
+// 对 [0, n) 中的每个 i 调用 fn(i)，所有调用结束后才返回
+// 工作线程抛出的第一个异常会在调用线程中重新抛出
+template <typename Fn>
+auto parallel_for(std::size_t n, Fn fn) -> void {
+    std::size_t workers = std::max(1u, std::thread::hardware_concurrency());
+    workers = std::min(workers, n);
+    if (workers <= 1) {
+        for (std::size_t i = 0; i < n; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    std::atomic<std::size_t> next{0};
+    std::exception_ptr error{};
+    std::mutex error_mutex{};
+
+    auto work = [&]() {
+        for (auto i = next++; i < n; i = next++) {
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock{error_mutex};
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads{};
+    for (std::size_t t = 1; t < workers; ++t) {
+        threads.emplace_back(work);
+    }
+    // 调用线程自己也参与工作
+    work();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+/**
+ * 采样分析器
+ * 定时器到期时 SIGALRM 打断调试器在 waitpid 中的等待，Inferior 暂停所有线程，用 Unwinder 回溯每个线程的调用栈后立即恢复运行
+ * 采样时只记录地址，结束后才查询调试信息把地址换成函数名，输出 flame graph 使用的 folded stacks 格式
+ */
+
+#include <unwinder.hh>
+#include <stopwatch.hh>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdint>
+#include <signal.h>
+#include <sys/time.h>
+
+namespace BitTech {
+
+class Profiler {
+public:
+    // 最多回溯的栈帧数
+    static const std::size_t max_depth = 128;
+
+public:
+    Profiler(double seconds, int hz)
+        : seconds{seconds}, hz{hz}, stopwatch{}, old_action{}, pcs{},
+          samples{}, sample_count{0}, pause_count{0}, total_pause_ms{0}, max_pause_ms{0}, elapsed_ms{0} {}
+
+public:
+    // 开始定时，SIGALRM 不设置 SA_RESTART，阻塞在 waitpid 中时会返回 EINTR
+    auto start() -> void {
+        ticks() = 0;
+        struct sigaction action{};
+        action.sa_handler = on_alarm;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGALRM, &action, &old_action);
+
+        auto usec = 1000000 / hz;
+        struct itimerval timer{{usec / 1000000, usec % 1000000}, {usec / 1000000, usec % 1000000}};
+        setitimer(ITIMER_REAL, &timer, nullptr);
+        stopwatch.restart();
+    }
+
+    auto stop() -> void {
+        struct itimerval timer{};
+        setitimer(ITIMER_REAL, &timer, nullptr);
+        sigaction(SIGALRM, &old_action, nullptr);
+        elapsed_ms = stopwatch.elapsed_ms();
+    }
+
+    // 上次调用之后定时器到期过
+    auto take_tick() -> bool {
+        if (ticks() == 0) {
+            return false;
+        }
+        ticks() = 0;
+        return true;
+    }
+
+    auto expired() const -> bool {
+        return stopwatch.elapsed_ms() >= seconds * 1000;
+    }
+
+public:
+    // 记录一次采样，frames 是从栈顶开始的调用栈
+    auto sample(std::vector<Unwinder::Frame> const& frames) -> void {
+        // folded stacks 从栈底写到栈顶
+        // 返回地址可能已经是下一个函数了，减 1 落在 call 指令上
+        pcs.clear();
+        for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+            pcs.push_back(it + 1 == frames.rend() ? it->pc : it->pc - 1);
+        }
+        ++samples[pcs];
+        ++sample_count;
+    }
+
+    // 一次采样中线程暂停的时间
+    auto add_pause(double ms) -> void {
+        ++pause_count;
+        total_pause_ms += ms;
+        max_pause_ms = std::max(max_pause_ms, ms);
+    }
+
+public:
+    // 每种调用栈被采到的次数，地址从栈底到栈顶
+    auto stacks() const -> std::map<std::vector<std::intptr_t>, uint64_t> const& {
+        return samples;
+    }
+
+    auto count() const -> uint64_t {
+        return sample_count;
+    }
+
+    auto pauses() const -> uint64_t {
+        return pause_count;
+    }
+
+    auto average_pause_us() const -> double {
+        return pause_count == 0 ? 0 : total_pause_ms * 1000 / pause_count;
+    }
+
+    auto max_pause_us() const -> double {
+        return max_pause_ms * 1000;
+    }
+
+    auto elapsed_seconds() const -> double {
+        return elapsed_ms / 1000;
+    }
+
+private:
+    static auto ticks() -> volatile sig_atomic_t& {
+        static volatile sig_atomic_t count = 0;
+        return count;
+    }
+
+    static auto on_alarm(int) -> void {
+        ticks() = 1;
+    }
+
+private:
+    double seconds;
+    int hz;
+    Stopwatch stopwatch;
+    struct sigaction old_action;
+    std::vector<std::intptr_t> pcs;
+    std::map<std::vector<std::intptr_t>, uint64_t> samples;
+    uint64_t sample_count;
+    uint64_t pause_count;
+    double total_pause_ms;
+    double max_pause_ms;
+    double elapsed_ms;
+};
+
+}
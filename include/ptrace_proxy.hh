@@ -7,66 +7,168 @@
 
 #include <sys/ptrace.h>
 #include <sys/user.h>
+#include <sys/uio.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
 #include <cstdint>
+#include <cstddef>
 
 
 namespace BitTech {
 
 class PtraceProxy {
+public:
+    // 各类系统调用的次数，用于观察调试器本身的开销
+    struct Counters {
+        uint64_t getregs;
+        uint64_t setregs;
+        uint64_t resumes;
+        uint64_t memory_reads;
+        uint64_t memory_writes;
+    };
+
+    static auto counters() -> Counters& {
+        static Counters c{};
+        return c;
+    }
+
 public:
     // 唯一一个被 tracee 调用，标志自己被 trace
     static auto trace_me() -> void {
         ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
     }
 
+    // 附加到线程上，不会让线程停下，options 是 PTRACE_O_* 的组合
+    // 和 PTRACE_TRACEME 不同，之后可以用 PTRACE_INTERRUPT 让正在运行的线程停下
+    static auto seize(pid_t pid, long options) -> bool {
+        return ptrace(PTRACE_SEIZE, pid, nullptr, options) == 0;
+    }
+
+    // 脱离停下的线程，signo 不为 0 时同时发送这个信号
+    static auto detach(pid_t tid, int signo) -> bool {
+        return ptrace(PTRACE_DETACH, tid, nullptr, signo) == 0;
+    }
+
+    // 让正在运行的线程停下，之后线程会以 PTRACE_EVENT_STOP 报告
+    // 只是发出请求，不等待，停很多线程时先全部发出再统一 waitpid
+    static auto interrupt(pid_t tid) -> void {
+        ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr);
+    }
+
+    // PTRACE_EVENT_* 停止附带的数据，例如 PTRACE_EVENT_CLONE 时是新线程的 tid
+    static auto get_event_message(pid_t tid) -> unsigned long {
+        unsigned long message = 0;
+        ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &message);
+        return message;
+    }
+
     // 不发送信号的继续执行 tracee
     static auto continue_tracee(pid_t pid) -> void {
+        ++counters().resumes;
         ptrace(PTRACE_CONT, pid, nullptr, nullptr);
     }
 
     // 发送 signo 信号给 tracee 以继续执行
     static auto delivery_signal_tracee(pid_t pid, int signo) -> void {
+        ++counters().resumes;
         ptrace(PTRACE_CONT, pid, nullptr, signo);
     }
 
-    // 读取 addr 地址处的内存数据，共读取 64 Bit
-    static auto read_memory(pid_t pid, std::intptr_t addr) -> uint64_t {
-        return ptrace(PTRACE_PEEKDATA, pid, addr, nullptr);
+    // 继续执行 tracee，并在下一次进入或者离开系统调用时停下，signo 不为 0 时同时发送这个信号
+    static auto syscall_tracee(pid_t pid, int signo) -> void {
+        ++counters().resumes;
+        ptrace(PTRACE_SYSCALL, pid, nullptr, signo);
+    }
+
+    // 从 addr 地址处读取 len 字节到 buf，返回实际读到的字节数
+    // 只读到一部分时，返回值小于 len，buf 中前面的部分是有效数据
+    static auto read_memory(pid_t pid, std::intptr_t addr, void *buf, std::size_t len) -> std::size_t {
+        auto done = transfer(pid, addr, buf, len, false);
+        if (done < len) {
+            // process_vm_readv 会在不可访问的页停下，/proc/pid/mem 会忽略页的保护属性
+            done += transfer_proc_mem(pid, addr + done, static_cast<char *>(buf) + done, len - done, false);
+        }
+        return done;
+    }
+
+    // 只用 process_vm_readv 读，遇到不可访问的页就停下，不再尝试 /proc/pid/mem
+    // 读栈这类不知道边界在哪里的大块内存时使用
+    // 一个 iovec 跨过不可访问的页时整个失败，所以远端按页拆开，一次系统调用读到第一个不可访问的页为止
+    static auto read_accessible(pid_t pid, std::intptr_t addr, void *buf, std::size_t len) -> std::size_t {
+        static const std::intptr_t page_size = 4096;
+        static const std::size_t max_pages = 64;
+        struct iovec remote[max_pages];
+        std::size_t count = 0;
+        std::size_t covered = 0;
+        while (covered < len && count < max_pages) {
+            auto start = addr + static_cast<std::intptr_t>(covered);
+            auto next_page = (start & ~(page_size - 1)) + page_size;
+            auto n = std::min(len - covered, static_cast<std::size_t>(next_page - start));
+            remote[count++] = iovec{reinterpret_cast<void *>(start), n};
+            covered += n;
+        }
+        struct iovec local{buf, covered};
+        ++counters().memory_reads;
+        auto n = process_vm_readv(pid, &local, 1, remote, count, 0);
+        return n <= 0 ? 0 : static_cast<std::size_t>(n);
     }
 
-    // 设置 addr 地址处的内存数据，设置为 data，共设置 64 Bit
-    static auto write_memory(pid_t pid, std::intptr_t addr, uint64_t data) -> void {
-        ptrace(PTRACE_POKEDATA, pid, addr, data);
+    // 一次 process_vm_readv 读取多段内存，remote[i] 读到 local[i]，返回读到的总字节数
+    // 失败时停在某一段的边界上，之前的各段完整有效
+    static auto read_ranges(pid_t pid, struct iovec const *local, struct iovec const *remote, std::size_t count) -> std::size_t {
+        if (count == 0) {
+            return 0;
+        }
+        ++counters().memory_reads;
+        auto n = process_vm_readv(pid, local, count, remote, count, 0);
+        return n <= 0 ? 0 : static_cast<std::size_t>(n);
+    }
+
+    // 将 buf 中的 len 字节写到 addr 地址处，返回实际写入的字节数
+    static auto write_memory(pid_t pid, std::intptr_t addr, void const *buf, std::size_t len) -> std::size_t {
+        auto done = transfer(pid, addr, const_cast<void *>(buf), len, true);
+        if (done < len) {
+            // 代码段是只读的，process_vm_writev 写不进去，要通过 /proc/pid/mem 写
+            done += transfer_proc_mem(pid, addr + done, static_cast<char *>(const_cast<void *>(buf)) + done, len - done, true);
+        }
+        return done;
+    }
+
+    // 修改代码段用，直接通过 /proc/pid/mem 写，不必先让 process_vm_writev 失败一次
+    static auto patch_memory(pid_t pid, std::intptr_t addr, void const *buf, std::size_t len) -> std::size_t {
+        return transfer_proc_mem(pid, addr, static_cast<char *>(const_cast<void *>(buf)), len, true);
+    }
+
+    // tracee 结束后关闭缓存的 /proc/pid/mem，避免 pid 被复用时访问到错误的进程
+    static auto release_memory(pid_t pid) -> void {
+        proc_mem(pid, true);
     }
 
     // 获取所有通用寄存器内容，struct user_regs_struct 结构见 /usr/include/sys/user.h 文件
     static auto get_registers(pid_t pid) -> struct user_regs_struct {
         struct user_regs_struct regs;
+        ++counters().getregs;
         ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
         return regs;
     }
 
     // 设置所有通用寄存器内容，struct user_regs_struct 结构见 /usr/include/sys/user.h 文件
-    static auto set_registers(pid_t pid, user_regs_struct regs) -> void {
-        ptrace(PTRACE_SETREGS, pid, nullptr, &regs);
-    }
-
-    // 获取 PC 寄存器内容
-    static auto get_pc(pid_t pid) -> std::intptr_t {
-        return get_registers(pid).rip;
+    static auto set_registers(pid_t pid, user_regs_struct const& regs) -> void {
+        ++counters().setregs;
+        ptrace(PTRACE_SETREGS, pid, nullptr, const_cast<user_regs_struct *>(&regs));
     }
 
-    // 设置 PC 寄存器内容
-    static auto set_pc(pid_t pid, std::intptr_t pc) -> void {
-        auto regs = get_registers(pid);
-        regs.rip = pc;
-        set_registers(pid, regs);
+    // 读取调试寄存器 DRn
+    static auto get_debug_register(pid_t pid, int n) -> uint64_t {
+        return ptrace(PTRACE_PEEKUSER, pid, offsetof(struct user, u_debugreg) + n * sizeof(long), nullptr);
     }
 
-    // 获取栈帧寄存器内容
-    static auto get_frame_pointer(pid_t pid) -> uint64_t {
-        return get_registers(pid).rbp;
+    // 写入调试寄存器 DRn，内核拒绝（例如地址不在用户空间）时返回 false
+    static auto set_debug_register(pid_t pid, int n, uint64_t value) -> bool {
+        return ptrace(PTRACE_POKEUSER, pid, offsetof(struct user, u_debugreg) + n * sizeof(long), value) == 0;
     }
 
     // 获取使得 tracee 停止的信号信息
@@ -78,8 +180,74 @@ public:
 
     // 单步执行，一次只执行一步机器码，而不是编程语言级别的单步
     static auto single_step(pid_t pid) -> void {
+        ++counters().resumes;
         ptrace(PTRACE_SINGLESTEP, pid, nullptr, nullptr);
     }
+
+private:
+    // 使用 process_vm_readv/process_vm_writev 读写，一次系统调用可以搬运任意长度
+    static auto transfer(pid_t pid, std::intptr_t addr, void *buf, std::size_t len, bool write) -> std::size_t {
+        std::size_t done = 0;
+        while (done < len) {
+            struct iovec local{static_cast<char *>(buf) + done, len - done};
+            struct iovec remote{reinterpret_cast<void *>(addr + done), len - done};
+            ++(write ? counters().memory_writes : counters().memory_reads);
+            auto n = write
+                ? process_vm_writev(pid, &local, 1, &remote, 1, 0)
+                : process_vm_readv(pid, &local, 1, &remote, 1, 0);
+            if (n <= 0) {
+                break;
+            }
+            done += n;
+        }
+        return done;
+    }
+
+    // 使用 /proc/pid/mem 读写
+    static auto transfer_proc_mem(pid_t pid, std::intptr_t addr, char *buf, std::size_t len, bool write) -> std::size_t {
+        auto fd = proc_mem(pid, false);
+        if (fd < 0) {
+            return 0;
+        }
+
+        std::size_t done = 0;
+        while (done < len) {
+            ++(write ? counters().memory_writes : counters().memory_reads);
+            auto n = write
+                ? pwrite(fd, buf + done, len - done, addr + done)
+                : pread(fd, buf + done, len - done, addr + done);
+            if (n <= 0) {
+                break;
+            }
+            done += n;
+        }
+        return done;
+    }
+
+    // 缓存最近一个 tracee 的 /proc/pid/mem 文件描述符
+    static auto proc_mem(pid_t pid, bool release) -> int {
+        static pid_t cached_pid = -1;
+        static int fd = -1;
+
+        if (release || cached_pid != pid) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            fd = -1;
+            cached_pid = -1;
+        }
+        if (release) {
+            return -1;
+        }
+
+        if (fd < 0) {
+            char path[64];
+            snprintf(path, sizeof(path), "/proc/%d/mem", pid);
+            fd = open(path, O_RDWR | O_CLOEXEC);
+            cached_pid = pid;
+        }
+        return fd;
+    }
 };
 
 }
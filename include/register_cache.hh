@@ -0,0 +1,91 @@
+#pragma once
+
+/**
+ * 单个线程的寄存器缓存
+ * 每次停下后最多 GETREGS 一次，修改只记录在缓存里，恢复运行前才用一次 SETREGS 写回
+ */
+
+#include <ptrace_proxy.hh>
+#include <sys/user.h>
+#include <cstdint>
+
+namespace BitTech {
+
+class RegisterCache {
+public:
+    explicit RegisterCache(pid_t tid): tid{tid}, regs{}, is_valid{false}, is_dirty{false} {}
+
+public:
+    auto get() -> user_regs_struct const& {
+        fetch();
+        ++reads();
+        return regs;
+    }
+
+    auto set(user_regs_struct const& new_regs) -> void {
+        regs = new_regs;
+        is_valid = true;
+        is_dirty = true;
+    }
+
+    auto pc() -> std::intptr_t {
+        return get().rip;
+    }
+
+    auto set_pc(std::intptr_t pc) -> void {
+        fetch();
+        regs.rip = pc;
+        is_dirty = true;
+    }
+
+    auto frame_pointer() -> uint64_t {
+        return get().rbp;
+    }
+
+    // 设置 EFLAGS 中的 RF 位，恢复运行后第一条指令不会触发硬件执行断点
+    auto set_resume_flag() -> void {
+        fetch();
+        regs.eflags |= 0x10000;
+        is_dirty = true;
+    }
+
+public:
+    // 恢复运行前调用，把修改过的寄存器写回
+    auto flush() -> void {
+        if (is_dirty) {
+            PtraceProxy::set_registers(tid, regs);
+            is_dirty = false;
+        }
+    }
+
+    // 线程恢复运行后，缓存的内容就不再有效
+    auto invalidate() -> void {
+        is_valid = false;
+        is_dirty = false;
+    }
+
+public:
+    // 所有线程的缓存一共被读取了多少次，和 PtraceProxy::counters().getregs 对比就是省下的系统调用
+    static auto reads() -> uint64_t& {
+        static uint64_t n = 0;
+        return n;
+    }
+
+private:
+    auto fetch() -> void {
+        if (!is_valid) {
+            regs = PtraceProxy::get_registers(tid);
+            is_valid = true;
+        }
+    }
+
+private:
+    pid_t tid;
+    user_regs_struct regs;
+    // 缓存的内容和线程的寄存器一致
+    bool is_valid;
+    // 缓存被修改过，还没写回线程
+    bool is_dirty;
+};
+
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+/**
+ * 源文件缓存，每次停下打印代码时使用
+ * 每个文件只 mmap 一次，映射时用 SSE2 一次比较 16 个字节找出所有换行，建立每行开头的偏移表，
+ * 之后取任意一行都是 O(1)，不需要再从文件开头逐行读取
+ * 每次取用前比较文件的修改时间和大小，文件被改动后重新映射
+ */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <emmintrin.h>
+
+namespace BitTech {
+
+class SourceFile {
+public:
+    SourceFile(SourceFile const&) = delete;
+    auto operator=(SourceFile const&) -> SourceFile& = delete;
+
+    ~SourceFile() {
+        if (base != nullptr) {
+            munmap(const_cast<char *>(base), size);
+        }
+    }
+
+public:
+    // 映射文件并建立行偏移表，打不开时返回空指针
+    static auto open(std::string const& path, struct stat const& st) -> std::unique_ptr<SourceFile> {
+        auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return nullptr;
+        }
+        auto size = static_cast<std::size_t>(st.st_size);
+        void *base = nullptr;
+        if (size > 0) {
+            base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (base == MAP_FAILED) {
+            return nullptr;
+        }
+        return std::unique_ptr<SourceFile>{new SourceFile{static_cast<char const *>(base), size, st}};
+    }
+
+    // 文件的修改时间或者大小变了
+    auto stale(struct stat const& st) const -> bool {
+        return st.st_size != static_cast<off_t>(size) || st.st_ino != inode
+            || st.st_mtim.tv_sec != mtime.tv_sec || st.st_mtim.tv_nsec != mtime.tv_nsec;
+    }
+
+    // 第 line 行（从 1 开始）的内容，不含换行符，超出范围时返回 false
+    auto line(std::size_t line, char const *& text, std::size_t& len) const -> bool {
+        if (line == 0 || line > starts.size()) {
+            return false;
+        }
+        auto begin = starts[line - 1];
+        auto end = line < starts.size() ? starts[line] - 1 : size;
+        if (line == starts.size() && end > begin && base[end - 1] == '\n') {
+            --end;
+        }
+        text = base + begin;
+        len = end - begin;
+        return true;
+    }
+
+private:
+    SourceFile(char const *base, std::size_t size, struct stat const& st)
+        : base{base}, size{size}, inode{st.st_ino}, mtime(st.st_mtim), starts{} {
+        index_lines();
+    }
+
+    // 每行开头的偏移；最后一行以换行结尾时，换行之后不再算一行
+    auto index_lines() -> void {
+        if (size == 0) {
+            return;
+        }
+        starts.reserve(size / 32 + 1);
+        starts.push_back(0);
+
+        auto const newline = _mm_set1_epi8('\n');
+        std::size_t at = 0;
+        for (; at + 16 <= size; at += 16) {
+            auto chunk = _mm_loadu_si128(reinterpret_cast<__m128i const *>(base + at));
+            auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+            while (mask != 0) {
+                starts.push_back(at + __builtin_ctz(mask) + 1);
+                mask &= mask - 1;
+            }
+        }
+        for (; at < size; ++at) {
+            if (base[at] == '\n') {
+                starts.push_back(at + 1);
+            }
+        }
+        if (starts.back() == size) {
+            starts.pop_back();
+        }
+    }
+
+private:
+    char const *base;
+    std::size_t size;
+    ino_t inode;
+    timespec mtime;
+    // 第 i 行（从 0 开始）在文件中的偏移
+    std::vector<std::size_t> starts;
+};
+
+class SourceCache {
+public:
+    SourceCache(): files{} {}
+
+public:
+    // 取得文件，第一次使用或者文件被改动后重新映射，文件不存在时返回空指针
+    auto get(std::string const& path) -> SourceFile const * {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            files.erase(path);
+            return nullptr;
+        }
+        auto& file = files[path];
+        if (file == nullptr || file->stale(st)) {
+            file = SourceFile::open(path, st);
+        }
+        return file.get();
+    }
+
+    // 打印 line 前后 n_context 行，当前行用 -> 标出，整段拼好后一次写出
+    auto list(std::string const& path, unsigned int line, unsigned int n_context) -> void {
+        auto file = get(path);
+        if (file == nullptr) {
+            return;
+        }
+        unsigned int start = n_context >= line ? 1 : line - n_context;
+        unsigned int end = line + n_context;
+
+        std::string out{};
+        char prefix[32];
+        char const *text = nullptr;
+        std::size_t len = 0;
+        for (auto current = start; current <= end && file->line(current, text, len); ++current) {
+            auto n = snprintf(prefix, sizeof(prefix), "%s%3d|", current == line ? "->" : "  ", current);
+            out.append(prefix, n);
+            out.append(text, len);
+            out += '\n';
+        }
+        fwrite(out.data(), 1, out.size(), stdout);
+    }
+
+private:
+    std::unordered_map<std::string, std::unique_ptr<SourceFile>> files;
+};
+
+}
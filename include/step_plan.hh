@@ -0,0 +1,40 @@
+#pragma once
+
+/**
+ * 单步计划：next/step 在一个函数中需要用到的信息
+ * 每个函数只计算一次，之后在同一个函数里反复 next 时直接使用
+ */
+
+#include <set>
+#include <map>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+namespace BitTech {
+
+struct StepPlan {
+    // 函数的地址区间，函数可能被拆成多段（DW_AT_ranges）
+    std::vector<std::pair<std::intptr_t, std::intptr_t>> ranges;
+    // 函数中内联展开的地址区间，next 不应该停在这些区间里
+    std::vector<std::pair<std::intptr_t, std::intptr_t>> inlined;
+    // 函数中每一行开始处的地址和行号，不包括内联展开中的行
+    // 同一行连续的多条行表记录只取第一条，与 LineIndex 的反向索引一致
+    std::map<std::intptr_t, unsigned int> line_addrs;
+};
+
+// 已经布置到 tracee 中的单步计划，只在同一个栈帧里连续单步时保留
+struct ArmedStepPlan {
+    // 对应的 StepPlan，nullptr 表示没有布置
+    StepPlan const *plan;
+    // 布置时的栈帧，用于判断是否还在同一个函数调用中
+    uint64_t frame;
+    // 返回地址，0 表示没有为返回地址设置断点
+    std::intptr_t return_address;
+    // 单步开始时所在的行，这一行的开始地址不设置断点，否则循环回到本行或者本行的另一段时就会停下
+    unsigned int line;
+    // 由单步计划加入的断点，撤销时只删除这些
+    std::set<std::intptr_t> owned;
+};
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+/**
+ * 计时器，用于统计启动和建立索引的耗时
+ */
+
+#include <chrono>
+
+namespace BitTech {
+
+class Stopwatch {
+public:
+    Stopwatch(): start{std::chrono::steady_clock::now()} {}
+
+public:
+    // 从创建或者上次 restart 到现在经过的毫秒数
+    auto elapsed_ms() const -> double {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // 返回经过的毫秒数并重新开始计时
+    auto restart() -> double {
+        auto ms = elapsed_ms();
+        start = std::chrono::steady_clock::now();
+        return ms;
+    }
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+/**
+ * 捕获系统调用
+ * tracee 在 execv 之前安装 seccomp-BPF 过滤器，只有关心的系统调用返回 SECCOMP_RET_TRACE，产生 PTRACE_EVENT_SECCOMP 停止
+ * 其他系统调用不经过调试器，不像 PTRACE_SYSCALL 那样每个系统调用都要停两次
+ * 进入时停下的线程用 PTRACE_SYSCALL 恢复运行，返回时再停一次（PTRACE_O_TRACESYSGOOD 标记的 SIGTRAP | 0x80），记下返回值和耗时
+ * 过滤器只能在启动时安装，之后不能修改；不再关心的系统调用停下后直接继续运行
+ */
+
+#include <syscall_table.hh>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+#include <sys/prctl.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <linux/audit.h>
+
+namespace BitTech {
+
+class SyscallCatcher {
+public:
+    enum class Mode {
+        none,  // 不关心
+        stop,  // 进入时停下，返回时打印返回值
+        log,   // 进入和返回都不停下，返回时打印一行调用和返回值
+    };
+
+    // 一次进行中的系统调用
+    struct Call {
+        long nr;
+        uint64_t args[6];
+        std::chrono::steady_clock::time_point start;
+    };
+
+    struct Stat {
+        uint64_t calls;
+        uint64_t errors;
+        uint64_t total_ns;
+        uint64_t max_ns;
+    };
+
+public:
+    SyscallCatcher()
+        : modes(SyscallTable::max_nr, Mode::none), all_mode{Mode::none}, installed{}, is_installed_all{false},
+          is_installed{false}, calls{}, stats{} {}
+
+public:
+    auto set(long nr, Mode mode) -> void {
+        modes[nr] = mode;
+    }
+
+    // 捕获所有系统调用，单独设置过的系统调用按单独的设置
+    auto set_all(Mode mode) -> void {
+        all_mode = mode;
+    }
+
+    // 取消所有捕获，统计数据保留
+    auto clear() -> void {
+        std::fill(modes.begin(), modes.end(), Mode::none);
+        all_mode = Mode::none;
+    }
+
+    auto mode_of(long nr) const -> Mode {
+        if (nr < 0 || nr >= SyscallTable::max_nr) {
+            return all_mode;
+        }
+        return modes[nr] != Mode::none ? modes[nr] : all_mode;
+    }
+
+    auto active() const -> bool {
+        return all_mode != Mode::none
+            || std::any_of(modes.begin(), modes.end(), [](Mode mode) { return mode != Mode::none; });
+    }
+
+public:
+    // 由关心的系统调用生成过滤器：先检查架构，然后每个系统调用一条比较加一条返回，不需要超过 255 条指令的跳转
+    auto filter() const -> std::vector<sock_filter> {
+        std::vector<sock_filter> program{
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch)),
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 1, 0),
+            BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+        };
+        if (all_mode != Mode::none) {
+            program.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+            return program;
+        }
+        program.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)));
+        for (long nr = 0; nr < SyscallTable::max_nr; ++nr) {
+            if (modes[nr] != Mode::none) {
+                program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>(nr), 0, 1));
+                program.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+            }
+        }
+        program.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+        return program;
+    }
+
+    // 在当前进程中安装过滤器，在 fork 出的子进程 execv 之前调用，过滤器在 execv 之后仍然有效
+    // 没有 CAP_SYS_ADMIN 时需要先设置 no_new_privs
+    auto install() const -> bool {
+        auto program = filter();
+        sock_fprog prog{static_cast<unsigned short>(program.size()), program.data()};
+        return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0
+            && prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) == 0;
+    }
+
+    // tracee 中已经安装了过滤器，记下会停下的系统调用
+    auto mark_installed() -> void {
+        is_installed = true;
+        is_installed_all = all_mode != Mode::none;
+        installed.clear();
+        for (long nr = 0; nr < SyscallTable::max_nr; ++nr) {
+            if (modes[nr] != Mode::none) {
+                installed.insert(nr);
+            }
+        }
+    }
+
+    auto filter_installed() const -> bool {
+        return is_installed;
+    }
+
+    // 系统调用 nr 会被已经安装的过滤器停下
+    auto is_filtered(long nr) const -> bool {
+        return is_installed && (is_installed_all || installed.count(nr) > 0);
+    }
+
+    // 已经安装的过滤器会停下所有系统调用
+    auto is_filtered_all() const -> bool {
+        return is_installed && is_installed_all;
+    }
+
+public:
+    // 线程 tid 进入了系统调用
+    auto enter(pid_t tid, long nr, uint64_t const *args) -> void {
+        Call call{nr, {}, std::chrono::steady_clock::now()};
+        std::copy(args, args + 6, call.args);
+        calls[tid] = call;
+    }
+
+    // 线程停在系统调用的入口，恢复运行时要用 PTRACE_SYSCALL 等它返回
+    auto in_syscall(pid_t tid) const -> bool {
+        return calls.count(tid) > 0;
+    }
+
+    // 线程从系统调用返回，记下统计，在 call 中返回进入时的记录
+    auto leave(pid_t tid, long result, Call& call, uint64_t& ns) -> bool {
+        auto it = calls.find(tid);
+        if (it == calls.end()) {
+            return false;
+        }
+        call = it->second;
+        calls.erase(it);
+        ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - call.start).count());
+
+        auto& stat = stats[call.nr];
+        ++stat.calls;
+        if (result < 0 && result >= -4095) {
+            ++stat.errors;
+        }
+        stat.total_ns += ns;
+        stat.max_ns = std::max(stat.max_ns, ns);
+        return true;
+    }
+
+    // 线程被单步执行过了系统调用，不会再有返回的停止
+    auto drop(pid_t tid) -> void {
+        calls.erase(tid);
+    }
+
+    auto all_stats() const -> std::map<long, Stat> const& {
+        return stats;
+    }
+
+    auto clear_stats() -> void {
+        stats.clear();
+    }
+
+    // tracee 结束后过滤器随着进程消失，捕获的设置和统计保留
+    auto reset() -> void {
+        installed.clear();
+        is_installed_all = false;
+        is_installed = false;
+        calls.clear();
+    }
+
+private:
+    std::vector<Mode> modes;
+    Mode all_mode;
+    // 已经安装到 tracee 中的过滤器会停下的系统调用
+    std::set<long> installed;
+    bool is_installed_all;
+    bool is_installed;
+    // 每个线程进行中的系统调用
+    std::unordered_map<pid_t, Call> calls;
+    // 系统调用编号 -> 统计
+    std::map<long, Stat> stats;
+};
+
+}
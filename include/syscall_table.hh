@@ -0,0 +1,302 @@
+#pragma once
+
+/**
+ * x86-64 系统调用的名称、编号和参数格式，用于 catch syscall 解析名称和打印参数
+ * 参数格式每个字符对应一个参数：
+ * d 文件描述符（AT_FDCWD 显示为名称）  i 有符号整数  u 无符号整数  x 十六进制  o 八进制
+ * s 字符串（从 tracee 中读取）  p 指针
+ * 表中只有常用的系统调用，其他系统调用可以用编号指定，参数按十六进制打印
+ */
+
+#include <ptrace_proxy.hh>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/syscall.h>
+
+namespace BitTech {
+
+class SyscallTable {
+public:
+    struct Entry {
+        char const *name;
+        long nr;
+        char const *args;
+    };
+
+    // x86-64 上系统调用编号的上限，留有余量
+    static const long max_nr = 512;
+
+public:
+    static auto entries() -> std::vector<Entry> const& {
+        static const std::vector<Entry> table{
+            {"read", SYS_read, "dpu"},
+            {"write", SYS_write, "dpu"},
+            {"open", SYS_open, "sxo"},
+            {"close", SYS_close, "d"},
+            {"stat", SYS_stat, "sp"},
+            {"fstat", SYS_fstat, "dp"},
+            {"lstat", SYS_lstat, "sp"},
+            {"poll", SYS_poll, "pui"},
+            {"lseek", SYS_lseek, "dii"},
+            {"mmap", SYS_mmap, "puxxdx"},
+            {"mprotect", SYS_mprotect, "pux"},
+            {"munmap", SYS_munmap, "pu"},
+            {"brk", SYS_brk, "p"},
+            {"rt_sigaction", SYS_rt_sigaction, "ippu"},
+            {"rt_sigprocmask", SYS_rt_sigprocmask, "ippu"},
+            {"ioctl", SYS_ioctl, "dxp"},
+            {"pread64", SYS_pread64, "dpui"},
+            {"pwrite64", SYS_pwrite64, "dpui"},
+            {"readv", SYS_readv, "dpi"},
+            {"writev", SYS_writev, "dpi"},
+            {"access", SYS_access, "so"},
+            {"pipe", SYS_pipe, "p"},
+            {"select", SYS_select, "ipppp"},
+            {"sched_yield", SYS_sched_yield, ""},
+            {"mremap", SYS_mremap, "puux"},
+            {"msync", SYS_msync, "pux"},
+            {"madvise", SYS_madvise, "pui"},
+            {"dup", SYS_dup, "d"},
+            {"dup2", SYS_dup2, "dd"},
+            {"nanosleep", SYS_nanosleep, "pp"},
+            {"getpid", SYS_getpid, ""},
+            {"sendfile", SYS_sendfile, "ddpu"},
+            {"socket", SYS_socket, "iii"},
+            {"connect", SYS_connect, "dpi"},
+            {"accept", SYS_accept, "dpp"},
+            {"sendto", SYS_sendto, "dpuxpi"},
+            {"recvfrom", SYS_recvfrom, "dpuxpp"},
+            {"sendmsg", SYS_sendmsg, "dpx"},
+            {"recvmsg", SYS_recvmsg, "dpx"},
+            {"shutdown", SYS_shutdown, "di"},
+            {"bind", SYS_bind, "dpi"},
+            {"listen", SYS_listen, "di"},
+            {"clone", SYS_clone, "xpppu"},
+            {"fork", SYS_fork, ""},
+            {"vfork", SYS_vfork, ""},
+            {"execve", SYS_execve, "spp"},
+            {"exit", SYS_exit, "i"},
+            {"wait4", SYS_wait4, "ipxp"},
+            {"kill", SYS_kill, "ii"},
+            {"uname", SYS_uname, "p"},
+            {"fcntl", SYS_fcntl, "dix"},
+            {"flock", SYS_flock, "di"},
+            {"fsync", SYS_fsync, "d"},
+            {"fdatasync", SYS_fdatasync, "d"},
+            {"truncate", SYS_truncate, "si"},
+            {"ftruncate", SYS_ftruncate, "di"},
+            {"getcwd", SYS_getcwd, "pu"},
+            {"chdir", SYS_chdir, "s"},
+            {"fchdir", SYS_fchdir, "d"},
+            {"rename", SYS_rename, "ss"},
+            {"mkdir", SYS_mkdir, "so"},
+            {"rmdir", SYS_rmdir, "s"},
+            {"creat", SYS_creat, "so"},
+            {"link", SYS_link, "ss"},
+            {"unlink", SYS_unlink, "s"},
+            {"symlink", SYS_symlink, "ss"},
+            {"readlink", SYS_readlink, "spu"},
+            {"chmod", SYS_chmod, "so"},
+            {"fchmod", SYS_fchmod, "do"},
+            {"chown", SYS_chown, "sii"},
+            {"umask", SYS_umask, "o"},
+            {"gettimeofday", SYS_gettimeofday, "pp"},
+            {"getuid", SYS_getuid, ""},
+            {"getgid", SYS_getgid, ""},
+            {"geteuid", SYS_geteuid, ""},
+            {"getegid", SYS_getegid, ""},
+            {"getppid", SYS_getppid, ""},
+            {"setsid", SYS_setsid, ""},
+            {"prctl", SYS_prctl, "ixxxx"},
+            {"arch_prctl", SYS_arch_prctl, "xp"},
+            {"gettid", SYS_gettid, ""},
+            {"futex", SYS_futex, "piippi"},
+            {"sched_getaffinity", SYS_sched_getaffinity, "iup"},
+            {"getdents64", SYS_getdents64, "dpu"},
+            {"set_tid_address", SYS_set_tid_address, "p"},
+            {"clock_gettime", SYS_clock_gettime, "ip"},
+            {"clock_nanosleep", SYS_clock_nanosleep, "iipp"},
+            {"exit_group", SYS_exit_group, "i"},
+            {"epoll_wait", SYS_epoll_wait, "dpii"},
+            {"epoll_ctl", SYS_epoll_ctl, "didp"},
+            {"tgkill", SYS_tgkill, "iii"},
+            {"openat", SYS_openat, "dsxo"},
+            {"mkdirat", SYS_mkdirat, "dso"},
+            {"newfstatat", SYS_newfstatat, "dspx"},
+            {"unlinkat", SYS_unlinkat, "dsx"},
+            {"renameat", SYS_renameat, "dsds"},
+            {"readlinkat", SYS_readlinkat, "dspu"},
+            {"faccessat", SYS_faccessat, "dso"},
+            {"pselect6", SYS_pselect6, "ipppp"},
+            {"ppoll", SYS_ppoll, "pupp"},
+            {"set_robust_list", SYS_set_robust_list, "pu"},
+            {"epoll_pwait", SYS_epoll_pwait, "dpiip"},
+            {"accept4", SYS_accept4, "dppx"},
+            {"eventfd2", SYS_eventfd2, "ux"},
+            {"epoll_create1", SYS_epoll_create1, "x"},
+            {"dup3", SYS_dup3, "ddx"},
+            {"pipe2", SYS_pipe2, "px"},
+            {"prlimit64", SYS_prlimit64, "iipp"},
+            {"getrandom", SYS_getrandom, "pux"},
+            {"memfd_create", SYS_memfd_create, "sx"},
+            {"statx", SYS_statx, "dsxxp"},
+        };
+        return table;
+    }
+
+    // 按名称或者编号查找系统调用，找不到时返回 -1
+    static auto number_of(std::string const& name) -> long {
+        for (auto const& entry : entries()) {
+            if (name == entry.name) {
+                return entry.nr;
+            }
+        }
+        char *end = nullptr;
+        auto nr = strtol(name.c_str(), &end, 10);
+        if (!name.empty() && *end == '\0' && nr >= 0 && nr < max_nr) {
+            return nr;
+        }
+        return -1;
+    }
+
+    static auto name_of(long nr) -> std::string {
+        auto entry = find(nr);
+        return entry != nullptr ? std::string{entry->name} : "syscall_" + std::to_string(nr);
+    }
+
+    // 按参数格式把一次系统调用格式化为 name(arg0, arg1, ...)，字符串参数从 tracee 中读取
+    static auto format_call(pid_t pid, long nr, uint64_t const *args) -> std::string {
+        auto entry = find(nr);
+        auto kinds = entry != nullptr ? entry->args : "xxxxxx";
+        auto result = name_of(nr) + "(";
+        for (auto i = 0; kinds[i] != '\0' && i < 6; ++i) {
+            if (i > 0) {
+                result += ", ";
+            }
+            result += format_arg(pid, kinds[i], args[i]);
+        }
+        return result + ")";
+    }
+
+    // 返回值在 [-4095, -1] 之间是 -errno，返回地址的系统调用按十六进制显示
+    static auto format_result(long nr, long result) -> std::string {
+        char buf[128];
+        if (result < 0 && result >= -4095) {
+            snprintf(buf, sizeof(buf), "-1 %s (%s)", errno_name(-result), strerror(-result));
+        } else if (nr == SYS_mmap || nr == SYS_mremap || nr == SYS_brk) {
+            snprintf(buf, sizeof(buf), "0x%lx", result);
+        } else {
+            snprintf(buf, sizeof(buf), "%ld", result);
+        }
+        return buf;
+    }
+
+private:
+    static auto find(long nr) -> Entry const * {
+        for (auto const& entry : entries()) {
+            if (entry.nr == nr) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    static auto format_arg(pid_t pid, char kind, uint64_t value) -> std::string {
+        char buf[64];
+        switch (kind) {
+        case 'd':
+            if (static_cast<int>(value) == AT_FDCWD) {
+                return "AT_FDCWD";
+            }
+            snprintf(buf, sizeof(buf), "%d", static_cast<int>(value));
+            break;
+        case 'i':
+            snprintf(buf, sizeof(buf), "%ld", static_cast<long>(value));
+            break;
+        case 'u':
+            snprintf(buf, sizeof(buf), "%lu", value);
+            break;
+        case 'o':
+            snprintf(buf, sizeof(buf), "0%lo", value);
+            break;
+        case 's':
+            return format_string(pid, value);
+        case 'p':
+            if (value == 0) {
+                return "NULL";
+            }
+            snprintf(buf, sizeof(buf), "0x%lx", value);
+            break;
+        default:
+            snprintf(buf, sizeof(buf), "0x%lx", value);
+            break;
+        }
+        return buf;
+    }
+
+    // 最多显示 64 个字符，不可打印的字符转义
+    static auto format_string(pid_t pid, uint64_t addr) -> std::string {
+        static const std::size_t max_length = 64;
+        if (addr == 0) {
+            return "NULL";
+        }
+        char raw[max_length + 1];
+        auto size = PtraceProxy::read_accessible(pid, addr, raw, sizeof(raw));
+        std::string result{"\""};
+        std::size_t i = 0;
+        for (; i < size && i < max_length && raw[i] != '\0'; ++i) {
+            auto c = static_cast<unsigned char>(raw[i]);
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += c;
+            } else if (c == '\n') {
+                result += "\\n";
+            } else if (c < 0x20 || c >= 0x7F) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\x%02x", c);
+                result += escaped;
+            } else {
+                result += c;
+            }
+        }
+        result += '"';
+        if (i == max_length && i < size && raw[i] != '\0') {
+            result += "...";
+        }
+        return result;
+    }
+
+    static auto errno_name(long err) -> char const * {
+        switch (err) {
+        case EPERM: return "EPERM";
+        case ENOENT: return "ENOENT";
+        case EINTR: return "EINTR";
+        case EIO: return "EIO";
+        case EBADF: return "EBADF";
+        case EAGAIN: return "EAGAIN";
+        case ENOMEM: return "ENOMEM";
+        case EACCES: return "EACCES";
+        case EFAULT: return "EFAULT";
+        case EEXIST: return "EEXIST";
+        case ENOTDIR: return "ENOTDIR";
+        case EISDIR: return "EISDIR";
+        case EINVAL: return "EINVAL";
+        case ENOTTY: return "ENOTTY";
+        case ESPIPE: return "ESPIPE";
+        case EPIPE: return "EPIPE";
+        case ENOSYS: return "ENOSYS";
+        case ETIMEDOUT: return "ETIMEDOUT";
+        case ECONNREFUSED: return "ECONNREFUSED";
+        case EINPROGRESS: return "EINPROGRESS";
+        default: return "E?";
+        }
+    }
+};
+
+}
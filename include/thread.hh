@@ -0,0 +1,121 @@
+#pragma once
+
+/**
+ * tracee 中的线程，以及按 tid 索引的线程表
+ * 每个线程有自己的寄存器缓存、停止原因和待发送的信号，断点和内存是整个进程共享的
+ * 线程编号从 1 开始按出现的顺序分配，不会复用，用户通过编号切换线程
+ */
+
+#include <register_cache.hh>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <sys/types.h>
+
+namespace BitTech {
+
+struct Thread {
+    // 线程为什么停下
+    enum class StopReason {
+        none,        // 还没有停下过，或者正在运行
+        breakpoint,  // 软件断点或者硬件执行断点
+        watchpoint,  // 观察点
+        step,        // 单步结束
+        signal,      // 收到信号
+        interrupt,   // 别的线程停下时被 PTRACE_INTERRUPT 停下
+        syscall,     // 进入捕获的系统调用
+    };
+
+    Thread(int number, pid_t tid)
+        : number{number}, tid{tid}, is_running{false}, is_starting{true}, is_stepping{false}, is_interrupting{false},
+          reason{StopReason::none}, pending_signal{0}, registers{tid} {}
+
+    // 用户看到的线程编号
+    int number;
+    pid_t tid;
+    // 线程被恢复运行了，还没有等到它停下
+    bool is_running;
+    // 新线程还没有报告第一次停止（PTRACE_EVENT_STOP），这之前不能对它做任何 ptrace 操作
+    bool is_starting;
+    // 上次恢复运行用的是单步，被无关的事件打断后要用同样的方式恢复
+    bool is_stepping;
+    // 发过 PTRACE_INTERRUPT 还没有收到对应的 PTRACE_EVENT_STOP
+    bool is_interrupting;
+    StopReason reason;
+    // 停下时收到的信号，恢复运行时发送给线程，0 表示没有
+    int pending_signal;
+    RegisterCache registers;
+};
+
+class ThreadTable {
+public:
+    ThreadTable(): threads{}, next_number{1} {}
+
+public:
+    // 加入新线程，已经存在时直接返回
+    auto add(pid_t tid) -> Thread& {
+        auto it = threads.find(tid);
+        if (it == threads.end()) {
+            it = threads.insert({tid, Thread{next_number++, tid}}).first;
+        }
+        return it->second;
+    }
+
+    auto remove(pid_t tid) -> void {
+        threads.erase(tid);
+    }
+
+    auto find(pid_t tid) -> Thread * {
+        auto it = threads.find(tid);
+        return it == threads.end() ? nullptr : &it->second;
+    }
+
+    auto at(pid_t tid) -> Thread& {
+        return threads.at(tid);
+    }
+
+    auto find_by_number(int number) -> Thread * {
+        for (auto& item : threads) {
+            if (item.second.number == number) {
+                return &item.second;
+            }
+        }
+        return nullptr;
+    }
+
+    // 按线程编号排序，用于显示
+    auto sorted() -> std::vector<Thread *> {
+        std::vector<Thread *> result{};
+        for (auto& item : threads) {
+            result.push_back(&item.second);
+        }
+        std::sort(result.begin(), result.end(), [](Thread const *a, Thread const *b) {
+            return a->number < b->number;
+        });
+        return result;
+    }
+
+    auto begin() -> std::map<pid_t, Thread>::iterator {
+        return threads.begin();
+    }
+
+    auto end() -> std::map<pid_t, Thread>::iterator {
+        return threads.end();
+    }
+
+    auto size() const -> std::size_t {
+        return threads.size();
+    }
+
+    // tracee 结束后，编号重新从 1 开始
+    auto clear() -> void {
+        threads.clear();
+        next_number = 1;
+    }
+
+private:
+    std::map<pid_t, Thread> threads;
+    int next_number;
+};
+
+}
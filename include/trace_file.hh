@@ -0,0 +1,394 @@
+#pragma once
+
+/**
+ * 跟踪点的二进制记录文件
+ * 文件开头是 FileHeader，之后是一条接一条的记录，每条记录由 RecordHeader 和 8 字节对齐的内容组成：
+ *   definition：跟踪点的编号、链接地址和定义它的命令
+ *   hit：一次命中的编号、线程、时间、PC，之后是收集的各项，每项由 ItemHeader 和数据组成
+ * 文件通过 mmap 写入，容量不够时成倍扩大；FileHeader::used 在每条记录写完后更新，调试器异常退出时之前的记录仍然完整
+ * 命中时内存项用一次 process_vm_readv 直接读进文件映射中，不经过中间缓冲区
+ */
+
+#include <ptrace_proxy.hh>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+
+namespace BitTech {
+
+class TraceFile {
+public:
+    // "BDBTRACE"
+    static const uint64_t magic = 0x4543415254424442;
+    static const uint32_t version = 1;
+    // 初始容量，之后成倍扩大
+    static const std::size_t initial_capacity = 1 << 20;
+
+    struct FileHeader {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t reserved;
+        // 已经写入的字节数，包括文件头
+        uint64_t used;
+    };
+
+    enum RecordType : uint32_t {
+        definition = 1,
+        hit = 2,
+    };
+
+    struct RecordHeader {
+        uint32_t type;
+        // 内容的字节数，已经按 8 字节对齐
+        uint32_t size;
+    };
+
+    // definition 记录的内容，之后是 text_len 字节的定义
+    struct Definition {
+        uint32_t id;
+        uint32_t text_len;
+        uint64_t addr;
+    };
+
+    // hit 记录的内容，之后是 item_count 项
+    struct Hit {
+        uint32_t id;
+        uint32_t tid;
+        // CLOCK_REALTIME 纳秒
+        uint64_t ns;
+        uint64_t pc;
+        uint32_t item_count;
+        uint32_t reserved;
+    };
+
+    enum ItemKind : uint32_t {
+        registers = 1,
+        memory = 2,
+    };
+
+    // 之后是 got 字节的数据，按 8 字节对齐
+    struct ItemHeader {
+        uint32_t kind;
+        uint32_t requested;
+        uint32_t got;
+        uint32_t reserved;
+        uint64_t addr;
+    };
+
+    // 一项要收集的内容：registers 时 addr 和 len 不用
+    struct Item {
+        ItemKind kind;
+        std::intptr_t addr;
+        std::size_t len;
+    };
+
+    struct Register {
+        char const *name;
+        std::size_t offset;
+    };
+
+public:
+    TraceFile(): fd{-1}, base{nullptr}, capacity{0}, file_path{} {}
+
+    ~TraceFile() {
+        close_file();
+    }
+
+    TraceFile(TraceFile const&) = delete;
+    auto operator=(TraceFile const&) -> TraceFile& = delete;
+
+public:
+    // 打开 path 继续追加记录，文件不存在或者不是记录文件时重新建立
+    auto open_file(std::string const& path) -> bool {
+        close_file();
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        FileHeader existing{};
+        auto size = fstat(fd, &st) == 0 ? static_cast<std::size_t>(st.st_size) : 0;
+        auto valid = size >= sizeof(FileHeader) && pread(fd, &existing, sizeof(existing), 0) == sizeof(existing)
+            && existing.magic == magic && existing.version == version
+            && existing.used >= sizeof(FileHeader) && existing.used <= size;
+        if (!map(std::max(initial_capacity, valid ? existing.used * 2 : 0))) {
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        if (!valid) {
+            *header() = FileHeader{magic, version, 0, sizeof(FileHeader)};
+        }
+        file_path = path;
+        return true;
+    }
+
+    // 截掉多余的容量后关闭
+    auto close_file() -> void {
+        if (fd < 0) {
+            return;
+        }
+        auto used = header()->used;
+        munmap(base, capacity);
+        if (ftruncate(fd, static_cast<off_t>(used)) != 0) {
+            perror("ftruncate");
+        }
+        close(fd);
+        fd = -1;
+        base = nullptr;
+        capacity = 0;
+    }
+
+    auto is_open() const -> bool {
+        return fd >= 0;
+    }
+
+    auto path() const -> std::string const& {
+        return file_path;
+    }
+
+public:
+    auto append_definition(uint32_t id, std::intptr_t addr, std::string const& text) -> bool {
+        auto size = sizeof(Definition) + align(text.size());
+        auto record = reserve(definition, size);
+        if (record == nullptr) {
+            return false;
+        }
+        Definition def{id, static_cast<uint32_t>(text.size()), static_cast<uint64_t>(addr)};
+        memcpy(record, &def, sizeof(def));
+        memcpy(record + sizeof(def), text.data(), text.size());
+        commit(size);
+        return true;
+    }
+
+    // 记下一次命中：regs 是线程的寄存器，items 中的内存项从 pid 中一次读取
+    auto append_hit(pid_t pid, uint32_t id, uint32_t tid, std::intptr_t pc, user_regs_struct const& regs,
+        std::vector<Item> const& items) -> bool {
+        auto size = sizeof(Hit);
+        for (auto const& item : items) {
+            size += sizeof(ItemHeader) + align(item.kind == registers ? sizeof(user_regs_struct) : item.len);
+        }
+        auto record = reserve(hit, size);
+        if (record == nullptr) {
+            return false;
+        }
+
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        Hit h{id, tid, static_cast<uint64_t>(ns), static_cast<uint64_t>(pc), static_cast<uint32_t>(items.size()), 0};
+        memcpy(record, &h, sizeof(h));
+
+        // 先排好每一项的位置，内存项的目标直接指向文件映射
+        std::vector<ItemHeader *> headers{};
+        std::vector<struct iovec> local{};
+        std::vector<struct iovec> remote{};
+        auto at = record + sizeof(Hit);
+        for (auto const& item : items) {
+            auto item_header = reinterpret_cast<ItemHeader *>(at);
+            auto data = at + sizeof(ItemHeader);
+            if (item.kind == registers) {
+                *item_header = ItemHeader{registers, sizeof(user_regs_struct), sizeof(user_regs_struct), 0, 0};
+                memcpy(data, &regs, sizeof(regs));
+                at = data + align(sizeof(user_regs_struct));
+                continue;
+            }
+            *item_header = ItemHeader{memory, static_cast<uint32_t>(item.len), 0, 0, static_cast<uint64_t>(item.addr)};
+            memset(data, 0, align(item.len));
+            headers.push_back(item_header);
+            local.push_back(iovec{data, item.len});
+            remote.push_back(iovec{reinterpret_cast<void *>(item.addr), item.len});
+            at = data + align(item.len);
+        }
+
+        // 一次读完；读不到的那一段和之后的各段再分别尝试，/proc/pid/mem 可以读没有读权限的页
+        auto done = PtraceProxy::read_ranges(pid, local.data(), remote.data(), local.size());
+        for (std::size_t i = 0; i < headers.size(); ++i) {
+            if (done >= local[i].iov_len) {
+                headers[i]->got = static_cast<uint32_t>(local[i].iov_len);
+                done -= local[i].iov_len;
+                continue;
+            }
+            done = 0;
+            headers[i]->got = static_cast<uint32_t>(PtraceProxy::read_memory(pid,
+                reinterpret_cast<std::intptr_t>(remote[i].iov_base), local[i].iov_base, local[i].iov_len));
+        }
+        commit(size);
+        return true;
+    }
+
+public:
+    // 记录文件中通用寄存器的名称和在 user_regs_struct 中的位置，tdump 按这个顺序打印
+    static auto register_table() -> std::vector<Register> const& {
+        static const std::vector<Register> table{
+            {"rip", offsetof(user_regs_struct, rip)},
+            {"rsp", offsetof(user_regs_struct, rsp)},
+            {"rbp", offsetof(user_regs_struct, rbp)},
+            {"rax", offsetof(user_regs_struct, rax)},
+            {"rbx", offsetof(user_regs_struct, rbx)},
+            {"rcx", offsetof(user_regs_struct, rcx)},
+            {"rdx", offsetof(user_regs_struct, rdx)},
+            {"rsi", offsetof(user_regs_struct, rsi)},
+            {"rdi", offsetof(user_regs_struct, rdi)},
+            {"r8", offsetof(user_regs_struct, r8)},
+            {"r9", offsetof(user_regs_struct, r9)},
+            {"r10", offsetof(user_regs_struct, r10)},
+            {"r11", offsetof(user_regs_struct, r11)},
+            {"r12", offsetof(user_regs_struct, r12)},
+            {"r13", offsetof(user_regs_struct, r13)},
+            {"r14", offsetof(user_regs_struct, r14)},
+            {"r15", offsetof(user_regs_struct, r15)},
+            {"eflags", offsetof(user_regs_struct, eflags)},
+            {"fs_base", offsetof(user_regs_struct, fs_base)},
+        };
+        return table;
+    }
+
+    // 寄存器名称在 user_regs_struct 中的位置，不认识时返回 -1
+    static auto register_offset(std::string const& name) -> long {
+        for (auto const& reg : register_table()) {
+            if (name == reg.name) {
+                return static_cast<long>(reg.offset);
+            }
+        }
+        return -1;
+    }
+
+    static auto register_value(user_regs_struct const& regs, std::size_t offset) -> uint64_t {
+        uint64_t value;
+        memcpy(&value, reinterpret_cast<char const *>(&regs) + offset, sizeof(value));
+        return value;
+    }
+
+    static auto align(std::size_t size) -> std::size_t {
+        return (size + 7) & ~static_cast<std::size_t>(7);
+    }
+
+private:
+    auto header() -> FileHeader * {
+        return reinterpret_cast<FileHeader *>(base);
+    }
+
+    auto map(std::size_t size) -> bool {
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            return false;
+        }
+        auto mapped = base == nullptr
+            ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+            : mremap(base, capacity, size, MREMAP_MAYMOVE);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        base = static_cast<char *>(mapped);
+        capacity = size;
+        return true;
+    }
+
+    // 预留一条记录，写好记录头，返回内容的位置，扩大容量失败时返回 nullptr
+    auto reserve(RecordType type, std::size_t size) -> char * {
+        if (fd < 0) {
+            return nullptr;
+        }
+        auto need = header()->used + sizeof(RecordHeader) + size;
+        if (need > capacity && !map(std::max(capacity * 2, need))) {
+            return nullptr;
+        }
+        auto record = base + header()->used;
+        RecordHeader rh{type, static_cast<uint32_t>(size)};
+        memcpy(record, &rh, sizeof(rh));
+        return record + sizeof(RecordHeader);
+    }
+
+    auto commit(std::size_t size) -> void {
+        header()->used += sizeof(RecordHeader) + size;
+    }
+
+private:
+    int fd;
+    char *base;
+    std::size_t capacity;
+    std::string file_path;
+};
+
+// 读取记录文件，tdump 使用，不需要 tracee
+class TraceFileReader {
+public:
+    struct Entry {
+        TraceFile::RecordType type;
+        char const *data;
+        std::size_t size;
+    };
+
+public:
+    TraceFileReader(): base{nullptr}, size{0}, size_used{0}, offset{0} {}
+
+    ~TraceFileReader() {
+        if (base != nullptr) {
+            munmap(const_cast<char *>(base), size);
+        }
+    }
+
+    TraceFileReader(TraceFileReader const&) = delete;
+    auto operator=(TraceFileReader const&) -> TraceFileReader& = delete;
+
+public:
+    // 只读映射整个文件，不是记录文件时返回 false
+    auto open_file(std::string const& path) -> bool {
+        auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(TraceFile::FileHeader)) {
+            close(fd);
+            return false;
+        }
+        auto mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        base = static_cast<char const *>(mapped);
+        size = static_cast<std::size_t>(st.st_size);
+        TraceFile::FileHeader header;
+        memcpy(&header, base, sizeof(header));
+        if (header.magic != TraceFile::magic || header.version != TraceFile::version || header.used > size) {
+            return false;
+        }
+        size_used = static_cast<std::size_t>(header.used);
+        offset = sizeof(header);
+        return true;
+    }
+
+    // 依次读出每条记录，没有完整的记录时返回 false
+    auto next(Entry& entry) -> bool {
+        TraceFile::RecordHeader rh;
+        if (offset + sizeof(rh) > size_used) {
+            return false;
+        }
+        memcpy(&rh, base + offset, sizeof(rh));
+        if (offset + sizeof(rh) + rh.size > size_used) {
+            return false;
+        }
+        entry = Entry{static_cast<TraceFile::RecordType>(rh.type), base + offset + sizeof(rh), rh.size};
+        offset += sizeof(rh) + rh.size;
+        return true;
+    }
+
+private:
+    char const *base;
+    std::size_t size;
+    std::size_t size_used;
+    std::size_t offset;
+};
+
+}
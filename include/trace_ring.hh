@@ -0,0 +1,107 @@
+#pragma once
+
+/**
+ * 快速跟踪点的共享内存布局，调试器和 tracee 中的 agent（agent/agent.cc）共用
+ * 调试器用 memfd 建立共享内存，tracee 通过继承的文件描述符映射同一块内存
+ * 蹦床调用 agent 的 bdb_agent_hit 写入一条记录，多个线程通过原子地推进 head 预留位置，写完后设置 seq 表示提交
+ * 调试器从 tail 开始读取已经提交的记录，读完推进 tail；环形缓冲区满了时 agent 丢弃记录并计数，不会等待
+ * 这里只用 POD 类型和 GCC 的 __atomic 内建函数，两边编译出的布局一致
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace BitTech {
+
+namespace TraceRing {
+
+// "BDBRING1"
+static const uint64_t magic = 0x31474e4952424442;
+static const uint32_t max_sites = 256;
+// 每条记录最多保存的寄存器个数
+static const uint32_t max_regs = 4;
+// 记录的个数，必须是 2 的幂
+static const uint64_t capacity = 1 << 16;
+
+// 蹦床压栈保存的寄存器，从低地址到高地址，是压栈顺序的逆序
+struct Frame {
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rdi, rsi, rbp, rbx, rdx, rcx, rax;
+    uint64_t rflags;
+};
+
+// 蹦床在保存寄存器之前先跳过 128 字节的红区，原来的 rsp 在 Frame 之上 128 字节处
+static const std::size_t red_zone = 128;
+
+// 寄存器编号：0 到 15 是 Frame 中的寄存器，rsp 单独处理
+static const uint8_t reg_rsp = 16;
+
+// 每个跟踪点的设置和命中次数
+struct Site {
+    uint64_t hits;
+    uint8_t regs[max_regs];
+    uint8_t reg_count;
+    uint8_t reserved[3];
+};
+
+struct Record {
+    // 提交后为位置 + 1
+    uint64_t seq;
+    // CLOCK_MONOTONIC 纳秒
+    uint64_t ns;
+    uint32_t site;
+    uint32_t tid;
+    uint64_t regs[max_regs];
+    uint64_t reserved;
+};
+
+struct Header {
+    uint64_t magic;
+    // agent 中 bdb_agent_hit 的地址，由 agent 加载时写入
+    uint64_t hit_function;
+    uint32_t agent_pid;
+    // agent 已经加载并写好了 hit_function 时为 1，调试器处理过加载的通知后改为 2
+    uint32_t ready;
+    // 下一个要预留的位置，由 agent 推进
+    uint64_t head;
+    // 下一个要读取的位置，由调试器推进
+    uint64_t tail;
+    // 缓冲区满时丢弃的记录数
+    uint64_t dropped;
+    Site sites[max_sites];
+};
+
+static inline auto size() -> std::size_t {
+    return sizeof(Header) + capacity * sizeof(Record);
+}
+
+static inline auto records(Header *header) -> Record * {
+    return reinterpret_cast<Record *>(header + 1);
+}
+
+static inline auto register_names() -> char const *const * {
+    static char const *const names[] = {
+        "r15", "r14", "r13", "r12", "r11", "r10", "r9", "r8",
+        "rdi", "rsi", "rbp", "rbx", "rdx", "rcx", "rax", "rflags", "rsp",
+    };
+    return names;
+}
+
+// 寄存器名称对应的编号，不认识时返回 -1
+static inline auto register_of(char const *name) -> int {
+    for (auto i = 0; i <= reg_rsp; ++i) {
+        if (strcmp(name, register_names()[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static inline auto register_name(int reg) -> char const * {
+    return reg >= 0 && reg <= reg_rsp ? register_names()[reg] : "?";
+}
+
+}
+
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+/**
+ * 收集数据的跟踪点：命中时按定义收集寄存器和内存，追加到记录文件后立即继续运行，不回到命令行
+ * 每个跟踪点是一个断点，Inferior 在等待线程的循环中处理命中；一次命中只读一次寄存器（线程的寄存器缓存）和一次内存
+ * 收集的项：
+ *   regs               所有通用寄存器
+ *   *0x地址,长度        固定地址的内存
+ *   $寄存器[+-偏移],长度  相对寄存器的内存，例如 $rsp,64
+ *   变量名[,长度]        全局变量，默认长度是变量类型的大小
+ */
+
+#include <trace_file.hh>
+#include <string>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <cstdint>
+#include <cstdlib>
+
+namespace BitTech {
+
+class Tracepoints {
+public:
+    // 每个跟踪点最多收集的项数和每一项最多的字节数
+    static const std::size_t max_items = 16;
+    static const std::size_t max_length = 1 << 16;
+
+    struct Item {
+        enum class Kind {
+            registers,
+            memory,    // addr 是固定的地址
+            relative,  // addr 是相对寄存器 reg 的偏移
+            variable,  // addr 是全局变量的链接地址
+        };
+        Kind kind;
+        // relative 时寄存器在 user_regs_struct 中的位置
+        std::size_t reg;
+        std::intptr_t addr;
+        std::size_t len;
+    };
+
+    struct Tracepoint {
+        // 链接地址
+        std::intptr_t addr;
+        // 定义跟踪点的命令，tdump 打印
+        std::string text;
+        std::vector<Item> items;
+        uint64_t hits;
+    };
+
+public:
+    Tracepoints(): tracepoints{}, entries{}, owned{}, file{}, file_path{"bdb.trace"} {}
+
+public:
+    // 加入跟踪点，同一地址已经有跟踪点时替换它收集的项，返回编号
+    auto add(std::intptr_t addr, std::string const& text, std::vector<Item> const& items) -> std::size_t {
+        auto it = entries.find(addr);
+        std::size_t id;
+        if (it != entries.end()) {
+            id = it->second;
+            tracepoints[id].text = text;
+            tracepoints[id].items = items;
+        } else {
+            id = tracepoints.size();
+            entries[addr] = id;
+            tracepoints.push_back(Tracepoint{addr, text, items, 0});
+        }
+        if (file.is_open()) {
+            file.append_definition(static_cast<uint32_t>(id), addr, text);
+        }
+        return id;
+    }
+
+    auto active() const -> bool {
+        return !tracepoints.empty();
+    }
+
+    auto all() -> std::vector<Tracepoint>& {
+        return tracepoints;
+    }
+
+    // 链接地址上的跟踪点，是时在 id 中返回编号
+    auto find(std::intptr_t addr, std::size_t& id) const -> bool {
+        auto it = entries.find(addr);
+        if (it == entries.end()) {
+            return false;
+        }
+        id = it->second;
+        return true;
+    }
+
+    // 跟踪点加入的断点，删除跟踪点时只删除这些
+    auto owned_breakpoints() -> std::set<std::intptr_t>& {
+        return owned;
+    }
+
+public:
+    // 之后的记录写到 path，已经打开的文件先关闭
+    auto set_path(std::string const& path) -> bool {
+        file.close_file();
+        file_path = path;
+        return open_file();
+    }
+
+    auto path() const -> std::string const& {
+        return file_path;
+    }
+
+    // 打开记录文件，写入所有跟踪点的定义，已经打开时直接返回
+    auto open_file() -> bool {
+        if (file.is_open()) {
+            return true;
+        }
+        if (!file.open_file(file_path)) {
+            return false;
+        }
+        for (std::size_t id = 0; id < tracepoints.size(); ++id) {
+            file.append_definition(static_cast<uint32_t>(id), tracepoints[id].addr, tracepoints[id].text);
+        }
+        return true;
+    }
+
+    // 关闭记录文件，截掉多余的容量，tdump 读取之前调用
+    auto close_file() -> void {
+        file.close_file();
+    }
+
+    auto trace_file() -> TraceFile& {
+        return file;
+    }
+
+public:
+    // tracee 结束后断点都不在了，跟踪点、命中次数和记录文件保留
+    auto reset() -> void {
+        owned.clear();
+    }
+
+    // 删除所有跟踪点，已经写入的记录保留
+    auto clear() -> void {
+        owned.clear();
+        tracepoints.clear();
+        entries.clear();
+    }
+
+    // 解析一项要收集的内容，变量由 find_variable 查出链接地址和大小，格式不正确时返回 false
+    template <typename FindVariable>
+    static auto parse_item(std::string const& text, Item& item, FindVariable find_variable) -> bool {
+        if (text == "regs") {
+            item = Item{Item::Kind::registers, 0, 0, 0};
+            return true;
+        }
+        auto comma = text.find(',');
+        auto where = text.substr(0, comma);
+        std::size_t len = 0;
+        if (comma != std::string::npos) {
+            char *end = nullptr;
+            len = strtoul(text.c_str() + comma + 1, &end, 0);
+            if (*end != '\0' || len == 0 || len > max_length) {
+                return false;
+            }
+        }
+
+        if (where.empty()) {
+            return false;
+        }
+        if (where[0] == '*') {
+            char *end = nullptr;
+            auto addr = strtoull(where.c_str() + 1, &end, 16);
+            if (*end != '\0' || len == 0) {
+                return false;
+            }
+            item = Item{Item::Kind::memory, 0, static_cast<std::intptr_t>(addr), len};
+            return true;
+        }
+        if (where[0] == '$') {
+            auto sign = where.find_first_of("+-");
+            auto offset = TraceFile::register_offset(where.substr(1, sign == std::string::npos ? sign : sign - 1));
+            long delta = 0;
+            if (sign != std::string::npos) {
+                char *end = nullptr;
+                delta = strtol(where.c_str() + sign, &end, 0);
+                if (*end != '\0') {
+                    return false;
+                }
+            }
+            if (offset < 0 || len == 0) {
+                return false;
+            }
+            item = Item{Item::Kind::relative, static_cast<std::size_t>(offset), delta, len};
+            return true;
+        }
+
+        std::intptr_t addr = 0;
+        std::size_t size = 0;
+        if (!find_variable(where, addr, size)) {
+            return false;
+        }
+        len = len != 0 ? len : size;
+        if (len == 0 || len > max_length) {
+            return false;
+        }
+        item = Item{Item::Kind::variable, 0, addr, len};
+        return true;
+    }
+
+private:
+    std::vector<Tracepoint> tracepoints;
+    // 链接地址 -> 编号
+    std::unordered_map<std::intptr_t, std::size_t> entries;
+    std::set<std::intptr_t> owned;
+    TraceFile file;
+    // 记录文件的路径，默认是当前目录下的 bdb.trace
+    std::string file_path;
+};
+
+}
@@ -0,0 +1,324 @@
+#pragma once
+
+/**
+ * 栈回溯：用 .eh_frame/.debug_frame 中的 CFI 从一个栈帧的寄存器算出调用者的寄存器
+ * 程序和它加载的共享库各有自己的 CFI，按 /proc/pid/maps 中的可执行映射找到 PC 所在的模块
+ * 没有 CFI 的栈帧（例如手写的汇编）退回到沿着帧指针回溯
+ * 栈内存按块读取，大多数调用栈只需要一次 process_vm_readv
+ */
+
+#include <cfi_table.hh>
+#include <ptrace_proxy.hh>
+#include <elf/elf++.hh>
+#include <vector>
+#include <map>
+#include <set>
+#include <array>
+#include <memory>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <climits>
+#include <fcntl.h>
+#include <sys/user.h>
+
+namespace BitTech {
+
+class Unwinder {
+public:
+    struct Frame {
+        // 最内层的栈帧是停下的位置，其他栈帧是返回地址
+        std::intptr_t pc;
+        // 调用这个函数之前的 rsp，在函数执行的过程中保持不变，用来区分栈帧
+        std::intptr_t cfa;
+    };
+
+    // 一次读取的栈内存
+    static const std::size_t stack_window = 16 * 1024;
+
+public:
+    Unwinder(): files{}, modules{}, missed{}, stack(stack_window / sizeof(uint64_t)), stack_low{0}, stack_valid{0} {}
+
+public:
+    // tracee 结束后模块的装载地址失效，解析过的 CFI 按文件保留，下次运行直接使用
+    auto reset() -> void {
+        modules.clear();
+        missed.clear();
+    }
+
+    // 从 regs 开始回溯进程 pid 中一个停下的线程，最多 max_depth 帧，结果放在 frames 中
+    auto unwind(pid_t pid, user_regs_struct const& regs, std::size_t max_depth, std::vector<Frame>& frames) -> void {
+        frames.clear();
+        std::array<uint64_t, register_count> values{
+            regs.rax, regs.rdx, regs.rcx, regs.rbx, regs.rsi, regs.rdi, regs.rbp, regs.rsp,
+            regs.r8, regs.r9, regs.r10, regs.r11, regs.r12, regs.r13, regs.r14, regs.r15,
+        };
+        std::array<bool, register_count> known{};
+        known.fill(true);
+
+        // 栈内存在两次回溯之间会变化，每次重新读
+        stack_valid = 0;
+        load_stack(pid, regs.rsp);
+
+        std::intptr_t pc = regs.rip;
+        auto is_caller = false;
+        while (frames.size() < max_depth) {
+            frames.push_back(Frame{pc, 0});
+
+            auto next_values = values;
+            auto next_known = known;
+            std::intptr_t cfa = 0;
+            uint64_t return_address = 0;
+
+            // 返回地址可能已经是下一个函数了，减 1 落在 call 指令上
+            CfiTable::Row row;
+            if (find_row(pid, is_caller ? pc - 1 : pc, row) && !row.cfa_is_expression
+                && row.cfa_reg < register_count && known[row.cfa_reg]) {
+                cfa = values[row.cfa_reg] + row.cfa_offset;
+                for (auto reg = 0; reg < register_count; ++reg) {
+                    auto const& rule = row.rules[reg];
+                    uint64_t value = reg < 16 ? values[reg] : 0;
+                    auto ok = reg < 16 && known[reg];
+                    switch (rule.kind) {
+                    case CfiTable::Rule::Kind::same:
+                        break;
+                    case CfiTable::Rule::Kind::offset:
+                        ok = read_stack(pid, cfa + rule.value, value);
+                        break;
+                    case CfiTable::Rule::Kind::val_offset:
+                        value = cfa + rule.value;
+                        ok = true;
+                        break;
+                    case CfiTable::Rule::Kind::reg:
+                        ok = rule.value < 16 && known[rule.value];
+                        value = ok ? values[rule.value] : 0;
+                        break;
+                    default:
+                        ok = false;
+                        break;
+                    }
+                    if (reg == row.ra_reg) {
+                        return_address = ok ? value : 0;
+                    } else if (reg < 16) {
+                        next_values[reg] = value;
+                        next_known[reg] = ok;
+                    }
+                }
+            } else {
+                // 没有 CFI，假设函数建立了帧指针：[rbp] 是调用者的 rbp，[rbp + 8] 是返回地址
+                uint64_t saved_fp = 0;
+                if (!known[rbp] || !read_stack(pid, values[rbp], saved_fp)
+                    || !read_stack(pid, values[rbp] + 8, return_address)) {
+                    break;
+                }
+                cfa = values[rbp] + 16;
+                next_values[rbp] = saved_fp;
+            }
+
+            frames.back().cfa = cfa;
+            // 调用者的栈帧在更高的地址上，返回地址是 0 表示已经到了最外层
+            if (return_address == 0 || cfa <= static_cast<std::intptr_t>(values[rsp])) {
+                break;
+            }
+            next_values[rsp] = cfa;
+            next_known[rsp] = true;
+            values = next_values;
+            known = next_known;
+            pc = return_address;
+            is_caller = true;
+        }
+    }
+
+    // pc 所在模块的文件路径，找不到时返回空字符串
+    auto module_path(pid_t pid, std::intptr_t pc) -> std::string {
+        auto module = find_module(pid, pc);
+        return module == nullptr ? std::string{} : module->path;
+    }
+
+private:
+    static const int register_count = CfiTable::register_count;
+    static const int rbp = 6;
+    static const int rsp = 7;
+
+    // 一个 ELF 文件的 CFI，data 指向 mmap 到内存中的节
+    struct File {
+        elf::elf elf;
+        std::unique_ptr<CfiTable> eh_frame;
+        std::unique_ptr<CfiTable> debug_frame;
+        // 链接时最低的装载地址（按页对齐）
+        std::intptr_t link_base;
+    };
+
+    // 一段可执行的映射
+    struct Module {
+        std::intptr_t low;
+        std::intptr_t high;
+        // 运行时地址 - 链接地址
+        std::intptr_t bias;
+        std::shared_ptr<File> file;
+        std::string path;
+    };
+
+private:
+    auto find_row(pid_t pid, std::intptr_t pc, CfiTable::Row& row) -> bool {
+        auto module = find_module(pid, pc);
+        if (module == nullptr || module->file == nullptr) {
+            return false;
+        }
+        auto link_pc = pc - module->bias;
+        auto& file = *module->file;
+        return (file.eh_frame != nullptr && file.eh_frame->find(link_pc, row))
+            || (file.debug_frame != nullptr && file.debug_frame->find(link_pc, row));
+    }
+
+    // pc 不在已知的模块中时重新读一次 /proc/pid/maps，可能是后来 dlopen 的库
+    // 重新读过还是找不到的页记下来，不再为它读 maps
+    auto find_module(pid_t pid, std::intptr_t pc) -> Module * {
+        auto module = lookup_module(pc);
+        auto page = pc & ~static_cast<std::intptr_t>(0xFFF);
+        if (module == nullptr && missed.count(page) == 0) {
+            load_modules(pid);
+            module = lookup_module(pc);
+            if (module == nullptr) {
+                missed.insert(page);
+            }
+        }
+        return module;
+    }
+
+    auto lookup_module(std::intptr_t pc) -> Module * {
+        auto it = std::upper_bound(modules.begin(), modules.end(), pc, [](std::intptr_t value, Module const& module) {
+            return value < module.low;
+        });
+        if (it == modules.begin() || (--it)->high <= pc) {
+            return nullptr;
+        }
+        return &*it;
+    }
+
+    auto load_modules(pid_t pid) -> void {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+        auto maps = fopen(path, "r");
+        if (maps == nullptr) {
+            return;
+        }
+
+        // 文件偏移为 0 的映射是文件的装载地址
+        struct Mapping {
+            std::intptr_t low;
+            std::intptr_t high;
+            std::string path;
+        };
+        std::vector<Mapping> executable{};
+        std::map<std::string, std::intptr_t> bases{};
+        unsigned long start, end, offset;
+        char perms[5];
+        char line[PATH_MAX + 128];
+        while (fgets(line, sizeof(line), maps) != nullptr) {
+            int name = 0;
+            if (sscanf(line, "%lx-%lx %4s %lx %*s %*s %n", &start, &end, perms, &offset, &name) != 4
+                || name == 0 || line[name] != '/') {
+                continue;
+            }
+            std::string mapped{line + name};
+            if (!mapped.empty() && mapped.back() == '\n') {
+                mapped.pop_back();
+            }
+            if (offset == 0 && bases.count(mapped) == 0) {
+                bases[mapped] = start;
+            }
+            if (perms[2] == 'x') {
+                executable.push_back(Mapping{static_cast<std::intptr_t>(start), static_cast<std::intptr_t>(end), mapped});
+            }
+        }
+        fclose(maps);
+
+        modules.clear();
+        missed.clear();
+        for (auto const& mapping : executable) {
+            auto file = load_file(mapping.path);
+            auto base = bases.count(mapping.path) ? bases[mapping.path] : mapping.low;
+            auto bias = file == nullptr ? 0 : base - file->link_base;
+            modules.push_back(Module{mapping.low, mapping.high, bias, file, mapping.path});
+        }
+        std::sort(modules.begin(), modules.end(), [](Module const& a, Module const& b) {
+            return a.low < b.low;
+        });
+    }
+
+    // 解析文件的 CFI，每个文件只解析一次，打不开或者不是 ELF 时返回空
+    auto load_file(std::string const& path) -> std::shared_ptr<File> {
+        auto it = files.find(path);
+        if (it != files.end()) {
+            return it->second;
+        }
+
+        std::shared_ptr<File> file{};
+        auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            try {
+                // mmap loader 映射完文件后会自己关闭 fd
+                file = std::make_shared<File>();
+                file->elf = elf::elf{elf::create_mmap_loader(fd)};
+                file->eh_frame = load_section(file->elf, ".eh_frame", true);
+                file->debug_frame = load_section(file->elf, ".debug_frame", false);
+                file->link_base = std::numeric_limits<std::intptr_t>::max();
+                for (auto const& segment : file->elf.segments()) {
+                    if (segment.get_hdr().type == elf::pt::load) {
+                        file->link_base = std::min(file->link_base, static_cast<std::intptr_t>(segment.get_hdr().vaddr));
+                    }
+                }
+                file->link_base = file->link_base == std::numeric_limits<std::intptr_t>::max()
+                    ? 0 : file->link_base & ~static_cast<std::intptr_t>(0xFFF);
+            } catch (std::exception const& exc) {
+                file = nullptr;
+            }
+        }
+        return files[path] = file;
+    }
+
+    static auto load_section(elf::elf const& elf, std::string const& name, bool eh_frame) -> std::unique_ptr<CfiTable> {
+        auto const& section = elf.get_section(name);
+        if (!section.valid() || section.get_hdr().type == elf::sht::nobits || section.size() == 0) {
+            return nullptr;
+        }
+        return std::unique_ptr<CfiTable>{new CfiTable{static_cast<uint8_t const *>(section.data()), section.size(),
+            static_cast<std::intptr_t>(section.get_hdr().addr), eh_frame}};
+    }
+
+private:
+    // 读一块从 addr 开始的栈内存
+    auto load_stack(pid_t pid, std::intptr_t addr) -> void {
+        stack_low = addr & ~static_cast<std::intptr_t>(sizeof(uint64_t) - 1);
+        stack_valid = PtraceProxy::read_accessible(pid, stack_low, stack.data(), stack_window);
+    }
+
+    // 读栈上的 8 字节，不在已经读出的块中时从 addr 开始再读一块
+    auto read_stack(pid_t pid, std::intptr_t addr, uint64_t& value) -> bool {
+        if (addr < stack_low || addr + sizeof(uint64_t) > stack_low + stack_valid) {
+            load_stack(pid, addr);
+        }
+        if (addr < stack_low || addr + sizeof(uint64_t) > stack_low + stack_valid) {
+            return false;
+        }
+        memcpy(&value, reinterpret_cast<uint8_t const *>(stack.data()) + (addr - stack_low), sizeof(value));
+        return true;
+    }
+
+private:
+    // 文件路径 -> CFI，tracee 重新运行后仍然有效
+    std::map<std::string, std::shared_ptr<File>> files;
+    // 按起始地址排序的可执行映射
+    std::vector<Module> modules;
+    // 重新读过 maps 也找不到模块的页
+    std::set<std::intptr_t> missed;
+    // 读出的栈内存 [stack_low, stack_low + stack_valid)
+    std::vector<uint64_t> stack;
+    std::intptr_t stack_low;
+    std::size_t stack_valid;
+};
+
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+/**
+ * x86-64 指令长度和控制流解码器
+ * 只解析到足以知道 指令长度、是否会改变控制流、直接跳转的目标、RIP 相对寻址的位移位置 为止，
+ * 不翻译操作数。支持 legacy 前缀、REX、VEX、EVEX 以及 1/2/3 字节操作码表
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace BitTech {
+
+class X86Decoder {
+public:
+    // 指令对控制流的影响
+    enum class Flow {
+        sequential,      // 顺序执行到下一条指令
+        jump,            // 直接跳转
+        cond_jump,       // 条件跳转（包括 loop/jrcxz）
+        call,            // 直接调用
+        ret,             // 返回
+        indirect_jump,   // 间接跳转
+        indirect_call,   // 间接调用
+        system,          // syscall/int/hlt/ud2 等陷入内核或者不返回的指令
+    };
+
+    struct Instruction {
+        std::size_t length;
+        Flow flow;
+        // 直接跳转、调用的目标地址
+        std::intptr_t target;
+        // RIP 相对寻址的 32 位位移在指令中的偏移，没有时为 -1
+        int disp_offset;
+    };
+
+public:
+    // 解码位于 addr 的一条指令，code 中至少有 size 字节可用，解码失败返回 false
+    static auto decode(uint8_t const *code, std::size_t size, std::intptr_t addr, Instruction& insn) -> bool {
+        if (size > max_length) {
+            size = max_length;
+        }
+
+        std::size_t i = 0;
+        bool opsize16 = false;
+        bool addr32 = false;
+        bool rex_w = false;
+
+        // legacy 前缀
+        for (; i < size; ++i) {
+            auto b = code[i];
+            if (b == 0x66) {
+                opsize16 = true;
+            } else if (b == 0x67) {
+                addr32 = true;
+            } else if (!(b == 0xF0 || b == 0xF2 || b == 0xF3 || b == 0x2E || b == 0x36
+                || b == 0x3E || b == 0x26 || b == 0x64 || b == 0x65)) {
+                break;
+            }
+        }
+
+        // REX 前缀必须紧挨着操作码
+        if (i < size && (code[i] & 0xF0) == 0x40) {
+            rex_w = code[i] & 0x08;
+            ++i;
+        }
+        if (i >= size) {
+            return false;
+        }
+
+        auto op = code[i++];
+        int map = 0;
+        if (op == 0xC5) {
+            // 两字节 VEX，隐含 0F 操作码表
+            if (i + 2 > size) {
+                return false;
+            }
+            map = 1;
+            i += 1;
+            op = code[i++];
+        } else if (op == 0xC4) {
+            // 三字节 VEX
+            if (i + 3 > size) {
+                return false;
+            }
+            map = code[i] & 0x1F;
+            rex_w = code[i + 1] & 0x80;
+            i += 2;
+            op = code[i++];
+        } else if (op == 0x62) {
+            // EVEX，64 位模式下 62 不再是 bound 指令
+            if (i + 4 > size) {
+                return false;
+            }
+            map = code[i] & 0x07;
+            rex_w = code[i + 1] & 0x80;
+            i += 3;
+            op = code[i++];
+        } else if (op == 0x0F) {
+            if (i >= size) {
+                return false;
+            }
+            op = code[i++];
+            map = 1;
+            if (op == 0x38 || op == 0x3A) {
+                if (i >= size) {
+                    return false;
+                }
+                map = op == 0x38 ? 2 : 3;
+                op = code[i++];
+            }
+        }
+
+        std::size_t imm = 0;
+        bool has_modrm = false;
+        bool relative = false;
+        auto flow = Flow::sequential;
+        // 16/32 位的立即数，REX.W 时仍然是 32 位
+        std::size_t imm_z = opsize16 && !rex_w ? 2 : 4;
+
+        switch (map) {
+        case 0:
+            if (invalid_in_64bit(op)) {
+                return false;
+            }
+            has_modrm = one_byte_has_modrm(op);
+            imm = one_byte_immediate(op, imm_z, rex_w, addr32);
+            if (op >= 0x70 && op <= 0x7F) {
+                flow = Flow::cond_jump;
+                relative = true;
+            } else if (op >= 0xE0 && op <= 0xE3) {
+                flow = Flow::cond_jump;
+                relative = true;
+            } else if (op == 0xE8) {
+                flow = Flow::call;
+                relative = true;
+            } else if (op == 0xE9 || op == 0xEB) {
+                flow = Flow::jump;
+                relative = true;
+            } else if (op == 0xC2 || op == 0xC3 || op == 0xCA || op == 0xCB || op == 0xCF) {
+                flow = Flow::ret;
+            } else if (op == 0xCC || op == 0xCD || op == 0xF1 || op == 0xF4) {
+                flow = Flow::system;
+            }
+            break;
+        case 1:
+            has_modrm = !two_byte_without_modrm(op);
+            if (op >= 0x80 && op <= 0x8F) {
+                imm = 4;
+                flow = Flow::cond_jump;
+                relative = true;
+            } else if ((op >= 0x70 && op <= 0x73) || op == 0xA4 || op == 0xAC || op == 0xBA
+                || op == 0xC2 || op == 0xC4 || op == 0xC5 || op == 0xC6 || op == 0x0F) {
+                imm = 1;
+            }
+            if (op == 0x05 || op == 0x07 || op == 0x34 || op == 0x35
+                || op == 0x0B || op == 0xB9 || op == 0xFF) {
+                flow = Flow::system;
+            }
+            break;
+        case 2:
+            has_modrm = true;
+            break;
+        case 3:
+            has_modrm = true;
+            imm = 1;
+            break;
+        default:
+            return false;
+        }
+
+        int disp_offset = -1;
+        if (has_modrm) {
+            if (i >= size) {
+                return false;
+            }
+            auto modrm = code[i++];
+            auto mod = modrm >> 6;
+            auto reg = (modrm >> 3) & 7;
+            auto rm = modrm & 7;
+            std::size_t disp = 0;
+            if (mod != 3) {
+                if (rm == 4) {
+                    if (i >= size) {
+                        return false;
+                    }
+                    auto sib = code[i++];
+                    if (mod == 0 && (sib & 7) == 5) {
+                        disp = 4;
+                    }
+                }
+                if (mod == 0 && rm == 5) {
+                    disp = 4;
+                    disp_offset = static_cast<int>(i);
+                }
+                if (mod == 1) {
+                    disp = 1;
+                } else if (mod == 2) {
+                    disp = 4;
+                }
+            }
+            i += disp;
+
+            if (map == 0) {
+                // test 指令的立即数由 reg 字段决定
+                if (op == 0xF6 && reg <= 1) {
+                    imm = 1;
+                } else if (op == 0xF7 && reg <= 1) {
+                    imm = imm_z;
+                } else if (op == 0x8F && reg != 0) {
+                    // AMD XOP 编码，不支持
+                    return false;
+                } else if (op == 0xFF && (reg == 2 || reg == 3)) {
+                    flow = Flow::indirect_call;
+                } else if (op == 0xFF && (reg == 4 || reg == 5)) {
+                    flow = Flow::indirect_jump;
+                }
+            }
+        }
+
+        i += imm;
+        if (i > size) {
+            return false;
+        }
+
+        insn.length = i;
+        insn.flow = flow;
+        insn.target = 0;
+        insn.disp_offset = disp_offset;
+        if (relative) {
+            insn.target = addr + static_cast<std::intptr_t>(i) + read_signed(code + i - imm, imm);
+        }
+        return true;
+    }
+
+    // 是否会离开顺序执行
+    static auto changes_flow(Instruction const& insn) -> bool {
+        return insn.flow != Flow::sequential;
+    }
+
+public:
+    static const std::size_t max_length = 15;
+
+private:
+    // 单字节操作码是否带 ModRM
+    // 表放在函数里，多个编译单元包含这个头文件时只有一份定义
+    static auto one_byte_has_modrm(uint8_t op) -> bool {
+        // 每行 16 个操作码，第 n 位对应低 4 位为 n 的操作码
+        static const uint16_t table[16] = {
+            0x0F0F, 0x0F0F, 0x0F0F, 0x0F0F, 0x0000, 0x0000, 0x0A08, 0x0000,
+            0xFFFF, 0x0000, 0x0000, 0x0000, 0x00C3, 0xFF0F, 0x0000, 0xC0C0,
+        };
+        return table[op >> 4] & (1 << (op & 0x0F));
+    }
+
+    static auto invalid_in_64bit(uint8_t op) -> bool {
+        switch (op) {
+        case 0x06: case 0x07: case 0x0E: case 0x16: case 0x17: case 0x1E: case 0x1F:
+        case 0x27: case 0x2F: case 0x37: case 0x3F: case 0x60: case 0x61: case 0x82:
+        case 0x9A: case 0xCE: case 0xD4: case 0xD5: case 0xD6: case 0xEA:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static auto one_byte_immediate(uint8_t op, std::size_t imm_z, bool rex_w, bool addr32) -> std::size_t {
+        if (op < 0x40) {
+            if ((op & 0x07) == 0x04) {
+                return 1;
+            }
+            if ((op & 0x07) == 0x05) {
+                return imm_z;
+            }
+            return 0;
+        }
+        if (op >= 0x70 && op <= 0x7F) {
+            return 1;
+        }
+        if (op >= 0xB0 && op <= 0xB7) {
+            return 1;
+        }
+        if (op >= 0xB8 && op <= 0xBF) {
+            return rex_w ? 8 : imm_z;
+        }
+        if (op >= 0xA0 && op <= 0xA3) {
+            return addr32 ? 4 : 8;
+        }
+        if (op >= 0xE0 && op <= 0xE7) {
+            return 1;
+        }
+        switch (op) {
+        case 0x6A: case 0x6B: case 0x80: case 0x83: case 0xA8: case 0xC0: case 0xC1:
+        case 0xC6: case 0xCD: case 0xEB:
+            return 1;
+        case 0xC2: case 0xCA:
+            return 2;
+        case 0xC8:
+            return 3;
+        case 0x68: case 0x69: case 0x81: case 0xA9: case 0xC7:
+            return imm_z;
+        case 0xE8: case 0xE9:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    static auto two_byte_without_modrm(uint8_t op) -> bool {
+        if ((op >= 0x30 && op <= 0x37) || (op >= 0x80 && op <= 0x8F) || (op >= 0xC8 && op <= 0xCF)) {
+            return true;
+        }
+        switch (op) {
+        case 0x05: case 0x06: case 0x07: case 0x08: case 0x09: case 0x0B: case 0x0E:
+        case 0x77: case 0xA0: case 0xA1: case 0xA2: case 0xA8: case 0xA9: case 0xAA:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static auto read_signed(uint8_t const *p, std::size_t size) -> std::intptr_t {
+        switch (size) {
+        case 1: {
+            int8_t v;
+            memcpy(&v, p, 1);
+            return v;
+        }
+        case 2: {
+            int16_t v;
+            memcpy(&v, p, 2);
+            return v;
+        }
+        default: {
+            int32_t v;
+            memcpy(&v, p, 4);
+            return v;
+        }
+        }
+    }
+};
+
+}
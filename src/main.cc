@@ -7,14 +7,30 @@
 
 
 int main(int argc, const char *argv[]) {
-    if (argc < 2) {
+    auto is_attach = argc >= 2 && strcmp(argv[1], "-p") == 0;
+    if (argc < 2 || (is_attach && argc < 3)) {
         auto argv0 = strdup(argv[0]);
-        fprintf(stderr, "usage: %s <program>\n", basename(argv0));
+        fprintf(stderr, "usage: %s <program>\n       %s -p <pid>\n", basename(argv0), basename(argv0));
         exit(EXIT_FAILURE);
     }
 
-    BitTech::Debugger debugger{argv[1]};
+    // -p <pid> 时调试的程序就是进程正在运行的可执行文件
+    std::string program{argv[1]};
+    pid_t pid = -1;
+    if (is_attach) {
+        pid = atoi(argv[2]);
+        program = BitTech::Inferior::executable_of(pid);
+        if (program.empty()) {
+            fprintf(stderr, "无法读取进程 %s 的可执行文件\n", argv[2]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    BitTech::Debugger debugger{program};
     try {
+        if (is_attach) {
+            debugger.attach(pid);
+        }
         debugger.run();
     } catch (BitTech::exception const& exc) {
         printf("%s: %d: %s\n", exc.file.c_str(), exc.line, exc.reason.c_str());